@@ -0,0 +1,903 @@
+#include "admm_interface.hpp"
+#include "index_expr.hpp"
+#include "utils/logging.hpp"
+#include "utils/stl_to_string.hpp"
+#include "macros.h"
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <iostream>
+
+using namespace std;
+using Eigen::VectorXd;
+
+namespace sco {
+
+static const double RHO_MIN = 1e-6, RHO_MAX = 1e6;
+static const double RHO_EQ_OVER_RHO_INEQ = 1e3;
+static const double RHO_ADAPT_TOLERANCE = 5;
+static const double MIN_SCALING = 1e-4, MAX_SCALING = 1e4;
+
+typedef Eigen::Triplet<double> Triplet;
+
+ADMMSettings::ADMMSettings() :
+  rho(.1),
+  sigma(1e-6),
+  alpha(1.6),
+  eps_abs(1e-5),
+  eps_rel(1e-5),
+  eps_prim_inf(1e-5),
+  polish_delta(1e-6),
+  max_iter(10000),
+  scaling_iter(10),
+  check_interval(25),
+  polish_refine_iter(3),
+  adaptive_rho(true),
+  polish(true)
+{}
+
+ModelPtr createADMMModel() {
+  ModelPtr out(new ADMMModel());
+  return out;
+}
+
+ADMMModel::ADMMModel() :
+  obj_const_(0),
+  kkt_banded_(false),
+  kkt_analyzed_(false),
+  kkt_factorized_(false),
+  n_factorizations_(0),
+  n_analyses_(0),
+  rho_(settings.rho),
+  has_warm_start_(false),
+  last_iter_(0),
+  persistent_(false)
+{}
+
+Var ADMMModel::addVar(const string& name) {
+  return addVar(name, -INFINITY, INFINITY);
+}
+
+Var ADMMModel::addVar(const string& name, double lb, double ub) {
+  if (!free_vars_.empty()) {
+    Var var = free_vars_.front();
+    free_vars_.pop_front();
+    var.var_rep->name = name;
+    setVarBounds(var, lb, ub);
+    var_stages_[var.var_rep->index] = -1;
+    return var;
+  }
+  vars.push_back(var_pool_.create(VarRep(vars.size(), name, this)));
+  lbs_.push_back(lb);
+  ubs_.push_back(ub);
+  var_stages_.push_back(-1);
+  obj_lin_.push_back(0);
+  return vars.back();
+}
+
+Cnt ADMMModel::addRow(const AffExpr& expr, ConstraintType type, const string& name) {
+  Row row;
+  row.inds.resize(expr.size());
+  for (size_t i=0; i < expr.size(); ++i) {
+    assert(expr.vars[i].var_rep->creator == this);
+    row.inds[i] = expr.vars[i].var_rep->index;
+  }
+  row.vals = expr.coeffs;
+  row.rhs = -expr.constant;
+  row.type = type;
+  row.name = name;
+  return addRow(row);
+}
+
+Cnt ADMMModel::addRow(const Row& row) {
+  if (!free_cnts_.empty()) {
+    Cnt cnt = free_cnts_.front();
+    free_cnts_.pop_front();
+    rows_[cnt.cnt_rep->index] = row;
+    cnt.cnt_rep->type = row.type;
+    return cnt;
+  }
+  rows_.push_back(row);
+  cnts.push_back(cnt_pool_.create(CntRep(cnts.size(), this)));
+  cnts.back().cnt_rep->type = row.type;
+  return cnts.back();
+}
+
+vector<Cnt> ADMMModel::addRows(const AffExprBlock& block, ConstraintType type) {
+  IntVec row_ptr, inds;
+  DblVec vals;
+  compressor_.compress(block, row_ptr, inds, vals);
+  vector<Cnt> out(block.rows());
+  rows_.reserve(rows_.size() + std::max<int>(block.rows() - free_cnts_.size(), 0));
+  Row row;
+  row.type = type;
+  for (int i=0; i < block.rows(); ++i) {
+    row.inds.assign(inds.begin() + row_ptr[i], inds.begin() + row_ptr[i+1]);
+    row.vals.assign(vals.begin() + row_ptr[i], vals.begin() + row_ptr[i+1]);
+    row.rhs = -block.constants[i];
+    out[i] = addRow(row);
+  }
+  return out;
+}
+
+Cnt ADMMModel::addEqCnt(const AffExpr& expr, const string& name) {
+  LOG_DEBUG("adding eq: %s == 0", CSTR(expr));
+  return addRow(expr, EQ, name);
+}
+Cnt ADMMModel::addIneqCnt(const AffExpr& expr, const string& name) {
+  LOG_DEBUG("adding ineq: %s <= 0", CSTR(expr));
+  return addRow(expr, INEQ, name);
+}
+vector<Cnt> ADMMModel::addEqCnts(const AffExprBlock& block) {
+  return addRows(block, EQ);
+}
+vector<Cnt> ADMMModel::addIneqCnts(const AffExprBlock& block) {
+  return addRows(block, INEQ);
+}
+Cnt ADMMModel::addIneqCnt(const QuadExpr&, const string& name) {
+  PRINT_AND_THROW("NOT IMPLEMENTED");
+  return 0;
+}
+
+void ADMMModel::removeVar(const Var& var) {
+  assert(var.var_rep->creator == this);
+  if (persistent_) {
+    setVarBounds(var, 0, 0);
+    free_vars_.push_back(var);
+    return;
+  }
+  var.var_rep->removed = true;
+}
+
+void ADMMModel::removeCnt(const Cnt& cnt) {
+  assert(cnt.cnt_rep->creator == this);
+  if (persistent_) {
+    Row& row = rows_[cnt.cnt_rep->index];
+    row.inds.clear();
+    row.vals.clear();
+    row.rhs = 0;
+    free_cnts_.push_back(cnt);
+    return;
+  }
+  cnt.cnt_rep->removed = true;
+}
+
+void ADMMModel::setPersistentStructure(bool persistent) {
+  persistent_ = persistent;
+  if (!persistent) {
+    BOOST_FOREACH(const Var& var, free_vars_) removeVar(var);
+    BOOST_FOREACH(const Cnt& cnt, free_cnts_) removeCnt(cnt);
+    free_vars_.clear();
+    free_cnts_.clear();
+  }
+}
+
+void ADMMModel::setVarStages(const VarVector& vars, const IntVec& stages) {
+  assert(vars.size() == stages.size());
+  for (size_t i=0; i < vars.size(); ++i) {
+    assert(vars[i].var_rep->creator == this);
+    var_stages_[vars[i].var_rep->index] = stages[i];
+  }
+}
+
+bool ADMMModel::hasStages() const {
+  return std::find_if(var_stages_.begin(), var_stages_.end(), std::bind2nd(std::greater_equal<int>(), 0)) != var_stages_.end();
+}
+
+void ADMMModel::update() {
+  IntVec old2new(vars.size(), -1);
+  {
+  int inew = 0;
+  for (size_t iold=0; iold < vars.size(); ++iold) {
+    const Var& var = vars[iold];
+    if (!var.var_rep->removed) {
+      vars[inew] = var;
+      lbs_[inew] = lbs_[iold];
+      ubs_[inew] = ubs_[iold];
+      var_stages_[inew] = var_stages_[iold];
+      obj_lin_[inew] = obj_lin_[iold];
+      if (iold < solution_.size()) solution_[inew] = solution_[iold];
+      if (iold < bound_duals_.size()) bound_duals_[inew] = bound_duals_[iold];
+      var.var_rep->index = inew;
+      old2new[iold] = inew;
+      ++inew;
+    }
+    else var_pool_.destroy(var.var_rep);
+  }
+  bool changed = (inew != (int)vars.size());
+  vars.resize(inew);
+  lbs_.resize(inew);
+  ubs_.resize(inew);
+  var_stages_.resize(inew);
+  obj_lin_.resize(inew);
+  if (solution_.size() > vars.size()) solution_.resize(inew);
+  if (bound_duals_.size() > vars.size()) bound_duals_.resize(inew);
+
+  if (changed) {
+    BOOST_FOREACH(Row& row, rows_) {
+      int knew = 0;
+      for (size_t k=0; k < row.inds.size(); ++k) {
+        int ind = old2new[row.inds[k]];
+        if (ind >= 0) {
+          row.inds[knew] = ind;
+          row.vals[knew] = row.vals[k];
+          ++knew;
+        }
+      }
+      row.inds.resize(knew);
+      row.vals.resize(knew);
+    }
+    int knew = 0;
+    for (size_t k=0; k < obj_quad_.size(); ++k) {
+      int ind1 = old2new[obj_inds1_[k]], ind2 = old2new[obj_inds2_[k]];
+      if (ind1 >= 0 && ind2 >= 0) {
+        obj_inds1_[knew] = ind1;
+        obj_inds2_[knew] = ind2;
+        obj_quad_[knew] = obj_quad_[k];
+        ++knew;
+      }
+    }
+    obj_inds1_.resize(knew);
+    obj_inds2_.resize(knew);
+    obj_quad_.resize(knew);
+  }
+  }
+  {
+  int inew = 0;
+  for (size_t iold=0; iold < cnts.size(); ++iold) {
+    const Cnt& cnt = cnts[iold];
+    if (!cnt.cnt_rep->removed) {
+      cnts[inew] = cnt;
+      if (inew != (int)iold) rows_[inew] = rows_[iold];
+      if (iold < row_duals_.size()) row_duals_[inew] = row_duals_[iold];
+      cnt.cnt_rep->index = inew;
+      ++inew;
+    }
+    else cnt_pool_.destroy(cnt.cnt_rep);
+  }
+  cnts.resize(inew);
+  rows_.resize(inew);
+  if (row_duals_.size() > cnts.size()) row_duals_.resize(inew);
+  }
+}
+
+void ADMMModel::setVarBounds(const Var& var, double lower, double upper) {
+  assert(var.var_rep->creator == this);
+  lbs_[var.var_rep->index] = lower;
+  ubs_[var.var_rep->index] = upper;
+}
+
+void ADMMModel::setVarBounds(const VarVector& vars, const vector<double>& lower, const vector<double>& upper) {
+  assert(vars.size() == lower.size() && vars.size() == upper.size());
+  for (size_t i=0; i < vars.size(); ++i) setVarBounds(vars[i], lower[i], upper[i]);
+}
+
+double ADMMModel::getVarValue(const Var& var) const {
+  assert(var.var_rep->creator == this);
+  if (var.var_rep->index >= (int)solution_.size()) PRINT_AND_THROW("variable has no value. call optimize() first");
+  return solution_[var.var_rep->index];
+}
+
+vector<double> ADMMModel::getVarValues(const vector<Var>& vars) const {
+  vector<double> out(vars.size());
+  for (size_t i=0; i < vars.size(); ++i) out[i] = getVarValue(vars[i]);
+  return out;
+}
+
+vector<double> ADMMModel::getDualValues(const vector<Cnt>& cnts) const {
+  vector<double> out(cnts.size());
+  for (size_t i=0; i < cnts.size(); ++i) {
+    assert(cnts[i].cnt_rep->creator == this);
+    int ind = cnts[i].cnt_rep->index;
+    if (ind >= (int)row_duals_.size()) PRINT_AND_THROW("constraint has no dual value. call optimize() first");
+    out[i] = row_duals_[ind];
+  }
+  return out;
+}
+
+void ADMMModel::setWarmStart(const vector<double>& primal, const vector<double>& dual) {
+  warm_primal_ = primal;
+  warm_dual_ = dual;
+  has_warm_start_ = true;
+}
+
+void ADMMModel::setObjective(const AffExpr& expr) {
+  std::fill(obj_lin_.begin(), obj_lin_.end(), 0.);
+  for (size_t i=0; i < expr.size(); ++i) {
+    assert(expr.vars[i].var_rep->creator == this);
+    obj_lin_[expr.vars[i].var_rep->index] += expr.coeffs[i];
+  }
+  obj_const_ = expr.constant;
+  obj_inds1_.clear();
+  obj_inds2_.clear();
+  obj_quad_.clear();
+}
+
+void ADMMModel::setObjective(const QuadExpr& quad_expr) {
+  setObjective(quad_expr.affexpr);
+  obj_inds1_.resize(quad_expr.size());
+  obj_inds2_.resize(quad_expr.size());
+  for (size_t i=0; i < quad_expr.size(); ++i) {
+    obj_inds1_[i] = quad_expr.vars1[i].var_rep->index;
+    obj_inds2_[i] = quad_expr.vars2[i].var_rep->index;
+  }
+  obj_quad_ = quad_expr.coeffs;
+}
+
+void ADMMModel::setObjective(const IndexQuadExpr& expr) {
+  std::fill(obj_lin_.begin(), obj_lin_.end(), 0.);
+  for (size_t i=0; i < expr.affexpr.size(); ++i) obj_lin_[expr.affexpr.inds[i]] += expr.affexpr.coeffs[i];
+  obj_const_ = expr.affexpr.constant;
+  obj_inds1_.assign(expr.inds1.begin(), expr.inds1.end());
+  obj_inds2_.assign(expr.inds2.begin(), expr.inds2.end());
+  obj_quad_.assign(expr.coeffs.begin(), expr.coeffs.end());
+}
+
+VarVector ADMMModel::getVars() const {
+  return vars;
+}
+vector<Cnt> ADMMModel::getCnts() const {
+  return cnts;
+}
+RecordStats ADMMModel::getRecordStats() const {
+  return RecordStats(var_pool_.numCreated() + cnt_pool_.numCreated(),
+      var_pool_.numHeapAllocations() + cnt_pool_.numHeapAllocations());
+}
+int ADMMModel::getNumNonzeros() const {
+  int nnz = 0;
+  BOOST_FOREACH(const Row& row, rows_) nnz += row.inds.size();
+  return nnz;
+}
+
+void ADMMModel::buildProblem(SparseMatrixd& P, VectorXd& q, SparseMatrixd& A, VectorXd& l, VectorXd& u) {
+  int nvars = vars.size(), mrows = rows_.size();
+
+  // variables with equal bounds are substituted out, and the columns of the QP are the remaining ones
+  IntVec var2col(nvars, -1);
+  free_cols_.clear();
+  for (int j=0; j < nvars; ++j) {
+    if (lbs_[j] != ubs_[j]) {
+      var2col[j] = free_cols_.size();
+      free_cols_.push_back(j);
+    }
+  }
+  int n = free_cols_.size(), m = mrows + n;
+  bool reduced = (n < nvars);
+  VectorXd xfixed = VectorXd::Zero(nvars);
+  if (reduced) {
+    for (int j=0; j < nvars; ++j) if (var2col[j] < 0) xfixed(j) = lbs_[j];
+  }
+
+  // objective is 1/2 x'Px + q'x, and P only stores the upper triangle.
+  // the diagonal is the last entry of each column, and gets a factor of 2
+  obj_hessian_.update(obj_inds1_.data(), obj_inds2_.data(), obj_quad_.data(), obj_quad_.size(), nvars);
+  P = Eigen::Map<const SparseMatrixd>(nvars, nvars, obj_hessian_.nonZeros(), obj_hessian_.colPtr().data(),
+      obj_hessian_.rowInd().data(), obj_hessian_.values().data());
+  for (int j=0; j < nvars; ++j) {
+    int last = P.outerIndexPtr()[j+1] - 1;
+    if (last >= P.outerIndexPtr()[j] && P.innerIndexPtr()[last] == j) P.valuePtr()[last] *= 2;
+  }
+  q = Eigen::Map<const VectorXd>(obj_lin_.data(), nvars);
+  if (reduced) {
+    VectorXd qfull = q + P.selfadjointView<Eigen::Upper>() * xfixed;
+    vector<Triplet> ptrips;
+    ptrips.reserve(P.nonZeros());
+    for (int j=0; j < nvars; ++j) {
+      if (var2col[j] < 0) continue;
+      for (SparseMatrixd::InnerIterator it(P, j); it; ++it) {
+        if (var2col[it.row()] >= 0) ptrips.push_back(Triplet(var2col[it.row()], var2col[j], it.value()));
+      }
+    }
+    P.resize(n, n);
+    P.setFromTriplets(ptrips.begin(), ptrips.end());
+    q.resize(n);
+    for (int k=0; k < n; ++k) q(k) = qfull(free_cols_[k]);
+  }
+
+  // constraint rows followed by one row per variable for the bounds
+  size_t nnz = n;
+  BOOST_FOREACH(const Row& row, rows_) nnz += row.inds.size();
+  vector<Triplet> atrips;
+  atrips.reserve(nnz);
+  l.resize(m);
+  u.resize(m);
+  for (int i=0; i < mrows; ++i) {
+    const Row& row = rows_[i];
+    double rhs = row.rhs;
+    for (size_t k=0; k < row.inds.size(); ++k) {
+      int col = var2col[row.inds[k]];
+      if (col >= 0) atrips.push_back(Triplet(i, col, row.vals[k]));
+      else rhs -= row.vals[k] * xfixed(row.inds[k]);
+    }
+    l(i) = (row.type == EQ) ? rhs : -INFINITY;
+    u(i) = rhs;
+  }
+  for (int k=0; k < n; ++k) {
+    atrips.push_back(Triplet(mrows+k, k, 1));
+    l(mrows+k) = lbs_[free_cols_[k]];
+    u(mrows+k) = ubs_[free_cols_[k]];
+  }
+  A.resize(m, n);
+  A.setFromTriplets(atrips.begin(), atrips.end());
+}
+
+// multipliers of the bounds of the variables that were substituted out, from the stationarity condition
+// of the full problem: obj gradient + sum of row multipliers * row coefficients + bound multiplier = 0
+void ADMMModel::computeFixedBoundDuals() {
+  int nvars = vars.size();
+  DblVec grad(obj_lin_);
+  for (size_t k=0; k < obj_quad_.size(); ++k) {
+    grad[obj_inds1_[k]] += obj_quad_[k] * solution_[obj_inds2_[k]];
+    grad[obj_inds2_[k]] += obj_quad_[k] * solution_[obj_inds1_[k]];
+  }
+  for (size_t i=0; i < rows_.size(); ++i) {
+    const Row& row = rows_[i];
+    for (size_t k=0; k < row.inds.size(); ++k) grad[row.inds[k]] += row.vals[k] * row_duals_[i];
+  }
+  for (int j=0; j < nvars; ++j) {
+    if (lbs_[j] == ubs_[j]) bound_duals_[j] = -grad[j];
+  }
+}
+
+static inline double limitScaling(double norm) {
+  if (norm < MIN_SCALING) return 1;
+  return 1/sqrt(std::min(norm, MAX_SCALING));
+}
+
+void ADMMModel::scaleProblem(SparseMatrixd& P, VectorXd& q, SparseMatrixd& A, VectorXd& l, VectorXd& u,
+    VectorXd& D, VectorXd& E, double& c) {
+  // Ruiz equilibration of the KKT matrix [P A'; A 0], followed by scaling of the cost
+  int n = P.rows(), m = A.rows();
+  D = VectorXd::Ones(n);
+  E = VectorXd::Ones(m);
+  c = 1;
+  VectorXd Dt(n), Et(m);
+  for (int iter=0; iter < settings.scaling_iter; ++iter) {
+    Dt.setZero();
+    Et.setZero();
+    for (int j=0; j < P.outerSize(); ++j) {
+      for (SparseMatrixd::InnerIterator it(P, j); it; ++it) {
+        double a = fabs(it.value());
+        Dt(j) = std::max(Dt(j), a);
+        Dt(it.row()) = std::max(Dt(it.row()), a);
+      }
+    }
+    for (int j=0; j < A.outerSize(); ++j) {
+      for (SparseMatrixd::InnerIterator it(A, j); it; ++it) {
+        double a = fabs(it.value());
+        Dt(j) = std::max(Dt(j), a);
+        Et(it.row()) = std::max(Et(it.row()), a);
+      }
+    }
+    for (int j=0; j < n; ++j) Dt(j) = limitScaling(Dt(j));
+    for (int i=0; i < m; ++i) Et(i) = limitScaling(Et(i));
+
+    for (int j=0; j < P.outerSize(); ++j) {
+      for (SparseMatrixd::InnerIterator it(P, j); it; ++it) it.valueRef() *= Dt(it.row()) * Dt(j);
+    }
+    for (int j=0; j < A.outerSize(); ++j) {
+      for (SparseMatrixd::InnerIterator it(A, j); it; ++it) it.valueRef() *= Et(it.row()) * Dt(j);
+    }
+    q = q.cwiseProduct(Dt);
+    D = D.cwiseProduct(Dt);
+    E = E.cwiseProduct(Et);
+
+    VectorXd pnorms = VectorXd::Zero(n);
+    for (int j=0; j < P.outerSize(); ++j) {
+      for (SparseMatrixd::InnerIterator it(P, j); it; ++it) {
+        double a = fabs(it.value());
+        pnorms(j) = std::max(pnorms(j), a);
+        pnorms(it.row()) = std::max(pnorms(it.row()), a);
+      }
+    }
+    double cost_norm = std::max(n > 0 ? pnorms.mean() : 0., q.size() > 0 ? q.lpNorm<Eigen::Infinity>() : 0.);
+    double ct = (cost_norm < MIN_SCALING) ? 1 : 1/std::min(cost_norm, MAX_SCALING);
+    P *= ct;
+    q *= ct;
+    c *= ct;
+  }
+  l = l.cwiseProduct(E);
+  u = u.cwiseProduct(E);
+}
+
+void ADMMModel::computeRhoVec(const VectorXd& l, const VectorXd& u, double rho, VectorXd& rho_vec) {
+  rho_vec.resize(l.size());
+  for (int i=0; i < l.size(); ++i) {
+    if (l(i) == -INFINITY && u(i) == INFINITY) rho_vec(i) = RHO_MIN;
+    else if (u(i) - l(i) < 1e-10 * (1 + fabs(u(i)))) rho_vec(i) = RHO_EQ_OVER_RHO_INEQ * rho;
+    else rho_vec(i) = rho;
+  }
+}
+
+// Orders the KKT matrix by time step. A row's step is the last step of the variables in it, and a variable
+// without a step goes with the last step of the rows it's in, so that it's eliminated along with the
+// variables it's coupled to. Whatever is still unassigned goes at the end.
+void ADMMModel::computeStageOrdering(const SparseMatrixd& A, IntVec& perm) const {
+  int n = A.cols(), m = A.rows();
+  IntVec var_stage(n), row_stage(m, -1);
+  for (int j=0; j < n; ++j) var_stage[j] = var_stages_[free_cols_[j]];
+  for (int j=0; j < n; ++j) {
+    if (var_stage[j] < 0) continue;
+    for (SparseMatrixd::InnerIterator it(A, j); it; ++it) row_stage[it.row()] = std::max(row_stage[it.row()], var_stage[j]);
+  }
+  for (int j=0; j < n; ++j) {
+    if (var_stage[j] >= 0) continue;
+    for (SparseMatrixd::InnerIterator it(A, j); it; ++it) var_stage[j] = std::max(var_stage[j], row_stage[it.row()]);
+  }
+  for (int j=0; j < n; ++j) {
+    for (SparseMatrixd::InnerIterator it(A, j); it; ++it) row_stage[it.row()] = std::max(row_stage[it.row()], var_stage[j]);
+  }
+  int n_stages = 1 + std::max(*std::max_element(var_stage.begin(), var_stage.end()),
+                              m > 0 ? *std::max_element(row_stage.begin(), row_stage.end()) : -1);
+
+  // stable counting sort on the key 2*stage (rows) or 2*stage+1 (variables). eliminating a row before its
+  // variables only couples those variables, which are in the band anyway
+  IntVec keys(n+m);
+  for (int j=0; j < n; ++j) keys[j] = 2*(var_stage[j] >= 0 ? var_stage[j] : n_stages) + 1;
+  for (int i=0; i < m; ++i) keys[n+i] = 2*(row_stage[i] >= 0 ? row_stage[i] : n_stages);
+  IntVec start(2*n_stages + 3, 0);
+  for (int k=0; k < n+m; ++k) ++start[keys[k]+1];
+  for (size_t s=1; s < start.size(); ++s) start[s] += start[s-1];
+  perm.resize(n+m);
+  for (int k=0; k < n+m; ++k) perm[k] = start[keys[k]]++;
+}
+
+bool ADMMModel::factorizeKKT(const SparseMatrixd& P, const SparseMatrixd& A, const VectorXd& rho_vec) {
+  int n = P.rows(), m = A.rows();
+  bool banded = n > 0 && hasStages();
+  vector<Triplet> trips;
+  trips.reserve(P.nonZeros() + A.nonZeros() + n + m);
+  for (int j=0; j < P.outerSize(); ++j) {
+    for (SparseMatrixd::InnerIterator it(P, j); it; ++it) trips.push_back(Triplet(it.row(), j, it.value()));
+    trips.push_back(Triplet(j, j, settings.sigma));
+  }
+  for (int j=0; j < A.outerSize(); ++j) {
+    for (SparseMatrixd::InnerIterator it(A, j); it; ++it) trips.push_back(Triplet(j, n + it.row(), it.value()));
+  }
+  for (int i=0; i < m; ++i) trips.push_back(Triplet(n+i, n+i, -1/rho_vec(i)));
+  if (banded) {
+    computeStageOrdering(A, kkt_perm_);
+    for (size_t k=0; k < trips.size(); ++k) {
+      int i = kkt_perm_[trips[k].row()], j = kkt_perm_[trips[k].col()];
+      trips[k] = Triplet(std::min(i, j), std::max(i, j), trips[k].value());
+    }
+  }
+  SparseMatrixd K(n+m, n+m);
+  K.setFromTriplets(trips.begin(), trips.end());
+  K.makeCompressed();
+
+  const int* outer = K.outerIndexPtr();
+  const int* inner = K.innerIndexPtr();
+  const double* values = K.valuePtr();
+  int nnz = K.nonZeros();
+  bool same_pattern = kkt_analyzed_ && kkt_banded_ == banded
+      && kkt_outer_.size() == size_t(n+m+1) && std::equal(outer, outer+n+m+1, kkt_outer_.begin())
+      && kkt_inner_.size() == size_t(nnz) && std::equal(inner, inner+nnz, kkt_inner_.begin());
+  if (!same_pattern) {
+    if (banded) banded_ldlt_.analyzePattern(K);
+    else ldlt_.analyzePattern(K);
+    kkt_banded_ = banded;
+    ++n_analyses_;
+    kkt_outer_.assign(outer, outer+n+m+1);
+    kkt_inner_.assign(inner, inner+nnz);
+    kkt_analyzed_ = true;
+    kkt_factorized_ = false;
+  }
+  if (!kkt_factorized_ || !std::equal(values, values+nnz, kkt_values_.begin())) {
+    if (banded) banded_ldlt_.factorize(K);
+    else ldlt_.factorize(K);
+    ++n_factorizations_;
+    kkt_values_.assign(values, values+nnz);
+    kkt_factorized_ = ((banded ? banded_ldlt_.info() : ldlt_.info()) == Eigen::Success);
+  }
+  return kkt_factorized_;
+}
+
+VectorXd ADMMModel::solveKKT(const VectorXd& rhs) const {
+  if (!kkt_banded_) return ldlt_.solve(rhs);
+  VectorXd prhs(rhs.size());
+  for (int k=0; k < rhs.size(); ++k) prhs(kkt_perm_[k]) = rhs(k);
+  VectorXd psol = banded_ldlt_.solve(prhs);
+  VectorXd sol(rhs.size());
+  for (int k=0; k < rhs.size(); ++k) sol(k) = psol(kkt_perm_[k]);
+  return sol;
+}
+
+int ADMMModel::numFactorNonzeros() const {
+  if (!kkt_factorized_) return 0;
+  return kkt_banded_ ? banded_ldlt_.matrixL().nestedExpression().nonZeros() : ldlt_.matrixL().nestedExpression().nonZeros();
+}
+
+static double residualScale(double a, double b, double c=0) {
+  return std::max(a, std::max(b, c));
+}
+
+bool ADMMModel::polishSolution(const SparseMatrixd& P, const VectorXd& q, const SparseMatrixd& A,
+    const VectorXd& l, const VectorXd& u, VectorXd& x, VectorXd& z, VectorXd& y) {
+  // guess the active set from the ADMM iterate and solve the resulting
+  // equality constrained QP, with a few steps of iterative refinement
+  int n = x.size(), m = z.size();
+  IntVec row2act(m, -1);
+  IntVec act;
+  DblVec actb;
+  vector<int> act_sign;
+  for (int i=0; i < m; ++i) {
+    int sign = 0;
+    if (l(i) == u(i)) sign = 2;
+    else if (z(i) - l(i) < -y(i)) sign = -1;
+    else if (u(i) - z(i) < y(i)) sign = 1;
+    if (sign != 0) {
+      row2act[i] = act.size();
+      act.push_back(i);
+      actb.push_back(sign == 1 ? u(i) : l(i));
+      act_sign.push_back(sign);
+    }
+  }
+  int na = act.size();
+
+  vector<Triplet> atrips, ktrips;
+  for (int j=0; j < A.outerSize(); ++j) {
+    for (SparseMatrixd::InnerIterator it(A, j); it; ++it) {
+      int k = row2act[it.row()];
+      if (k >= 0) {
+        atrips.push_back(Triplet(k, j, it.value()));
+        ktrips.push_back(Triplet(j, n+k, it.value()));
+      }
+    }
+  }
+  SparseMatrixd Aact(na, n);
+  Aact.setFromTriplets(atrips.begin(), atrips.end());
+  for (int j=0; j < P.outerSize(); ++j) {
+    for (SparseMatrixd::InnerIterator it(P, j); it; ++it) ktrips.push_back(Triplet(it.row(), j, it.value()));
+    ktrips.push_back(Triplet(j, j, settings.polish_delta));
+  }
+  for (int k=0; k < na; ++k) ktrips.push_back(Triplet(n+k, n+k, -settings.polish_delta));
+  SparseMatrixd K(n+na, n+na);
+  K.setFromTriplets(ktrips.begin(), ktrips.end());
+
+  LDLTSolver ldlt(K);
+  if (ldlt.info() != Eigen::Success) {
+    LOG_DEBUG("polishing failed: couldn't factorize reduced KKT matrix");
+    return false;
+  }
+  VectorXd rhs(n+na);
+  rhs.head(n) = -q;
+  rhs.tail(na) = Eigen::Map<const VectorXd>(actb.data(), na);
+  VectorXd sol = ldlt.solve(rhs);
+  for (int iter=0; iter < settings.polish_refine_iter; ++iter) {
+    VectorXd Ksol(n+na);
+    Ksol.head(n) = P.selfadjointView<Eigen::Upper>() * sol.head(n) + Aact.transpose() * sol.tail(na);
+    Ksol.tail(na) = Aact * sol.head(n);
+    sol += ldlt.solve(rhs - Ksol);
+  }
+
+  for (int k=0; k < na; ++k) {
+    if ((act_sign[k] == -1 && sol(n+k) > settings.eps_abs) || (act_sign[k] == 1 && sol(n+k) < -settings.eps_abs)) {
+      LOG_DEBUG("polishing failed: multiplier has the wrong sign");
+      return false;
+    }
+  }
+
+  VectorXd xpol = sol.head(n);
+  VectorXd ypol = VectorXd::Zero(m);
+  for (int k=0; k < na; ++k) ypol(act[k]) = sol(n+k);
+  VectorXd Axpol = A * xpol;
+  VectorXd zpol = Axpol.cwiseMax(l).cwiseMin(u);
+
+  double prim_res = (A*x - z).lpNorm<Eigen::Infinity>();
+  double dual_res = (P.selfadjointView<Eigen::Upper>()*x + q + A.transpose()*y).lpNorm<Eigen::Infinity>();
+  double prim_res_pol = (Axpol - zpol).lpNorm<Eigen::Infinity>();
+  double dual_res_pol = (P.selfadjointView<Eigen::Upper>()*xpol + q + A.transpose()*ypol).lpNorm<Eigen::Infinity>();
+  if (prim_res_pol <= std::max(prim_res, settings.eps_abs) && dual_res_pol <= std::max(dual_res, settings.eps_abs)) {
+    x = xpol;
+    y = ypol;
+    z = zpol;
+    return true;
+  }
+  LOG_DEBUG("polishing failed: residuals (%.2e, %.2e) are worse than (%.2e, %.2e)", prim_res_pol, dual_res_pol, prim_res, dual_res);
+  return false;
+}
+
+CvxOptStatus ADMMModel::optimize() {
+  SparseMatrixd P, A;
+  VectorXd q, l, u;
+  buildProblem(P, q, A, l, u);
+  int n = P.rows(), m = A.rows();
+  for (int i=0; i < m; ++i) {
+    if (l(i) > u(i)) {
+      LOG_DEBUG("row %i has inconsistent bounds %.3e > %.3e", i, l(i), u(i));
+      return CVX_INFEASIBLE;
+    }
+  }
+
+  VectorXd D, E;
+  double c;
+  scaleProblem(P, q, A, l, u, D, E, c);
+  VectorXd Dinv = D.cwiseInverse(), Einv = E.cwiseInverse();
+
+  VectorXd rho_vec;
+  computeRhoVec(l, u, rho_, rho_vec);
+  if (!factorizeKKT(P, A, rho_vec)) {
+    LOG_ERROR("ADMM solver: KKT factorization failed");
+    return CVX_FAILED;
+  }
+
+  VectorXd x = VectorXd::Zero(n), z = VectorXd::Zero(m), y = VectorXd::Zero(m);
+  if (has_warm_start_) {
+    // the iterates live in the scaled space: x = D xbar, y = E ybar / c, z = E^-1 zbar
+    int mrows = rows_.size();
+    for (int k=0; k < n; ++k) {
+      int j = free_cols_[k];
+      if (j < (int)warm_primal_.size()) x(k) = warm_primal_[j] / D(k);
+      if (j < (int)bound_duals_.size()) y(mrows+k) = c * bound_duals_[j] / E(mrows+k);
+    }
+    for (int i=0; i < std::min<int>(mrows, warm_dual_.size()); ++i) y(i) = c * warm_dual_[i] / E(i);
+    z = (A*x).cwiseMax(l).cwiseMin(u);
+    has_warm_start_ = false;
+  }
+  VectorXd rhs(n+m), sol(n+m), zrelax(m), znew(m), dy(m);
+  const double alpha = settings.alpha, sigma = settings.sigma;
+  bool converged = false, infeasible = false;
+  double prim_res = INFINITY, dual_res = INFINITY, eps_prim = 0, eps_dual = 0;
+  int iter;
+  for (iter=1; iter <= settings.max_iter; ++iter) {
+    rhs.head(n) = sigma*x - q;
+    rhs.tail(m) = z - y.cwiseQuotient(rho_vec);
+    sol = solveKKT(rhs);
+    zrelax = alpha*(z + (sol.tail(m) - y).cwiseQuotient(rho_vec)) + (1-alpha)*z;
+    x = alpha*sol.head(n) + (1-alpha)*x;
+    znew = (zrelax + y.cwiseQuotient(rho_vec)).cwiseMax(l).cwiseMin(u);
+    dy = rho_vec.cwiseProduct(zrelax - znew);
+    y += dy;
+    z = znew;
+
+    if (iter % settings.check_interval != 0 && iter != settings.max_iter) continue;
+
+    // residuals of the unscaled problem
+    VectorXd Ax = A*x, Px = P.selfadjointView<Eigen::Upper>()*x, Aty = A.transpose()*y;
+    prim_res = Einv.cwiseProduct(Ax - z).lpNorm<Eigen::Infinity>();
+    dual_res = Dinv.cwiseProduct(Px + q + Aty).lpNorm<Eigen::Infinity>() / c;
+    double prim_scale = residualScale(Einv.cwiseProduct(Ax).lpNorm<Eigen::Infinity>(), Einv.cwiseProduct(z).lpNorm<Eigen::Infinity>());
+    double dual_scale = residualScale(Dinv.cwiseProduct(Px).lpNorm<Eigen::Infinity>(), Dinv.cwiseProduct(Aty).lpNorm<Eigen::Infinity>(),
+        Dinv.cwiseProduct(q).lpNorm<Eigen::Infinity>()) / c;
+    eps_prim = settings.eps_abs + settings.eps_rel * prim_scale;
+    eps_dual = settings.eps_abs + settings.eps_rel * dual_scale;
+    if (prim_res <= eps_prim && dual_res <= eps_dual) {
+      converged = true;
+      break;
+    }
+
+    // certificate of primal infeasibility: A'dy = 0 and u'max(dy,0) + l'min(dy,0) < 0
+    double dy_norm = E.cwiseProduct(dy).lpNorm<Eigen::Infinity>();
+    if (dy_norm > 1e-12) {
+      VectorXd dyn = dy / dy_norm;
+      if (Dinv.cwiseProduct(A.transpose()*dyn).lpNorm<Eigen::Infinity>() < settings.eps_prim_inf) {
+        double support = 0;
+        for (int i=0; i < m; ++i) {
+          if (fabs(dyn(i)) < settings.eps_prim_inf) continue;
+          double bound = (dyn(i) > 0) ? u(i) : l(i);
+          if (std::isinf(bound)) {support = INFINITY; break;}
+          support += bound * dyn(i);
+        }
+        if (support < -settings.eps_prim_inf) {
+          infeasible = true;
+          break;
+        }
+      }
+    }
+
+    if (settings.adaptive_rho) {
+      double ratio = sqrt((prim_res / (prim_scale + 1e-10)) / (dual_res / (dual_scale + 1e-10) + 1e-10));
+      double new_rho = std::min(std::max(rho_ * ratio, RHO_MIN), RHO_MAX);
+      if (new_rho > RHO_ADAPT_TOLERANCE * rho_ || new_rho < rho_ / RHO_ADAPT_TOLERANCE) {
+        LOG_TRACE("ADMM solver: rho %.3e -> %.3e at iteration %i", rho_, new_rho, iter);
+        rho_ = new_rho;
+        computeRhoVec(l, u, rho_, rho_vec);
+        if (!factorizeKKT(P, A, rho_vec)) {
+          LOG_ERROR("ADMM solver: KKT factorization failed");
+          return CVX_FAILED;
+        }
+      }
+    }
+  }
+  last_iter_ = std::min(iter, settings.max_iter);
+
+  if (infeasible) {
+    LOG_DEBUG("ADMM solver: problem is primal infeasible (%i iterations)", last_iter_);
+    return CVX_INFEASIBLE;
+  }
+
+  bool polished = settings.polish && polishSolution(P, q, A, l, u, x, z, y);
+  LOG_DEBUG("ADMM solver: %i iterations. residuals: primal %.3e dual %.3e. polished: %i", last_iter_, prim_res, dual_res, (int)polished);
+  int nvars = vars.size();
+  VectorXd x_unscaled = D.cwiseProduct(x), y_unscaled = E.cwiseProduct(y) / c;
+  row_duals_.assign(y_unscaled.data(), y_unscaled.data() + (m-n));
+  if (n == nvars) {
+    solution_.assign(x_unscaled.data(), x_unscaled.data() + n);
+    bound_duals_.assign(y_unscaled.data() + (m-n), y_unscaled.data() + m);
+  }
+  else {
+    solution_.assign(lbs_.begin(), lbs_.end());
+    bound_duals_.resize(nvars);
+    for (int k=0; k < n; ++k) {
+      solution_[free_cols_[k]] = x_unscaled(k);
+      bound_duals_[free_cols_[k]] = y_unscaled(m-n+k);
+    }
+    computeFixedBoundDuals();
+  }
+
+  if (converged || polished) return CVX_SOLVED;
+  if (prim_res <= 100*eps_prim && dual_res <= 100*eps_dual) {
+    LOG_WARN("ADMM solver: hit iteration limit. returning inaccurate solution (residuals %.2e, %.2e)", prim_res, dual_res);
+    return CVX_SOLVED;
+  }
+  return CVX_FAILED;
+}
+
+static string lpName(const Var& var) {
+  return (boost::format("%s_%i")%var.var_rep->name%var.var_rep->index).str();
+}
+
+static void writeLinearTerms(ostream& o, const IntVec& inds, const DblVec& vals, const vector<Var>& vars) {
+  for (size_t k=0; k < inds.size(); ++k) {
+    o << (vals[k] < 0 ? " - " : " + ") << fabs(vals[k]) << " " << lpName(vars[inds[k]]);
+  }
+}
+
+void ADMMModel::writeToFile(const string& fname) {
+  ofstream o(fname.c_str());
+  if (!o.good()) PRINT_AND_THROW("couldn't open " << fname << " for writing");
+  o.precision(17);
+  o << "\\ LP format. written by sco::ADMMModel. objective constant: " << obj_const_ << endl;
+  o << "Minimize" << endl << " obj:";
+  IntVec lin_inds;
+  DblVec lin_vals;
+  for (size_t i=0; i < obj_lin_.size(); ++i) {
+    if (obj_lin_[i] != 0) {
+      lin_inds.push_back(i);
+      lin_vals.push_back(obj_lin_[i]);
+    }
+  }
+  writeLinearTerms(o, lin_inds, lin_vals, vars);
+  if (obj_quad_.size() > 0) {
+    o << " + [";
+    for (size_t k=0; k < obj_quad_.size(); ++k) {
+      o << (obj_quad_[k] < 0 ? " - " : " + ") << 2*fabs(obj_quad_[k]) << " " << lpName(vars[obj_inds1_[k]]);
+      if (obj_inds1_[k] == obj_inds2_[k]) o << " ^ 2";
+      else o << " * " << lpName(vars[obj_inds2_[k]]);
+    }
+    o << " ] / 2";
+  }
+  o << endl << "Subject To" << endl;
+  for (size_t i=0; i < rows_.size(); ++i) {
+    const Row& row = rows_[i];
+    o << " R" << i << ":";
+    writeLinearTerms(o, row.inds, row.vals, vars);
+    if (row.inds.empty() && !vars.empty()) o << " 0 " << lpName(vars[0]);
+    o << (row.type == EQ ? " = " : " <= ") << row.rhs << endl;
+  }
+  o << "Bounds" << endl;
+  for (size_t j=0; j < vars.size(); ++j) {
+    if (lbs_[j] == -INFINITY && ubs_[j] == INFINITY) o << " " << lpName(vars[j]) << " free" << endl;
+    else {
+      o << " ";
+      if (lbs_[j] == -INFINITY) o << "-inf"; else o << lbs_[j];
+      o << " <= " << lpName(vars[j]) << " <= ";
+      if (ubs_[j] == INFINITY) o << "+inf"; else o << ubs_[j];
+      o << endl;
+    }
+  }
+  o << "End" << endl;
+}
+
+ADMMModel::~ADMMModel() {
+  BOOST_FOREACH(const Var& var, vars) var_pool_.destroy(var.var_rep);
+  BOOST_FOREACH(const Cnt& cnt, cnts) cnt_pool_.destroy(cnt.cnt_rep);
+}
+
+}
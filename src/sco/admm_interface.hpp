@@ -0,0 +1,170 @@
+#pragma once
+#include "solver_interface.hpp"
+#include "record_pool.hpp"
+#include "quad_csc.hpp"
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include <Eigen/SparseCholesky>
+#include <deque>
+
+/**
+
+@file admm_interface.hpp
+
+Built-in sparse QP backend (SOLVER_CUSTOM).
+
+Solves
+  minimize 1/2 x'Px + q'x  subject to  l <= Ax <= u
+with the operator splitting (ADMM) iteration used by OSQP, where the variable bounds
+are treated as extra rows of A. The quasi-definite KKT matrix
+  [P + sigma I, A'; A, -diag(1/rho)]
+is factorized with a sparse LDL' decomposition. Variables with equal bounds are substituted out
+beforehand, so they cost nothing in the factorization. The symbolic analysis is kept as long as
+the sparsity pattern is unchanged, and the numeric factorization is kept as long as the
+values are unchanged, which is the case when only the trust region bounds were modified.
+
+Trajectory problems (see Model::setVarStages) are factorized in time step order instead of with a
+general fill-reducing ordering: the constraint rows that end at a step come first, followed by the
+step's variables. The KKT matrix is then block banded with a bandwidth of a few steps, the factor has
+no fill outside the band, and a factorization costs O(T n^3) for T steps of n variables. This also
+skips the minimum degree analysis whenever the pattern changes, e.g. when the collision rows change.
+
+*/
+
+namespace sco {
+
+struct ADMMSettings {
+  double rho, // initial step size for inequality rows
+         sigma, // regularization of the primal block
+         alpha, // over-relaxation parameter in (0,2)
+         eps_abs, eps_rel, // convergence tolerances on the primal and dual residuals
+         eps_prim_inf, // tolerance for the primal infeasibility certificate
+         polish_delta; // regularization of the reduced KKT system used for polishing
+  int max_iter,
+      scaling_iter, // number of Ruiz equilibration passes
+      check_interval, // iterations between termination checks
+      polish_refine_iter; // iterative refinement steps when polishing
+  bool adaptive_rho,
+       polish; // solve the equality-constrained problem on the guessed active set
+  ADMMSettings();
+};
+
+class ADMMModel : public Model {
+public:
+  vector<Var> vars;
+  vector<Cnt> cnts;
+  ADMMSettings settings;
+
+  ADMMModel();
+
+  Var addVar(const string& name);
+  Var addVar(const string& name, double lower, double upper);
+
+  Cnt addEqCnt(const AffExpr&, const string& name);
+  Cnt addIneqCnt(const AffExpr&, const string& name);
+  Cnt addIneqCnt(const QuadExpr&, const string& name);
+  vector<Cnt> addEqCnts(const AffExprBlock&);
+  vector<Cnt> addIneqCnts(const AffExprBlock&);
+
+  void removeVar(const Var&);
+  void removeCnt(const Cnt&);
+
+  void update();
+  void setPersistentStructure(bool persistent);
+  void setVarStages(const VarVector& vars, const IntVec& stages);
+
+  void setVarBounds(const Var&, double lower, double upper);
+  void setVarBounds(const std::vector<Var>&, const std::vector<double>& lower, const std::vector<double>& upper);
+
+  double getVarValue(const Var&) const;
+  vector<double> getVarValues(const vector<Var>&) const;
+  vector<double> getDualValues(const vector<Cnt>&) const;
+  /** The multipliers of the variable bounds from the last solve are reused along with the given point */
+  void setWarmStart(const vector<double>& primal, const vector<double>& dual);
+  CvxOptStatus optimize();
+
+  void setObjective(const AffExpr&);
+  void setObjective(const QuadExpr&);
+  void setObjective(const IndexQuadExpr&);
+  void writeToFile(const string& fname);
+
+  VarVector getVars() const;
+  vector<Cnt> getCnts() const;
+  RecordStats getRecordStats() const;
+  int getNumNonzeros() const;
+
+  /** Number of numeric factorizations / symbolic analyses of the KKT matrix so far */
+  int numFactorizations() const {return n_factorizations_;}
+  int numAnalyses() const {return n_analyses_;}
+  /** Nonzeros in the L factor of the KKT matrix of the last solve */
+  int numFactorNonzeros() const;
+  /** ADMM iterations taken by the last call to optimize() */
+  int lastIterations() const {return last_iter_;}
+
+  ~ADMMModel();
+
+protected:
+  typedef Eigen::SparseMatrix<double, Eigen::ColMajor> SparseMatrixd;
+  typedef Eigen::SimplicialLDLT<SparseMatrixd, Eigen::Upper> LDLTSolver;
+  typedef Eigen::SimplicialLDLT<SparseMatrixd, Eigen::Upper, Eigen::NaturalOrdering<int> > BandedLDLTSolver;
+
+  struct Row {
+    IntVec inds;
+    DblVec vals;
+    double rhs;
+    ConstraintType type;
+    string name;
+  };
+
+  Cnt addRow(const AffExpr&, ConstraintType type, const string& name);
+  Cnt addRow(const Row&);
+  vector<Cnt> addRows(const AffExprBlock&, ConstraintType type);
+  void buildProblem(SparseMatrixd& P, Eigen::VectorXd& q, SparseMatrixd& A, Eigen::VectorXd& l, Eigen::VectorXd& u);
+  void scaleProblem(SparseMatrixd& P, Eigen::VectorXd& q, SparseMatrixd& A, Eigen::VectorXd& l, Eigen::VectorXd& u,
+      Eigen::VectorXd& D, Eigen::VectorXd& E, double& c);
+  void computeFixedBoundDuals();
+  void computeRhoVec(const Eigen::VectorXd& l, const Eigen::VectorXd& u, double rho, Eigen::VectorXd& rho_vec);
+  bool factorizeKKT(const SparseMatrixd& P, const SparseMatrixd& A, const Eigen::VectorXd& rho_vec);
+  Eigen::VectorXd solveKKT(const Eigen::VectorXd& rhs) const;
+  bool hasStages() const;
+  void computeStageOrdering(const SparseMatrixd& A, IntVec& perm) const;
+  bool polishSolution(const SparseMatrixd& P, const Eigen::VectorXd& q, const SparseMatrixd& A,
+      const Eigen::VectorXd& l, const Eigen::VectorXd& u, Eigen::VectorXd& x, Eigen::VectorXd& z, Eigen::VectorXd& y);
+
+  // problem data. indices refer to the current positions in vars
+  DblVec lbs_, ubs_;
+  IntVec var_stages_; // -1 if unknown
+  IntVec free_cols_; // variable of each column of the QP passed to the solver. fixed variables are substituted out
+  vector<Row> rows_;
+  DblVec obj_lin_;
+  IntVec obj_inds1_, obj_inds2_;
+  DblVec obj_quad_;
+  QuadCSC obj_hessian_;
+  double obj_const_;
+
+  // cached factorization of the KKT matrix. with stages, banded_ldlt_ factorizes it in the order kkt_perm_
+  LDLTSolver ldlt_;
+  BandedLDLTSolver banded_ldlt_;
+  IntVec kkt_perm_; // position of each row/column of the KKT matrix in stage order
+  bool kkt_banded_;
+  IntVec kkt_outer_, kkt_inner_;
+  DblVec kkt_values_;
+  bool kkt_analyzed_, kkt_factorized_;
+  int n_factorizations_, n_analyses_;
+
+  double rho_;
+  DblVec solution_;
+  DblVec row_duals_, bound_duals_; // multipliers from the last solve, indexed like rows_ and vars
+  DblVec warm_primal_, warm_dual_;
+  bool has_warm_start_;
+  int last_iter_;
+
+  RowCompressor compressor_;
+  RecordPool<VarRep> var_pool_;
+  RecordPool<CntRep> cnt_pool_;
+  bool persistent_;
+  std::deque<Var> free_vars_;
+  std::deque<Cnt> free_cnts_;
+};
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <cmath>
+#include <Eigen/Core>
+#include "num_diff.hpp"
+
+/**
+
+@file autodiff.hpp
+
+Forward-mode automatic differentiation.
+
+A Dual number carries a value and its derivatives with respect to all the inputs of a function. An error
+function written as a template on the scalar type, e.g.
+
+  struct DistErr {
+    template <class T>
+    Eigen::Matrix<T, Eigen::Dynamic, 1> operator()(const Eigen::Matrix<T, Eigen::Dynamic, 1>& x) const {
+      Eigen::Matrix<T, Eigen::Dynamic, 1> out(1);
+      out(0) = x.norm() - 1;
+      return out;
+    }
+  };
+
+can be wrapped with AutoDiffVectorOfVector<DistErr>::construct(DistErr()). Called with doubles, it's
+evaluated as usual, and CostFromErrFunc / ConstraintFromFunc evaluate it once with Dual numbers to get
+the value together with the exact Jacobian, instead of differencing n+1 evaluations.
+
+Derivatives are stored in a dynamic vector, and constants (Duals made from a double) keep it empty, so
+only the terms that depend on the inputs allocate.
+
+*/
+
+namespace sco {
+
+struct Dual {
+  double a; // value
+  VectorXd v; // derivatives with respect to the inputs. empty if constant
+  Dual() : a(0) {}
+  Dual(double a) : a(a) {}
+  Dual(double a, const VectorXd& v) : a(a), v(v) {}
+
+  Dual& operator+=(const Dual& other);
+  Dual& operator-=(const Dual& other);
+  Dual& operator*=(const Dual& other);
+  Dual& operator/=(const Dual& other);
+};
+
+}
+
+namespace Eigen {
+template<> struct NumTraits<sco::Dual> : NumTraits<double> {
+  typedef sco::Dual Real;
+  typedef sco::Dual NonInteger;
+  typedef sco::Dual Literal;
+  typedef sco::Dual Nested;
+  enum {
+    IsComplex = 0,
+    IsInteger = 0,
+    IsSigned = 1,
+    RequireInitialization = 1,
+    ReadCost = 1,
+    AddCost = 3,
+    MulCost = 3
+  };
+};
+}
+
+namespace sco {
+
+namespace autodiff_detail {
+// ca*va + cb*vb, where an empty vector stands for zero
+inline VectorXd combine(double ca, const VectorXd& va, double cb, const VectorXd& vb) {
+  if (va.size() == 0) return vb.size() == 0 ? VectorXd() : VectorXd(cb*vb);
+  if (vb.size() == 0) return ca*va;
+  return ca*va + cb*vb;
+}
+inline VectorXd scale(double c, const VectorXd& v) {
+  return v.size() == 0 ? VectorXd() : VectorXd(c*v);
+}
+}
+
+inline Dual operator+(const Dual& x, const Dual& y) {return Dual(x.a + y.a, autodiff_detail::combine(1, x.v, 1, y.v));}
+inline Dual operator-(const Dual& x, const Dual& y) {return Dual(x.a - y.a, autodiff_detail::combine(1, x.v, -1, y.v));}
+inline Dual operator*(const Dual& x, const Dual& y) {return Dual(x.a * y.a, autodiff_detail::combine(y.a, x.v, x.a, y.v));}
+inline Dual operator/(const Dual& x, const Dual& y) {
+  double q = x.a / y.a;
+  return Dual(q, autodiff_detail::combine(1/y.a, x.v, -q/y.a, y.v));
+}
+inline Dual operator-(const Dual& x) {return Dual(-x.a, autodiff_detail::scale(-1, x.v));}
+inline Dual operator+(const Dual& x) {return x;}
+
+inline Dual operator+(const Dual& x, double y) {return Dual(x.a + y, x.v);}
+inline Dual operator+(double x, const Dual& y) {return Dual(x + y.a, y.v);}
+inline Dual operator-(const Dual& x, double y) {return Dual(x.a - y, x.v);}
+inline Dual operator-(double x, const Dual& y) {return Dual(x - y.a, autodiff_detail::scale(-1, y.v));}
+inline Dual operator*(const Dual& x, double y) {return Dual(x.a * y, autodiff_detail::scale(y, x.v));}
+inline Dual operator*(double x, const Dual& y) {return Dual(x * y.a, autodiff_detail::scale(x, y.v));}
+inline Dual operator/(const Dual& x, double y) {return Dual(x.a / y, autodiff_detail::scale(1/y, x.v));}
+inline Dual operator/(double x, const Dual& y) {return Dual(x) / y;}
+
+inline Dual& Dual::operator+=(const Dual& other) {return *this = *this + other;}
+inline Dual& Dual::operator-=(const Dual& other) {return *this = *this - other;}
+inline Dual& Dual::operator*=(const Dual& other) {return *this = *this * other;}
+inline Dual& Dual::operator/=(const Dual& other) {return *this = *this / other;}
+
+// comparisons look at the value only, so that branches in templated code take the same path as with doubles
+inline bool operator<(const Dual& x, const Dual& y) {return x.a < y.a;}
+inline bool operator>(const Dual& x, const Dual& y) {return x.a > y.a;}
+inline bool operator<=(const Dual& x, const Dual& y) {return x.a <= y.a;}
+inline bool operator>=(const Dual& x, const Dual& y) {return x.a >= y.a;}
+inline bool operator==(const Dual& x, const Dual& y) {return x.a == y.a;}
+inline bool operator!=(const Dual& x, const Dual& y) {return x.a != y.a;}
+
+// f(x) with f'(x) = df
+inline Dual chain(const Dual& x, double f, double df) {return Dual(f, autodiff_detail::scale(df, x.v));}
+
+inline Dual sin(const Dual& x) {return chain(x, std::sin(x.a), std::cos(x.a));}
+inline Dual cos(const Dual& x) {return chain(x, std::cos(x.a), -std::sin(x.a));}
+inline Dual tan(const Dual& x) {double t = std::tan(x.a); return chain(x, t, 1 + t*t);}
+inline Dual asin(const Dual& x) {return chain(x, std::asin(x.a), 1/std::sqrt(1 - x.a*x.a));}
+inline Dual acos(const Dual& x) {return chain(x, std::acos(x.a), -1/std::sqrt(1 - x.a*x.a));}
+inline Dual atan(const Dual& x) {return chain(x, std::atan(x.a), 1/(1 + x.a*x.a));}
+inline Dual exp(const Dual& x) {double e = std::exp(x.a); return chain(x, e, e);}
+inline Dual log(const Dual& x) {return chain(x, std::log(x.a), 1/x.a);}
+inline Dual sqrt(const Dual& x) {double s = std::sqrt(x.a); return chain(x, s, .5/s);}
+inline Dual abs(const Dual& x) {return x.a < 0 ? -x : x;}
+inline Dual fabs(const Dual& x) {return abs(x);}
+inline Dual sq(const Dual& x) {return x*x;}
+inline Dual pow(const Dual& x, double p) {return chain(x, std::pow(x.a, p), p*std::pow(x.a, p-1));}
+inline Dual atan2(const Dual& y, const Dual& x) {
+  double r2 = x.a*x.a + y.a*y.a;
+  return Dual(std::atan2(y.a, x.a), autodiff_detail::combine(x.a/r2, y.v, -y.a/r2, x.v));
+}
+
+typedef Eigen::Matrix<Dual, Eigen::Dynamic, 1> DualVector;
+
+/** Duals for the inputs x, where the derivative of x_i is the i-th unit vector */
+inline DualVector seedDuals(const VectorXd& x) {
+  DualVector out(x.size());
+  for (int i=0; i < x.size(); ++i) out(i) = Dual(x(i), VectorXd::Unit(x.size(), i));
+  return out;
+}
+/** Values and n x |x| Jacobian of the outputs y */
+inline void extractDuals(const DualVector& y, int n_inputs, VectorXd& val, MatrixXd& jac) {
+  val.resize(y.size());
+  jac.setZero(y.size(), n_inputs);
+  for (int i=0; i < y.size(); ++i) {
+    val(i) = y(i).a;
+    if (y(i).v.size() > 0) jac.row(i) = y(i).v.transpose();
+  }
+}
+
+template <class F>
+class AutoDiffVectorOfVector : public VectorOfVector {
+public:
+  AutoDiffVectorOfVector(const F& f) : f_(f) {}
+  VectorXd operator()(const VectorXd& x) const {return f_(x);}
+  bool valueAndJacobian(const VectorXd& x, VectorXd& y, MatrixXd& jac) const {
+    extractDuals(f_(seedDuals(x)), x.size(), y, jac);
+    return true;
+  }
+  static VectorOfVectorPtr construct(const F& f) {
+    return VectorOfVectorPtr(new AutoDiffVectorOfVector(f));
+  }
+private:
+  F f_;
+};
+
+}
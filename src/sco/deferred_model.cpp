@@ -0,0 +1,84 @@
+#include "deferred_model.hpp"
+#include "modeling.hpp"
+#include "macros.h"
+#include <boost/foreach.hpp>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+namespace sco {
+
+#define NOT_DEFERRED(method) PRINT_AND_THROW("DeferredVarModel::" method " is not available while convexifying in parallel")
+
+DeferredVarModel::~DeferredVarModel() {
+  clear();
+}
+
+Var DeferredVarModel::addVar(const string& name) {
+  return addVar(name, -INFINITY, INFINITY);
+}
+Var DeferredVarModel::addVar(const string& name, double lb, double ub) {
+  VarRep* rep = new VarRep(-1 - (int)placeholders_.size(), name, this);
+  placeholders_.push_back(rep);
+  lbs_.push_back(lb);
+  ubs_.push_back(ub);
+  return Var(rep);
+}
+
+void DeferredVarModel::substitute(Var& v, const VarVector& real) const {
+  if (isPlaceholder(v)) v = real[-1 - v.var_rep->index];
+}
+void DeferredVarModel::substitute(int& ind, const VarVector& real) const {
+  if (ind < 0) ind = real[-1 - ind].var_rep->index;
+}
+
+void DeferredVarModel::commit(ConvexObjective& co, Model* model) {
+  co.model_ = model;
+  if (placeholders_.empty()) return;
+
+  VarVector real(placeholders_.size());
+  for (size_t k=0; k < placeholders_.size(); ++k) {
+    real[k] = model->addVar(placeholders_[k]->name, lbs_[k], ubs_[k]);
+  }
+
+  BOOST_FOREACH(Var& v, co.vars_) substitute(v, real);
+  BOOST_FOREACH(Var& v, co.quad_.affexpr.vars) substitute(v, real);
+  BOOST_FOREACH(Var& v, co.quad_.vars1) substitute(v, real);
+  BOOST_FOREACH(Var& v, co.quad_.vars2) substitute(v, real);
+  BOOST_FOREACH(AffExpr& aff, co.eqs_) BOOST_FOREACH(Var& v, aff.vars) substitute(v, real);
+  BOOST_FOREACH(AffExpr& aff, co.ineqs_) BOOST_FOREACH(Var& v, aff.vars) substitute(v, real);
+  IndexQuadExpr& iq = co.index_quad_;
+  for (size_t i=0; i < iq.affexpr.inds.size(); ++i) substitute(iq.affexpr.inds[i], real);
+  for (size_t i=0; i < iq.inds1.size(); ++i) substitute(iq.inds1[i], real);
+  for (size_t i=0; i < iq.inds2.size(); ++i) substitute(iq.inds2[i], real);
+
+  clear();
+}
+
+void DeferredVarModel::clear() {
+  BOOST_FOREACH(VarRep* rep, placeholders_) delete rep;
+  placeholders_.clear();
+  lbs_.clear();
+  ubs_.clear();
+}
+
+Cnt DeferredVarModel::addEqCnt(const AffExpr&, const string&) {NOT_DEFERRED("addEqCnt");}
+Cnt DeferredVarModel::addIneqCnt(const AffExpr&, const string&) {NOT_DEFERRED("addIneqCnt");}
+Cnt DeferredVarModel::addIneqCnt(const QuadExpr&, const string&) {NOT_DEFERRED("addIneqCnt");}
+void DeferredVarModel::update() {NOT_DEFERRED("update");}
+void DeferredVarModel::setPersistentStructure(bool) {NOT_DEFERRED("setPersistentStructure");}
+void DeferredVarModel::setVarBounds(const Var&, double, double) {NOT_DEFERRED("setVarBounds");}
+double DeferredVarModel::getVarValue(const Var&) const {NOT_DEFERRED("getVarValue");}
+vector<double> DeferredVarModel::getDualValues(const vector<Cnt>&) const {NOT_DEFERRED("getDualValues");}
+void DeferredVarModel::setWarmStart(const vector<double>&, const vector<double>&) {NOT_DEFERRED("setWarmStart");}
+CvxOptStatus DeferredVarModel::optimize() {NOT_DEFERRED("optimize");}
+void DeferredVarModel::setObjective(const AffExpr&) {NOT_DEFERRED("setObjective");}
+void DeferredVarModel::setObjective(const QuadExpr&) {NOT_DEFERRED("setObjective");}
+void DeferredVarModel::writeToFile(const string&) {NOT_DEFERRED("writeToFile");}
+VarVector DeferredVarModel::getVars() const {NOT_DEFERRED("getVars");}
+vector<Cnt> DeferredVarModel::getCnts() const {NOT_DEFERRED("getCnts");}
+RecordStats DeferredVarModel::getRecordStats() const {NOT_DEFERRED("getRecordStats");}
+int DeferredVarModel::getNumNonzeros() const {NOT_DEFERRED("getNumNonzeros");}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "sco_fwd.hpp"
+#include "solver_interface.hpp"
+
+/**
+
+@file deferred_model.hpp
+
+Stand-in Model for convexifying costs concurrently.
+
+Cost::convex() adds the auxiliary variables of hinge, abs and max terms to the Model it's given, and the
+backends are not thread-safe. DeferredVarModel only records the variables that are added, and hands out
+placeholder Vars for them, so each cost can be convexified against a DeferredVarModel of its own.
+Afterwards commit() creates the recorded variables in the real model, in the order they were added, and
+substitutes them for the placeholders in the ConvexObjective. Committing the costs in their original order
+creates exactly the same variables as convexifying them one after another against the real model.
+
+Only addVar and removeVar/removeVars are supported; everything else throws.
+
+*/
+
+namespace sco {
+
+class DeferredVarModel : public Model {
+public:
+  DeferredVarModel() {}
+  ~DeferredVarModel();
+
+  Var addVar(const string& name);
+  Var addVar(const string& name, double lb, double ub);
+  /** Placeholders are owned by this model, so removing them does nothing */
+  void removeVar(const Var&) {}
+  void removeCnt(const Cnt&) {}
+
+  /** Create the recorded variables in model and make co refer to them and to model */
+  void commit(ConvexObjective& co, Model* model);
+  /** Forget the recorded variables */
+  void clear();
+  int numVars() const {return placeholders_.size();}
+
+  Cnt addEqCnt(const AffExpr&, const string&);
+  Cnt addIneqCnt(const AffExpr&, const string&);
+  Cnt addIneqCnt(const QuadExpr&, const string&);
+  void update();
+  void setPersistentStructure(bool);
+  void setVarBounds(const Var&, double, double);
+  double getVarValue(const Var&) const;
+  vector<double> getDualValues(const vector<Cnt>&) const;
+  void setWarmStart(const vector<double>&, const vector<double>&);
+  CvxOptStatus optimize();
+  void setObjective(const AffExpr&);
+  void setObjective(const QuadExpr&);
+  void writeToFile(const string&);
+  VarVector getVars() const;
+  vector<Cnt> getCnts() const;
+  RecordStats getRecordStats() const;
+  int getNumNonzeros() const;
+
+private:
+  bool isPlaceholder(const Var& v) const {return v.var_rep->creator == this;}
+  void substitute(Var& v, const VarVector& real) const;
+  void substitute(int& ind, const VarVector& real) const;
+
+  // placeholder k has index -1-k, so that index expressions built from it can be fixed up as well
+  vector<VarRep*> placeholders_;
+  DblVec lbs_, ubs_;
+
+  DeferredVarModel(const DeferredVarModel&);
+  DeferredVarModel& operator=(const DeferredVarModel&);
+};
+
+}
@@ -1,5 +1,6 @@
 #include "solver_interface.hpp"
 #include "gurobi_interface.hpp"
+#include "index_expr.hpp"
 #include "utils/logging.hpp"
 extern "C" {
 #include "gurobi_c.h"
@@ -7,7 +8,9 @@ extern "C" {
 #include <boost/foreach.hpp>
 #include "sco_common.hpp"
 #include <map>
+#include <algorithm>
 #include <utility>
+#include <iterator>
 #include "macros.h"
 #include <sstream>
 #include <stdexcept>
@@ -20,21 +23,6 @@ namespace sco {
 
 GRBenv* gEnv;
 
-void simplify2(vector<int>& inds, vector<double>& vals) {
-  typedef std::map<int, double> Int2Double;
-  Int2Double ind2val;
-  for (unsigned i=0; i < inds.size(); ++i) {
-    if (vals[i] != 0) ind2val[inds[i]] += vals[i];
-  }
-  inds.resize(ind2val.size());
-  vals.resize(ind2val.size());
-  int i_new = 0;
-  BOOST_FOREACH(Int2Double::value_type& iv, ind2val) {
-    inds[i_new] = iv.first;
-    vals[i_new] = iv.second;
-    ++i_new;
-  }
-}
 #if 0
 void simplify(vector<int>& inds, vector<double>& vals) {
   // first find the largest element of inds
@@ -81,7 +69,7 @@ ModelPtr createGurobiModel() {
   return out;
 }
 
-GurobiModel::GurobiModel() {
+GurobiModel::GurobiModel() : persistent_(false) {
   if (!gEnv) {
     GRBloadenv(&gEnv, NULL);
     if (util::GetLogLevel() < util::LevelDebug) {
@@ -98,37 +86,90 @@ static vector<int> vars2inds(const vector<Var>& vars) {
 }
 
 Var GurobiModel::addVar(const string& name) {
-  ENSURE_SUCCESS(GRBaddvar(model, 0, NULL, NULL, 0, -GRB_INFINITY, GRB_INFINITY, GRB_CONTINUOUS, const_cast<char*>(name.c_str())));
-  vars.push_back(new VarRep(vars.size(), name, this));
-  return vars.back();
+  return addVar(name, -GRB_INFINITY, GRB_INFINITY);
 }
 
 Var GurobiModel::addVar(const string& name, double lb, double ub) {
+  if (!free_vars_.empty()) {
+    Var var = free_vars_.front();
+    free_vars_.pop_front();
+    var.var_rep->name = name;
+    setVarBounds(var, lb, ub);
+    return var;
+  }
   ENSURE_SUCCESS(GRBaddvar(model, 0, NULL, NULL, 0, lb, ub, GRB_CONTINUOUS, const_cast<char*>(name.c_str())));
-  vars.push_back(new VarRep(vars.size(), name, this));
+  vars.push_back(var_pool_.create(VarRep(vars.size(), name, this)));
   return vars.back();
 }
 
+void GurobiModel::setCntCoeffs(int row, const IntVec& inds, const DblVec& vals) {
+  IntVec& old_inds = cnt_inds_[row];
+  IntVec vind = inds;
+  DblVec val = vals;
+  // coefficients that are no longer present are set to zero
+  std::set_difference(old_inds.begin(), old_inds.end(), inds.begin(), inds.end(), std::back_inserter(vind));
+  val.resize(vind.size(), 0);
+  IntVec cind(vind.size(), row);
+  if (!vind.empty()) ENSURE_SUCCESS(GRBchgcoeffs(model, vind.size(), cind.data(), vind.data(), val.data()));
+  old_inds = inds;
+}
+
+vector<Cnt> GurobiModel::addCnts(const AffExprBlock& block, char sense, const string& name) {
+  IntVec row_ptr, inds;
+  DblVec vals;
+  compressor_.compress(block, row_ptr, inds, vals);
+  int nrows = block.rows();
+  vector<Cnt> out;
+  out.reserve(nrows);
+
+  // rows parked in persistent mode are filled in place
+  int i = 0;
+  for (; i < nrows && !free_cnts_.empty(); ++i) {
+    Cnt cnt = free_cnts_.front();
+    free_cnts_.pop_front();
+    int row = cnt.cnt_rep->index;
+    setCntCoeffs(row, IntVec(inds.begin() + row_ptr[i], inds.begin() + row_ptr[i+1]),
+        DblVec(vals.begin() + row_ptr[i], vals.begin() + row_ptr[i+1]));
+    ENSURE_SUCCESS(GRBsetdblattrelement(model, GRB_DBL_ATTR_RHS, row, -block.constants[i]));
+    ENSURE_SUCCESS(GRBsetcharattrelement(model, GRB_CHAR_ATTR_SENSE, row, sense));
+    out.push_back(cnt);
+  }
+
+  // the rest are added with one call
+  if (i < nrows) {
+    int nnew = nrows - i, offset = row_ptr[i];
+    IntVec cbeg(nnew);
+    vector<char> senses(nnew, sense);
+    vector<char*> names(nnew, const_cast<char*>(name.c_str()));
+    DblVec rhs(nnew);
+    for (int j=0; j < nnew; ++j) {
+      cbeg[j] = row_ptr[i+j] - offset;
+      rhs[j] = -block.constants[i+j];
+    }
+    ENSURE_SUCCESS(GRBaddconstrs(model, nnew, row_ptr[nrows] - offset, cbeg.data(), inds.data() + offset,
+        vals.data() + offset, senses.data(), rhs.data(), name.empty() ? NULL : names.data()));
+    for (; i < nrows; ++i) {
+      cnts.push_back(cnt_pool_.create(CntRep(cnts.size(), this)));
+      cnt_inds_.push_back(IntVec(inds.begin() + row_ptr[i], inds.begin() + row_ptr[i+1]));
+      out.push_back(cnts.back());
+    }
+  }
+  return out;
+}
 
 Cnt GurobiModel::addEqCnt(const AffExpr& expr, const string& name) {
-  LOG_DEBUG("adding ineq: %s <= 0", CSTR(expr));
-  vector<int> inds = vars2inds(expr.vars);
-  vector<double> vals = expr.coeffs;
-  simplify2(inds, vals);
-  ENSURE_SUCCESS(GRBaddconstr(model, inds.size(),
-       const_cast<int*>(inds.data()), const_cast<double*>(vals.data()), GRB_EQUAL, -expr.constant, const_cast<char*>(name.c_str())));
-  cnts.push_back(new CntRep(cnts.size(), this));
-  return cnts.back();
+  LOG_DEBUG("adding eq: %s == 0", CSTR(expr));
+  return addCnts(AffExprBlock(AffExprVector(1, expr)), GRB_EQUAL, name)[0];
 }
 Cnt GurobiModel::addIneqCnt(const AffExpr& expr, const string& name) {
   LOG_DEBUG("adding ineq: %s <= 0", CSTR(expr));
-  vector<int> inds = vars2inds(expr.vars);
-  vector<double> vals = expr.coeffs;
-  simplify2(inds, vals);
-  ENSURE_SUCCESS(GRBaddconstr(model, inds.size(),
-      const_cast<int*>(inds.data()), const_cast<double*>(vals.data()), GRB_LESS_EQUAL, -expr.constant, const_cast<char*>(name.c_str())));
-  cnts.push_back(new CntRep(cnts.size(), this));
-  return cnts.back();
+  return addCnts(AffExprBlock(AffExprVector(1, expr)), GRB_LESS_EQUAL, name)[0];
+}
+vector<Cnt> GurobiModel::addEqCnts(const AffExprBlock& block) {
+  return addCnts(block, GRB_EQUAL);
+}
+vector<Cnt> GurobiModel::addIneqCnts(const AffExprBlock& block) {
+  return addCnts(block, GRB_LESS_EQUAL);
 }
 Cnt GurobiModel::addIneqCnt(const QuadExpr&, const string& name) {
   PRINT_AND_THROW("NOT IMPLEMENTED");
@@ -144,17 +185,37 @@ void resetIndices(vector<Cnt>& cnts) {
 
 void GurobiModel::removeVar(const Var& var) {
   assert(var.var_rep->creator == this);
+  if (persistent_) {
+    setVarBounds(var, 0, 0);
+    free_vars_.push_back(var);
+    return;
+  }
   ENSURE_SUCCESS(GRBdelvars(model, 1, &var.var_rep->index));
   var.var_rep->removed = true;
 }
 
 void GurobiModel::removeCnt(const Cnt& cnt) {
   assert(cnt.cnt_rep->creator == this);
+  if (persistent_) {
+    // the row is emptied lazily in optimize(), so that reusing it only changes the coefficients that differ
+    free_cnts_.push_back(cnt);
+    return;
+  }
   ENSURE_SUCCESS(GRBdelconstrs(model, 1, &cnt.cnt_rep->index));
   cnt.cnt_rep->removed = true;
 }
 
 
+void GurobiModel::setPersistentStructure(bool persistent) {
+  persistent_ = persistent;
+  if (!persistent) {
+    BOOST_FOREACH(const Var& var, free_vars_) removeVar(var);
+    BOOST_FOREACH(const Cnt& cnt, free_cnts_) removeCnt(cnt);
+    free_vars_.clear();
+    free_cnts_.clear();
+  }
+}
+
 void GurobiModel::setVarBounds(const Var& var, double lower, double upper) {
   assert(var.var_rep->creator == this);
   ENSURE_SUCCESS(GRBsetdblattrelement(model, GRB_DBL_ATTR_LB, var.var_rep->index, lower));
@@ -182,7 +243,36 @@ vector<double> GurobiModel::getVarValues(const vector<Var>& vars) const {
   return out;
 }
 
+vector<double> GurobiModel::getDualValues(const vector<Cnt>& cnts) const {
+  vector<int> inds(cnts.size());
+  for (size_t i=0; i < cnts.size(); ++i) {
+    assert(cnts[i].cnt_rep->creator == this);
+    inds[i] = cnts[i].cnt_rep->index;
+  }
+  vector<double> out(inds.size());
+  ENSURE_SUCCESS(GRBgetdblattrlist(model, GRB_DBL_ATTR_PI, inds.size(), inds.data(), out.data()));
+  return out;
+}
+
+void GurobiModel::setWarmStart(const vector<double>& primal, const vector<double>& dual) {
+  // Gurobi keeps the basis of the previous solve as long as the model isn't reset, so the simplex
+  // methods reuse it automatically. PStart/DStart additionally seed the next solve from the given point.
+  int nvars, ncnts;
+  GRBgetintattr(model, GRB_INT_ATTR_NUMVARS, &nvars);
+  GRBgetintattr(model, GRB_INT_ATTR_NUMCONSTRS, &ncnts);
+  vector<double> pstart(nvars, GRB_UNDEFINED), dstart(ncnts, GRB_UNDEFINED);
+  std::copy(primal.begin(), primal.begin() + std::min<size_t>(primal.size(), nvars), pstart.begin());
+  std::copy(dual.begin(), dual.begin() + std::min<size_t>(dual.size(), ncnts), dstart.begin());
+  if (nvars > 0) ENSURE_SUCCESS(GRBsetdblattrarray(model, GRB_DBL_ATTR_PSTART, 0, nvars, pstart.data()));
+  if (ncnts > 0 && !dual.empty()) ENSURE_SUCCESS(GRBsetdblattrarray(model, GRB_DBL_ATTR_DSTART, 0, ncnts, dstart.data()));
+}
+
 CvxOptStatus GurobiModel::optimize(){
+  BOOST_FOREACH(const Cnt& cnt, free_cnts_) {
+    int row = cnt.cnt_rep->index;
+    setCntCoeffs(row, IntVec(), DblVec());
+    ENSURE_SUCCESS(GRBsetdblattrelement(model, GRB_DBL_ATTR_RHS, row, 0));
+  }
   ENSURE_SUCCESS(GRBoptimize(model));
   int status;
   GRBgetintattr(model, GRB_INT_ATTR_STATUS, &status);
@@ -216,11 +306,26 @@ void GurobiModel::setObjective(const AffExpr& expr) {
 }
 
 void GurobiModel::setObjective(const QuadExpr& quad_expr) {
-  setObjective(quad_expr.affexpr);
-  vector<int> inds1 = vars2inds(quad_expr.vars1);
-  vector<int> inds2 = vars2inds(quad_expr.vars2);
-  GRBaddqpterms(model, quad_expr.coeffs.size(), const_cast<int*>(inds1.data()),
-      const_cast<int*>(inds2.data()), const_cast<double*>(quad_expr.coeffs.data()));
+  setObjective(IndexQuadExpr(quad_expr));
+}
+
+void GurobiModel::setObjective(const IndexQuadExpr& expr) {
+  GRBdelq(model);
+
+  int nvars;
+  GRBgetintattr(model, GRB_INT_ATTR_NUMVARS, &nvars);
+  assert(nvars == (int)vars.size());
+
+  vector<double> obj(nvars, 0);
+  for (size_t i=0; i < expr.affexpr.size(); ++i) obj[expr.affexpr.inds[i]] += expr.affexpr.coeffs[i];
+  ENSURE_SUCCESS(GRBsetdblattrarray(model, "Obj", 0, nvars, obj.data()));
+  GRBsetdblattr(model, "ObjCon", expr.affexpr.constant);
+  // Q can only be replaced as a whole, but the coalesced terms are much fewer than the raw ones
+  obj_hessian_.update(expr, nvars);
+  if (obj_hessian_.nonZeros() > 0) {
+    ENSURE_SUCCESS(GRBaddqpterms(model, obj_hessian_.nonZeros(), const_cast<int*>(obj_hessian_.rowInd().data()),
+        const_cast<int*>(obj_hessian_.colInd().data()), const_cast<double*>(obj_hessian_.values().data())));
+  }
 }
 
 void GurobiModel::writeToFile(const string& fname) {
@@ -239,7 +344,7 @@ void GurobiModel::update() {
       var.var_rep->index = inew;
       ++inew;
     }
-    else delete var.var_rep;
+    else var_pool_.destroy(var.var_rep);
   }
   vars.resize(inew);
   }
@@ -248,21 +353,37 @@ void GurobiModel::update() {
   BOOST_FOREACH(const Cnt& cnt, cnts) {
     if (!cnt.cnt_rep->removed) {
       cnts[inew] = cnt;
+      cnt_inds_[inew].swap(cnt_inds_[cnt.cnt_rep->index]);
       cnt.cnt_rep->index = inew;
       ++inew;
     }
-    else delete cnt.cnt_rep;
+    else cnt_pool_.destroy(cnt.cnt_rep);
   }
   cnts.resize(inew);
+  cnt_inds_.resize(inew);
   }
 }
 
 VarVector GurobiModel::getVars() const {
   return vars;
 }
+vector<Cnt> GurobiModel::getCnts() const {
+  return cnts;
+}
+RecordStats GurobiModel::getRecordStats() const {
+  return RecordStats(var_pool_.numCreated() + cnt_pool_.numCreated(),
+      var_pool_.numHeapAllocations() + cnt_pool_.numHeapAllocations());
+}
+int GurobiModel::getNumNonzeros() const {
+  int nnz;
+  ENSURE_SUCCESS(GRBgetintattr(model, GRB_INT_ATTR_NUMNZS, &nnz));
+  return nnz;
+}
 
 GurobiModel::~GurobiModel() {
   ENSURE_SUCCESS(GRBfreemodel(model));
+  BOOST_FOREACH(const Var& var, vars) var_pool_.destroy(var.var_rep);
+  BOOST_FOREACH(const Cnt& cnt, cnts) cnt_pool_.destroy(cnt.cnt_rep);
 }
 
 }
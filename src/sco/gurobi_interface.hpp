@@ -1,4 +1,7 @@
 #include "solver_interface.hpp"
+#include "record_pool.hpp"
+#include "quad_csc.hpp"
+#include <deque>
 
 /**
 
@@ -27,29 +30,51 @@ public:
   Cnt addEqCnt(const AffExpr&, const string& name);
   Cnt addIneqCnt(const AffExpr&, const string& name);
   Cnt addIneqCnt(const QuadExpr&, const string& name);
+  vector<Cnt> addEqCnts(const AffExprBlock&);
+  vector<Cnt> addIneqCnts(const AffExprBlock&);
 
   void removeVar(const Var&);
   void removeCnt(const Cnt&);
 
   void update();
+  void setPersistentStructure(bool persistent);
 
   void setVarBounds(const Var&, double lower, double upper);
   void setVarBounds(const std::vector<Var>&, const std::vector<double>& lower, const std::vector<double>& upper);
 
   double getVarValue(const Var&) const;
   vector<double> getVarValues(const vector<Var>&) const;
+  vector<double> getDualValues(const vector<Cnt>&) const;
+  void setWarmStart(const vector<double>& primal, const vector<double>& dual);
   CvxOptStatus optimize();
   /** Don't use this function, because it adds constraints that aren't tracked  */
   CvxOptStatus optimizeFeasRelax();
 
   void setObjective(const AffExpr&);
   void setObjective(const QuadExpr&);
+  void setObjective(const IndexQuadExpr&);
   void writeToFile(const string& fname);
 
   VarVector getVars() const;
+  vector<Cnt> getCnts() const;
+  RecordStats getRecordStats() const;
+  int getNumNonzeros() const;
 
   ~GurobiModel();
 
+protected:
+  vector<Cnt> addCnts(const AffExprBlock&, char sense, const string& name="");
+  /** Change the coefficients of a row from the ones in cnt_inds_ to the given ones */
+  void setCntCoeffs(int row, const IntVec& inds, const DblVec& vals);
+
+  RowCompressor compressor_;
+  QuadCSC obj_hessian_;
+  RecordPool<VarRep> var_pool_;
+  RecordPool<CntRep> cnt_pool_;
+  vector<IntVec> cnt_inds_; // sorted variable indices of each row, parallel to cnts
+  bool persistent_;
+  std::deque<Var> free_vars_;
+  std::deque<Cnt> free_cnts_;
 };
 
 
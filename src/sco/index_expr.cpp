@@ -0,0 +1,167 @@
+#include "index_expr.hpp"
+#include <iostream>
+#include <algorithm>
+#include <utility>
+
+namespace sco {
+
+static inline double sq(double x) {return x*x;}
+
+IndexAffExpr::IndexAffExpr(const AffExpr& aff) : constant(aff.constant) {
+  coeffs.append(aff.coeffs.data(), aff.size());
+  inds.resize(aff.size());
+  for (size_t i=0; i < aff.size(); ++i) inds[i] = aff.vars[i].var_rep->index;
+}
+double IndexAffExpr::value(const double* x) const {
+  double out = constant;
+  for (size_t i=0; i < size(); ++i) out += coeffs[i] * x[inds[i]];
+  return out;
+}
+double IndexAffExpr::value(const vector<double>& x) const {
+  return value(x.data());
+}
+void IndexAffExpr::swap(IndexAffExpr& other) {
+  std::swap(constant, other.constant);
+  coeffs.swap(other.coeffs);
+  inds.swap(other.inds);
+}
+
+IndexQuadExpr::IndexQuadExpr(const QuadExpr& quad) : affexpr(quad.affexpr) {
+  size_t n = quad.size();
+  coeffs.append(quad.coeffs.data(), n);
+  inds1.resize(n);
+  inds2.resize(n);
+  for (size_t i=0; i < n; ++i) {
+    inds1[i] = quad.vars1[i].var_rep->index;
+    inds2[i] = quad.vars2[i].var_rep->index;
+  }
+}
+double IndexQuadExpr::value(const double* x) const {
+  double out = affexpr.value(x);
+  for (size_t i=0; i < size(); ++i) out += coeffs[i] * x[inds1[i]] * x[inds2[i]];
+  return out;
+}
+double IndexQuadExpr::value(const vector<double>& x) const {
+  return value(x.data());
+}
+void IndexQuadExpr::swap(IndexQuadExpr& other) {
+  affexpr.swap(other.affexpr);
+  coeffs.swap(other.coeffs);
+  inds1.swap(other.inds1);
+  inds2.swap(other.inds2);
+}
+
+void exprInc(IndexAffExpr& a, const AffExpr& b) {
+  a.constant += b.constant;
+  a.coeffs.append(b.coeffs.data(), b.size());
+  a.inds.reserve(a.inds.size() + b.size());
+  for (size_t i=0; i < b.size(); ++i) a.inds.push_back(b.vars[i].var_rep->index);
+}
+void exprInc(IndexQuadExpr& a, const QuadExpr& b) {
+  exprInc(a.affexpr, b.affexpr);
+  size_t n = b.size();
+  a.coeffs.append(b.coeffs.data(), n);
+  a.inds1.reserve(a.inds1.size() + n);
+  a.inds2.reserve(a.inds2.size() + n);
+  for (size_t i=0; i < n; ++i) {
+    a.inds1.push_back(b.vars1[i].var_rep->index);
+    a.inds2.push_back(b.vars2[i].var_rep->index);
+  }
+}
+
+AffExpr toAffExpr(const IndexAffExpr& iaff, const VarVector& vars) {
+  AffExpr out(iaff.constant);
+  out.coeffs.assign(iaff.coeffs.begin(), iaff.coeffs.end());
+  out.vars.resize(iaff.size());
+  for (size_t i=0; i < iaff.size(); ++i) out.vars[i] = vars[iaff.inds[i]];
+  return out;
+}
+QuadExpr toQuadExpr(const IndexQuadExpr& iquad, const VarVector& vars) {
+  QuadExpr out(toAffExpr(iquad.affexpr, vars));
+  size_t n = iquad.size();
+  out.coeffs.assign(iquad.coeffs.begin(), iquad.coeffs.end());
+  out.vars1.resize(n);
+  out.vars2.resize(n);
+  for (size_t i=0; i < n; ++i) {
+    out.vars1[i] = vars[iquad.inds1[i]];
+    out.vars2[i] = vars[iquad.inds2[i]];
+  }
+  return out;
+}
+
+IndexQuadExpr exprSquare(const IndexAffExpr& affexpr) {
+  IndexQuadExpr out;
+  size_t naff = affexpr.size();
+  out.reserve(naff, (naff*(naff+1))/2);
+
+  out.affexpr.constant = sq(affexpr.constant);
+  out.affexpr.inds = affexpr.inds;
+  for (size_t i=0; i < naff; ++i) out.affexpr.coeffs.push_back(2*affexpr.constant*affexpr.coeffs[i]);
+
+  for (size_t i=0; i < naff; ++i) {
+    out.inds1.push_back(affexpr.inds[i]);
+    out.inds2.push_back(affexpr.inds[i]);
+    out.coeffs.push_back(sq(affexpr.coeffs[i]));
+    for (size_t j=i+1; j < naff; ++j) {
+      out.inds1.push_back(affexpr.inds[i]);
+      out.inds2.push_back(affexpr.inds[j]);
+      out.coeffs.push_back(2 * affexpr.coeffs[i] * affexpr.coeffs[j]);
+    }
+  }
+  return out;
+}
+
+IndexAffExpr combineTerms(const IndexAffExpr& a) {
+  vector< std::pair<int, double> > terms(a.size());
+  for (size_t i=0; i < a.size(); ++i) terms[i] = std::make_pair(a.inds[i], a.coeffs[i]);
+  std::sort(terms.begin(), terms.end());
+  IndexAffExpr out(a.constant);
+  for (size_t i=0; i < terms.size(); ) {
+    int ind = terms[i].first;
+    double coeff = 0;
+    for (; i < terms.size() && terms[i].first == ind; ++i) coeff += terms[i].second;
+    if (coeff != 0) {
+      out.inds.push_back(ind);
+      out.coeffs.push_back(coeff);
+    }
+  }
+  return out;
+}
+
+IndexQuadExpr combineTerms(const IndexQuadExpr& q) {
+  typedef std::pair<int, int> IntPair;
+  vector< std::pair<IntPair, double> > terms(q.size());
+  for (size_t i=0; i < q.size(); ++i) {
+    terms[i] = std::make_pair(IntPair(std::min(q.inds1[i], q.inds2[i]), std::max(q.inds1[i], q.inds2[i])), q.coeffs[i]);
+  }
+  std::sort(terms.begin(), terms.end());
+  IndexQuadExpr out(combineTerms(q.affexpr));
+  for (size_t i=0; i < terms.size(); ) {
+    IntPair inds = terms[i].first;
+    double coeff = 0;
+    for (; i < terms.size() && terms[i].first == inds; ++i) coeff += terms[i].second;
+    if (coeff != 0) {
+      out.inds1.push_back(inds.first);
+      out.inds2.push_back(inds.second);
+      out.coeffs.push_back(coeff);
+    }
+  }
+  return out;
+}
+
+ostream& operator<<(ostream& o, const IndexAffExpr& e) {
+  o << e.constant;
+  for (size_t i=0; i < e.size(); ++i) {
+    o << " + " << e.coeffs[i] << "*x" << e.inds[i];
+  }
+  return o;
+}
+ostream& operator<<(ostream& o, const IndexQuadExpr& e) {
+  o << e.affexpr;
+  for (size_t i=0; i < e.size(); ++i) {
+    o << " + " << e.coeffs[i] << "*x" << e.inds1[i] << "*x" << e.inds2[i];
+  }
+  return o;
+}
+
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include "sco_fwd.hpp"
+#include "solver_interface.hpp"
+#include "utils/small_vector.hpp"
+
+/**
+
+@file index_expr.hpp
+
+Compact layout for affine and quadratic expressions.
+
+AffExpr and QuadExpr hold a Var (a pointer to a VarRep) per term. IndexAffExpr and IndexQuadExpr instead hold
+the model index of each variable in a contiguous int array next to the coefficient array, and keep short
+expressions inline without allocating. They are meant for cost terms that are built once and added to the
+convex subproblem every iteration, and for assembling the objective.
+
+The indices are those of the Model at construction time, so an index expression must only refer to
+variables that are never removed, e.g. the variables of an OptProb, or be used before the next update().
+
+*/
+
+namespace sco {
+
+using util::SmallVector;
+
+typedef SmallVector<int, 4> IndexVec;
+typedef SmallVector<double, 4> CoeffVec;
+
+struct IndexAffExpr {
+  double constant;
+  CoeffVec coeffs;
+  IndexVec inds;
+  IndexAffExpr() : constant(0) {}
+  explicit IndexAffExpr(double a) : constant(a) {}
+  explicit IndexAffExpr(const Var& v) : constant(0), coeffs(1, 1.), inds(1, v.var_rep->index) {}
+  explicit IndexAffExpr(const AffExpr& aff);
+  size_t size() const {return coeffs.size();}
+  double value(const double* x) const;
+  double value(const vector<double>& x) const;
+  void reserve(size_t n) {coeffs.reserve(n); inds.reserve(n);}
+  void swap(IndexAffExpr& other);
+  void clear() {constant = 0; coeffs.clear(); inds.clear();}
+};
+
+struct IndexQuadExpr {
+  IndexAffExpr affexpr;
+  CoeffVec coeffs;
+  IndexVec inds1, inds2;
+  IndexQuadExpr() {}
+  explicit IndexQuadExpr(double a) : affexpr(a) {}
+  explicit IndexQuadExpr(const IndexAffExpr& aff) : affexpr(aff) {}
+  explicit IndexQuadExpr(const QuadExpr& quad);
+  size_t size() const {return coeffs.size();}
+  double value(const double* x) const;
+  double value(const vector<double>& x) const;
+  void reserve(size_t naff, size_t nquad) {affexpr.reserve(naff); coeffs.reserve(nquad); inds1.reserve(nquad); inds2.reserve(nquad);}
+  void swap(IndexQuadExpr& other);
+  void clear() {affexpr.clear(); coeffs.clear(); inds1.clear(); inds2.clear();}
+};
+
+/** Expression in terms of vars, where vars[i] is the variable with index i (e.g. Model::getVars()) */
+AffExpr toAffExpr(const IndexAffExpr&, const VarVector& vars);
+QuadExpr toQuadExpr(const IndexQuadExpr&, const VarVector& vars);
+
+IndexQuadExpr exprSquare(const IndexAffExpr&);
+/** Sum the terms with the same variable (or pair of variables, in either order) and drop the ones that are zero */
+IndexAffExpr combineTerms(const IndexAffExpr&);
+IndexQuadExpr combineTerms(const IndexQuadExpr&);
+
+ostream& operator<<(ostream&, const IndexAffExpr&);
+ostream& operator<<(ostream&, const IndexQuadExpr&);
+
+////// In-place operations ///////
+
+inline void exprScale(IndexAffExpr& v, double a) {
+  v.constant *= a;
+  for (size_t i=0; i < v.coeffs.size(); ++i) v.coeffs[i] *= a;
+}
+inline void exprScale(IndexQuadExpr& q, double a) {
+  exprScale(q.affexpr, a);
+  for (size_t i=0; i < q.coeffs.size(); ++i) q.coeffs[i] *= a;
+}
+
+inline void exprInc(IndexAffExpr& a, double b) {
+  a.constant += b;
+}
+inline void exprInc(IndexAffExpr& a, const IndexAffExpr& b) {
+  a.constant += b.constant;
+  a.coeffs.append(b.coeffs.data(), b.coeffs.size());
+  a.inds.append(b.inds.data(), b.inds.size());
+}
+inline void exprInc(IndexQuadExpr& a, double b) {
+  exprInc(a.affexpr, b);
+}
+inline void exprInc(IndexQuadExpr& a, const IndexAffExpr& b) {
+  exprInc(a.affexpr, b);
+}
+inline void exprInc(IndexQuadExpr& a, const IndexQuadExpr& b) {
+  exprInc(a.affexpr, b.affexpr);
+  a.coeffs.append(b.coeffs.data(), b.coeffs.size());
+  a.inds1.append(b.inds1.data(), b.inds1.size());
+  a.inds2.append(b.inds2.data(), b.inds2.size());
+}
+
+/** Append an expression of Vars, converted to indices in place */
+void exprInc(IndexAffExpr& a, const AffExpr& b);
+void exprInc(IndexQuadExpr& a, const QuadExpr& b);
+
+/**
+Add b to a and leave b empty. When a is empty, b's storage is taken over instead of copied,
+which is the common case when summing up temporaries.
+*/
+inline void exprAbsorb(IndexAffExpr& a, IndexAffExpr& b) {
+  if (a.size() == 0) {
+    b.constant += a.constant;
+    a.swap(b);
+  }
+  else exprInc(a, b);
+  b.clear();
+}
+inline void exprAbsorb(IndexQuadExpr& a, IndexQuadExpr& b) {
+  if (a.size() == 0 && a.affexpr.size() == 0) {
+    b.affexpr.constant += a.affexpr.constant;
+    a.swap(b);
+  }
+  else exprInc(a, b);
+  b.clear();
+}
+
+inline IndexAffExpr exprMult(IndexAffExpr a, double b) {
+  exprScale(a, b);
+  return a;
+}
+inline IndexQuadExpr exprMult(IndexQuadExpr a, double b) {
+  exprScale(a, b);
+  return a;
+}
+inline IndexAffExpr exprAdd(IndexAffExpr a, const IndexAffExpr& b) {
+  exprInc(a, b);
+  return a;
+}
+inline IndexQuadExpr exprAdd(IndexQuadExpr a, const IndexQuadExpr& b) {
+  exprInc(a, b);
+  return a;
+}
+
+}
@@ -3,18 +3,40 @@
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 #include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include "expr_ops.hpp"
 #include "sco_common.hpp"
+#include "macros.h"
 using namespace std;
 
 namespace sco {
 
+static void addBlocksToModel(Model* model, const vector<AffExpr>& eqs, const vector<AffExpr>& ineqs, vector<Cnt>& cnts) {
+  cnts.reserve(eqs.size() + ineqs.size());
+  if (!eqs.empty()) {
+    vector<Cnt> eq_cnts = model->addEqCnts(AffExprBlock(eqs));
+    cnts.insert(cnts.end(), eq_cnts.begin(), eq_cnts.end());
+  }
+  if (!ineqs.empty()) {
+    vector<Cnt> ineq_cnts = model->addIneqCnts(AffExprBlock(ineqs));
+    cnts.insert(cnts.end(), ineq_cnts.begin(), ineq_cnts.end());
+  }
+}
+
 void ConvexObjective::addAffExpr(const AffExpr& affexpr) {
   exprInc(quad_, affexpr);
 }
 void ConvexObjective::addQuadExpr(const QuadExpr& quadexpr) {
   exprInc(quad_, quadexpr);
 }
+void ConvexObjective::addAffExpr(const IndexAffExpr& affexpr) {
+  exprInc(index_quad_, affexpr);
+}
+void ConvexObjective::addQuadExpr(const IndexQuadExpr& quadexpr) {
+  exprInc(index_quad_, quadexpr);
+}
 void ConvexObjective::addHinge(const AffExpr& affexpr, double coeff) {
   Var hinge = model_->addVar("hinge", 0, INFINITY);
   vars_.push_back(hinge);
@@ -58,13 +80,7 @@ void ConvexObjective::addMax(const AffExprVector& ev) {
 }
 
 void ConvexObjective::addConstraintsToModel() {
-  cnts_.reserve(eqs_.size() + ineqs_.size());
-  BOOST_FOREACH(const AffExpr& aff, eqs_) {
-    cnts_.push_back(model_->addEqCnt(aff, ""));
-  }
-  BOOST_FOREACH(const AffExpr& aff, ineqs_) {
-    cnts_.push_back(model_->addIneqCnt(aff, ""));
-  }
+  addBlocksToModel(model_, eqs_, ineqs_, cnts_);
 }
 
 void ConvexObjective::removeFromModel() {
@@ -85,13 +101,7 @@ void ConvexConstraints::addIneqCnt(const AffExpr& aff) {
 }
 
 void ConvexConstraints::addConstraintsToModel() {
-  cnts_.reserve(eqs_.size() + ineqs_.size());
-  BOOST_FOREACH(const AffExpr& aff, eqs_) {
-    cnts_.push_back(model_->addEqCnt(aff, ""));
-  }
-  BOOST_FOREACH(const AffExpr& aff, ineqs_) {
-    cnts_.push_back(model_->addIneqCnt(aff, ""));
-  }
+  addBlocksToModel(model_, eqs_, ineqs_, cnts_);
 }
 
 void ConvexConstraints::removeFromModel() {
@@ -115,7 +125,7 @@ ConvexConstraints::~ConvexConstraints() {
 }
 
 double ConvexObjective::value(const vector<double>& x)  {
-  return quad_.value(x);
+  return quad_.value(x) + index_quad_.value(x);
 }
 
 
@@ -137,7 +147,8 @@ double Constraint::violation(const DblVec& x) {
   return vecSum(violations(x));
 }
 
-OptProb::OptProb() : model_(createModel(SOLVER_GUROBI)) {}
+OptProb::OptProb() : model_(createModel(defaultSolver())) {}
+OptProb::OptProb(CvxSolverID solver) : model_(createModel(solver)) {}
 
 void OptProb::createVariables(const vector<string>& var_names) {
   createVariables(var_names, DblVec(var_names.size(), -INFINITY), DblVec(var_names.size(), INFINITY));
@@ -156,8 +167,33 @@ void OptProb::createVariables(const vector<string>& var_names, const DblVec& lb,
   }
   model_->update();
 }
-void OptProb::setLowerBounds(const vector<double>& lb) {assert(lb.size() == vars_.size()); lower_bounds_ = lb;}
-void OptProb::setUpperBounds(const vector<double>& ub) {assert(ub.size() == vars_.size()); upper_bounds_ = ub;}
+void OptProb::setLowerBounds(const vector<double>& lb) {
+  assert(lb.size() == vars_.size());
+  // keep the variables fixed by addLinearConstr
+  for (map<int, double>::const_iterator it = fixed_vals_.begin(); it != fixed_vals_.end(); ++it) {
+    if (!(lb[it->first] <= it->second)) {
+      PRINT_AND_THROW(boost::format("lower bound %f of %s excludes the value %f it was fixed to by addLinearConstr")
+          % lb[it->first] % vars_[it->first].var_rep->name % it->second);
+    }
+  }
+  lower_bounds_ = lb;
+  for (map<int, double>::const_iterator it = fixed_vals_.begin(); it != fixed_vals_.end(); ++it) {
+    lower_bounds_[it->first] = it->second;
+  }
+}
+void OptProb::setUpperBounds(const vector<double>& ub) {
+  assert(ub.size() == vars_.size());
+  for (map<int, double>::const_iterator it = fixed_vals_.begin(); it != fixed_vals_.end(); ++it) {
+    if (!(ub[it->first] >= it->second)) {
+      PRINT_AND_THROW(boost::format("upper bound %f of %s excludes the value %f it was fixed to by addLinearConstr")
+          % ub[it->first] % vars_[it->first].var_rep->name % it->second);
+    }
+  }
+  upper_bounds_ = ub;
+  for (map<int, double>::const_iterator it = fixed_vals_.begin(); it != fixed_vals_.end(); ++it) {
+    upper_bounds_[it->first] = it->second;
+  }
+}
 
 void OptProb::addCost(CostPtr cost) {
   costs_.push_back(cost);
@@ -181,7 +217,35 @@ vector<ConstraintPtr> OptProb::getConstraints() const {
   out.insert(out.end(), ineqcnts_.begin(), ineqcnts_.end());
   return out;
 }
+bool OptProb::fixVariable(const AffExpr& expr) {
+  double constant = expr.constant, coeff = 0;
+  int ind = -1;
+  for (size_t k=0; k < expr.size(); ++k) {
+    int i = expr.vars[k].var_rep->index;
+    if (i >= (int)vars_.size() || vars_[i].var_rep != expr.vars[k].var_rep) return false;
+    // only variables fixed by earlier equalities are substituted: the bounds set by setLowerBounds and
+    // setUpperBounds can change later, and the equality would be lost
+    map<int, double>::const_iterator fixed = fixed_vals_.find(i);
+    if (fixed != fixed_vals_.end()) constant += expr.coeffs[k] * fixed->second;
+    else if (ind < 0 || ind == i) {
+      ind = i;
+      coeff += expr.coeffs[k];
+    }
+    else return false;
+  }
+  if (ind < 0 || coeff == 0) return false;
+  double val = -constant / coeff;
+  // an infeasible value is left to the solver to report
+  if (!(val >= lower_bounds_[ind] && val <= upper_bounds_[ind])) return false;
+  LOG_DEBUG("fixing %s to %f", vars_[ind].var_rep->name.c_str(), val);
+  lower_bounds_[ind] = upper_bounds_[ind] = val;
+  fixed_vals_[ind] = val;
+  model_->setVarBounds(vars_[ind], val, val);
+  return true;
+}
+
 void OptProb::addLinearConstr(const AffExpr& expr, ConstraintType type) {
+  if (type == EQ && fixVariable(expr)) return;
   if (type == EQ) model_->addEqCnt(expr, "");
   else model_->addIneqCnt(expr, "");
 }
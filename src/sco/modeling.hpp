@@ -8,9 +8,11 @@
  */
 
 #include <vector>
+#include <map>
 #include <boost/shared_ptr.hpp>
 #include "sco/sco_fwd.hpp"
 #include "sco/solver_interface.hpp"
+#include "sco/index_expr.hpp"
 
 namespace sco {
 
@@ -26,6 +28,8 @@ public:
   ConvexObjective(Model* model) : model_(model) {}
   void addAffExpr(const AffExpr&);
   void addQuadExpr(const QuadExpr&);
+  void addAffExpr(const IndexAffExpr&);
+  void addQuadExpr(const IndexQuadExpr&);
   void addHinge(const AffExpr&, double coeff);
   void addAbs(const AffExpr&, double coeff);
   void addHinges(const AffExprVector&);
@@ -45,6 +49,7 @@ public:
   
   Model* model_;
   QuadExpr quad_;
+  IndexQuadExpr index_quad_; // terms added in index form, part of the objective along with quad_
   vector<Var> vars_;
   vector<AffExpr> eqs_;
   vector<AffExpr> ineqs_;
@@ -97,6 +102,11 @@ public:
   virtual double value(const vector<double>&) = 0;
   /** Convexify at solution vector x*/
   virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model) = 0;
+  /**
+   * True if the cost is convex and convex() returns the same objective at every x, without auxiliary variables
+   * or constraints, e.g. a fixed quadratic. The optimizer then convexifies it only once.
+   */
+  virtual bool isConvexConstant() const {return false;}
 
   string name() {return name_;}
   void setName(const string& name) {name_=name;}
@@ -150,16 +160,20 @@ Non-convex optimization problem
 class OptProb {
 public:
   OptProb();
+  OptProb(CvxSolverID solver);
   /** create variables with bounds [-INFINITY, INFINITY]  */
   void createVariables(const vector<string>& names);
   /** create variables with bounds [lb[i], ub[i] */
   void createVariables(const vector<string>& names, const vector<double>& lb, const vector<double>& ub);
-  /** set the lower bounds of all the variables */
+  /** set the lower bounds of all the variables. The variables fixed by addLinearConstr stay fixed */
   void setLowerBounds(const vector<double>& lb);
-  /** set the upper bounds of all the variables */
+  /** set the upper bounds of all the variables. The variables fixed by addLinearConstr stay fixed */
   void setUpperBounds(const vector<double>& ub);
   /** Note: in the current implementation, this function just adds the constraint to the
-   * model. So if you're not careful, you might end up with an infeasible problem. */
+   * model. So if you're not careful, you might end up with an infeasible problem.
+   * An equality that determines a single variable, once the variables that are already fixed are
+   * substituted, fixes the bounds of that variable instead, and the backend substitutes it out of
+   * every convex subproblem. E.g. x_1 == 2 and then x_2 - x_1 == 0 fix both. */
   void addLinearConstr(const AffExpr&, ConstraintType type);
   /** Add nonlinear cost function */
   void addCost(CostPtr);
@@ -196,6 +210,9 @@ protected:
   vector<ConstraintPtr> eqcnts_;
   vector<ConstraintPtr> ineqcnts_;
   vector<bool> incmask_;
+  std::map<int, double> fixed_vals_; // variables fixed by addLinearConstr, and their values
+
+  bool fixVariable(const AffExpr& expr);
 
   OptProb(OptProb&);
 };
@@ -34,6 +34,25 @@ AffExpr affFromValGrad(double y, const VectorXd& x, const VectorXd& dydx, const
   return aff;
 }
 
+// value and Jacobian of f at x, from the analytic derivative dfdx if there is one, or from colored forward
+// differences if colors isn't empty. the value is taken from the cache if value() was last called at x
+static void calcValueAndJac(const VectorOfVector& f, const MatrixOfVectorPtr& dfdx, const JacobianSparsity& sparsity,
+    const vector< vector<int> >& colors, const EvalCache& cache, const VectorXd& x, double epsilon, VectorXd& y, MatrixXd& jac) {
+  const VectorXd* cached = cache.find(x);
+  if (dfdx) {
+    jac = dfdx->call(x);
+    y = cached ? *cached : f.call(x);
+  }
+  else if (!colors.empty()) {
+    y = cached ? *cached : f.call(x);
+    jac = calcForwardNumJac(f, x, y, epsilon, sparsity, colors);
+  }
+  else if (!f.valueAndJacobian(x, y, jac)) {
+    y = cached ? *cached : f.call(x);
+    jac = calcForwardNumJac(f, x, y, epsilon);
+  }
+}
+
 CostFromFunc::CostFromFunc(ScalarOfVectorPtr f, const VarVector& vars, const string& name, bool full_hessian) :
   Cost(name), f_(f), vars_(vars), full_hessian_(full_hessian), epsilon_(DEFAULT_EPSILON) {}
 
@@ -101,9 +120,12 @@ CostFromErrFunc::CostFromErrFunc(VectorOfVectorPtr f, const VarVector& vars, con
     Cost(name), f_(f), vars_(vars), coeffs_(coeffs), pen_type_(pen_type), epsilon_(DEFAULT_EPSILON) {}
 CostFromErrFunc::CostFromErrFunc(VectorOfVectorPtr f, MatrixOfVectorPtr dfdx, const VarVector& vars, const VectorXd& coeffs, PenaltyType pen_type, const std::string& name) :
     Cost(name), f_(f), dfdx_(dfdx), vars_(vars), coeffs_(coeffs), pen_type_(pen_type), epsilon_(DEFAULT_EPSILON) {}
+CostFromErrFunc::CostFromErrFunc(VectorOfVectorPtr f, const JacobianSparsity& sparsity, const VarVector& vars, const VectorXd& coeffs, PenaltyType pen_type, const std::string& name) :
+    Cost(name), f_(f), sparsity_(sparsity), colors_(sparsity.colorColumns()), vars_(vars), coeffs_(coeffs), pen_type_(pen_type), epsilon_(DEFAULT_EPSILON) {}
 double CostFromErrFunc::value(const vector<double>& xin) {
   VectorXd x = getVec(xin, vars_);
   VectorXd err = f_->call(x);
+  cache_.store(x, err);
   if (coeffs_.size()>0) err = err.cwiseProduct(coeffs_);
   switch (pen_type_) {
     case SQUARED: return err.array().square().sum();
@@ -114,9 +136,10 @@ double CostFromErrFunc::value(const vector<double>& xin) {
 }
 ConvexObjectivePtr CostFromErrFunc::convex(const vector<double>& xin, Model* model) {
   VectorXd x = getVec(xin, vars_);
-  MatrixXd jac = (dfdx_) ? dfdx_->call(x) : calcForwardNumJac(*f_, x, epsilon_);
+  VectorXd y;
+  MatrixXd jac;
+  calcValueAndJac(*f_, dfdx_, sparsity_, colors_, cache_, x, epsilon_, y, jac);
   ConvexObjectivePtr out(new ConvexObjective(model));
-  VectorXd y = f_->call(x);
   for (int i=0; i < jac.rows(); ++i) {
     AffExpr aff = affFromValGrad(y[i], x, jac.row(i), vars_);
     if (coeffs_.size()>0) {
@@ -140,16 +163,22 @@ ConstraintFromFunc::ConstraintFromFunc(VectorOfVectorPtr f, const VarVector& var
 ConstraintFromFunc::ConstraintFromFunc(VectorOfVectorPtr f, MatrixOfVectorPtr dfdx, const VarVector& vars, ConstraintType type, const std::string& name) :
     Constraint(name), f_(f), dfdx_(dfdx), vars_(vars), type_(type), epsilon_(DEFAULT_EPSILON) {}
 
+ConstraintFromFunc::ConstraintFromFunc(VectorOfVectorPtr f, const JacobianSparsity& sparsity, const VarVector& vars, ConstraintType type, const std::string& name) :
+    Constraint(name), f_(f), sparsity_(sparsity), colors_(sparsity.colorColumns()), vars_(vars), type_(type), epsilon_(DEFAULT_EPSILON) {}
+
 vector<double> ConstraintFromFunc::value(const vector<double>& xin) {
   VectorXd x = getVec(xin, vars_);
-  return toDblVec(f_->call(x));
+  VectorXd y = f_->call(x);
+  cache_.store(x, y);
+  return toDblVec(y);
 }
 
 ConvexConstraintsPtr ConstraintFromFunc::convex(const vector<double>& xin, Model* model) {
   VectorXd x = getVec(xin, vars_);
-  MatrixXd jac = (dfdx_) ? dfdx_->call(x) : calcForwardNumJac(*f_, x, epsilon_);
+  VectorXd y;
+  MatrixXd jac;
+  calcValueAndJac(*f_, dfdx_, sparsity_, colors_, cache_, x, epsilon_, y, jac);
   ConvexConstraintsPtr out(new ConvexConstraints(model));
-  VectorXd y = f_->call(x);
   for (int i=0; i < jac.rows(); ++i) {
     AffExpr aff = affFromValGrad(y[i], x, jac.row(i), vars_);
     if (type() == INEQ) out->addIneqCnt(aff);
@@ -36,6 +36,23 @@ Same idea as above, but different output type
 DblVec getDblVec(const vector<double>& x, const VarVector& vars);
 
 
+/**
+The last point a function was evaluated at, and its value there.
+The optimizer evaluates the costs and constraints at a candidate point and, if it accepts it, convexifies
+them at the same point, so value() stores the result here and convex() looks it up instead of evaluating
+the function again. The points are compared exactly.
+*/
+class EvalCache {
+public:
+  EvalCache() : valid_(false) {}
+  /** The stored value, if x is the stored point, otherwise NULL */
+  const VectorXd* find(const VectorXd& x) const {return (valid_ && x.size() == x_.size() && x == x_) ? &y_ : NULL;}
+  void store(const VectorXd& x, const VectorXd& y) {x_ = x; y_ = y; valid_ = true;}
+private:
+  VectorXd x_, y_;
+  bool valid_;
+};
+
 class CostFromFunc : public Cost {
 public:
   /// supply function, obtain derivative and hessian numerically
@@ -55,15 +72,20 @@ public:
   CostFromErrFunc(VectorOfVectorPtr f, const VarVector& vars, const VectorXd& coeffs, PenaltyType pen_type, const string&  name);
   /// supply error function and gradient
   CostFromErrFunc(VectorOfVectorPtr f, MatrixOfVectorPtr dfdx, const VarVector& vars, const VectorXd& coeffs, PenaltyType pen_type, const string&  name);
+  /// supply error function and the sparsity pattern of its Jacobian, obtain derivative numerically with one evaluation per group of columns
+  CostFromErrFunc(VectorOfVectorPtr f, const JacobianSparsity& sparsity, const VarVector& vars, const VectorXd& coeffs, PenaltyType pen_type, const string&  name);
   double value(const vector<double>& x);
   ConvexObjectivePtr convex(const vector<double>& x, Model* model);
 protected:
   VectorOfVectorPtr f_;
   MatrixOfVectorPtr dfdx_;
+  JacobianSparsity sparsity_;
+  vector< vector<int> > colors_; // of the columns of sparsity_, empty if it isn't used
   VarVector vars_;
   VectorXd coeffs_;
   PenaltyType pen_type_;
   double epsilon_;
+  EvalCache cache_;
 };
 
 class ConstraintFromFunc : public Constraint {
@@ -72,15 +94,20 @@ public:
   ConstraintFromFunc(VectorOfVectorPtr f, const VarVector& vars, ConstraintType type, const std::string& name);
   /// supply error function and gradient
   ConstraintFromFunc(VectorOfVectorPtr f, MatrixOfVectorPtr dfdx, const VarVector& vars, ConstraintType type, const std::string& name);
+  /// supply error function and the sparsity pattern of its Jacobian, obtain derivative numerically with one evaluation per group of columns
+  ConstraintFromFunc(VectorOfVectorPtr f, const JacobianSparsity& sparsity, const VarVector& vars, ConstraintType type, const std::string& name);
   vector<double> value(const vector<double>& x);
   ConvexConstraintsPtr convex(const vector<double>& x, Model* model);
   ConstraintType type() {return type_;}
 protected:
   VectorOfVectorPtr f_;
   MatrixOfVectorPtr dfdx_;
+  JacobianSparsity sparsity_;
+  vector< vector<int> > colors_; // of the columns of sparsity_, empty if it isn't used
   VarVector vars_;
   ConstraintType type_;
   double epsilon_;
+  EvalCache cache_;
 };
 
 
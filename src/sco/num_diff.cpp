@@ -1,5 +1,9 @@
 #include "num_diff.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cassert>
 using namespace Eigen;
+using namespace std;
 using namespace sco;
 
 namespace sco {
@@ -40,7 +44,9 @@ VectorXd calcForwardNumGrad(const ScalarOfVector& f, const VectorXd& x, double e
   return out;
 }
 MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, double epsilon) {
-  VectorXd y = f(x);
+  return calcForwardNumJac(f, x, f(x), epsilon);
+}
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, const VectorXd& y, double epsilon) {
   MatrixXd out(y.size(), x.size());
   VectorXd xpert = x;
   for (size_t i=0; i < size_t(x.size()); ++i) {
@@ -52,6 +58,96 @@ MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, double ep
   return out;
 }
 
+JacobianSparsity JacobianSparsity::fromJacobian(const MatrixXd& jac) {
+  JacobianSparsity out(jac.rows(), jac.cols());
+  for (int j=0; j < jac.cols(); ++j) {
+    for (int i=0; i < jac.rows(); ++i) {
+      if (jac(i,j) != 0) out.col_rows_[j].push_back(i);
+    }
+  }
+  return out;
+}
+
+void JacobianSparsity::addNonzero(int row, int col) {
+  assert(row < rows_ && col < cols());
+  vector<int>& rows = col_rows_[col];
+  vector<int>::iterator it = std::lower_bound(rows.begin(), rows.end(), row);
+  if (it == rows.end() || *it != row) rows.insert(it, row);
+}
+void JacobianSparsity::addBlock(int row, int col, int n_rows, int n_cols) {
+  for (int j=col; j < col+n_cols; ++j) {
+    for (int i=row; i < row+n_rows; ++i) addNonzero(i, j);
+  }
+}
+
+static bool moreNonzeros(const pair<int,int>& a, const pair<int,int>& b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+vector< vector<int> > JacobianSparsity::colorColumns() const {
+  vector< pair<int,int> > order(cols()); // (nonzeros, column)
+  for (int j=0; j < cols(); ++j) order[j] = make_pair((int)col_rows_[j].size(), j);
+  std::sort(order.begin(), order.end(), moreNonzeros);
+
+  vector< vector<int> > colors;
+  vector< vector<bool> > rows_used; // by each color
+  for (size_t k=0; k < order.size(); ++k) {
+    int j = order[k].second;
+    const vector<int>& rows = col_rows_[j];
+    size_t c = 0;
+    for (; c < colors.size(); ++c) {
+      bool orthogonal = true;
+      for (size_t r=0; r < rows.size() && orthogonal; ++r) orthogonal = !rows_used[c][rows[r]];
+      if (orthogonal) break;
+    }
+    if (c == colors.size()) {
+      colors.push_back(vector<int>());
+      rows_used.push_back(vector<bool>(rows_, false));
+    }
+    colors[c].push_back(j);
+    for (size_t r=0; r < rows.size(); ++r) rows_used[c][rows[r]] = true;
+  }
+  return colors;
+}
+
+// forward difference of one group of columns
+struct PerturbColumns {
+  const VectorOfVector& f;
+  const VectorXd& x;
+  const VectorXd& y;
+  double epsilon;
+  const JacobianSparsity& sparsity;
+  const vector< vector<int> >& colors;
+  MatrixXd& out;
+  PerturbColumns(const VectorOfVector& f, const VectorXd& x, const VectorXd& y, double epsilon,
+      const JacobianSparsity& sparsity, const vector< vector<int> >& colors, MatrixXd& out) :
+    f(f), x(x), y(y), epsilon(epsilon), sparsity(sparsity), colors(colors), out(out) {}
+  void operator()(int c) const {
+    VectorXd xpert = x;
+    const vector<int>& cols = colors[c];
+    for (size_t k=0; k < cols.size(); ++k) xpert(cols[k]) += epsilon;
+    VectorXd ypert = f(xpert);
+    for (size_t k=0; k < cols.size(); ++k) {
+      const vector<int>& rows = sparsity.colRows(cols[k]);
+      for (size_t r=0; r < rows.size(); ++r) out(rows[r], cols[k]) = (ypert(rows[r]) - y(rows[r])) / epsilon;
+    }
+  }
+};
+
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, double epsilon,
+    const JacobianSparsity& sparsity, const vector< vector<int> >& colors, ThreadPool* pool) {
+  return calcForwardNumJac(f, x, f(x), epsilon, sparsity, colors, pool);
+}
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, const VectorXd& y, double epsilon,
+    const JacobianSparsity& sparsity, const vector< vector<int> >& colors, ThreadPool* pool) {
+  assert(sparsity.rows() == y.size() && sparsity.cols() == x.size());
+  MatrixXd out = MatrixXd::Zero(y.size(), x.size());
+  PerturbColumns body(f, x, y, epsilon, sparsity, colors, out);
+  if (pool) pool->parallelFor(colors.size(), body);
+  else for (size_t c=0; c < colors.size(); ++c) body(c);
+  return out;
+}
+
 void calcGradAndDiagHess(const ScalarOfVector& f, const VectorXd& x,
     double epsilon, double& y, VectorXd& grad, VectorXd& hess) {
   y = f(x);
@@ -97,12 +193,42 @@ struct ForwardNumJac : public MatrixOfVector {
   }
 };
 
+struct SparseForwardNumJac : public MatrixOfVector {
+  VectorOfVectorPtr f_;
+  double epsilon_;
+  ThreadPoolPtr pool_;
+  // set by the first call if the pattern has to be detected
+  mutable JacobianSparsity sparsity_;
+  mutable vector< vector<int> > colors_;
+  mutable bool detected_;
+  SparseForwardNumJac(VectorOfVectorPtr f, double epsilon, ThreadPoolPtr pool) :
+    f_(f), epsilon_(epsilon), pool_(pool), detected_(false) {}
+  SparseForwardNumJac(VectorOfVectorPtr f, double epsilon, const JacobianSparsity& sparsity, ThreadPoolPtr pool) :
+    f_(f), epsilon_(epsilon), pool_(pool), sparsity_(sparsity), colors_(sparsity.colorColumns()), detected_(true) {}
+  MatrixXd operator()(const VectorXd& x) const {
+    if (!detected_) {
+      MatrixXd jac = calcForwardNumJac(*f_, x, epsilon_);
+      sparsity_ = JacobianSparsity::fromJacobian(jac);
+      colors_ = sparsity_.colorColumns();
+      detected_ = true;
+      return jac;
+    }
+    return calcForwardNumJac(*f_, x, epsilon_, sparsity_, colors_, pool_.get());
+  }
+};
+
 VectorOfVectorPtr forwardNumGrad(ScalarOfVectorPtr f, double epsilon) {
   return VectorOfVectorPtr(new ForwardNumGrad(f, epsilon));
 }
 MatrixOfVectorPtr forwardNumJac(VectorOfVectorPtr f, double epsilon) {
   return MatrixOfVectorPtr(new ForwardNumJac(f, epsilon));
 }
+MatrixOfVectorPtr forwardNumJac(VectorOfVectorPtr f, double epsilon, const JacobianSparsity& sparsity, ThreadPoolPtr pool) {
+  return MatrixOfVectorPtr(new SparseForwardNumJac(f, epsilon, sparsity, pool));
+}
+MatrixOfVectorPtr forwardNumJacDetectSparsity(VectorOfVectorPtr f, double epsilon, ThreadPoolPtr pool) {
+  return MatrixOfVectorPtr(new SparseForwardNumJac(f, epsilon, pool));
+}
 
 
 }
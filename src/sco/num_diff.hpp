@@ -2,6 +2,7 @@
 #include <boost/function.hpp>
 #include <Eigen/Dense>
 #include <boost/shared_ptr.hpp>
+#include <vector>
 /*
  * Numerical derivatives
  */
@@ -13,9 +14,11 @@ using Eigen::MatrixXd;
 class ScalarOfVector;
 class VectorOfVector;
 class MatrixOfVector;
+class ThreadPool;
 typedef boost::shared_ptr<ScalarOfVector> ScalarOfVectorPtr;
 typedef boost::shared_ptr<VectorOfVector> VectorOfVectorPtr;
 typedef boost::shared_ptr<MatrixOfVector> MatrixOfVectorPtr;
+typedef boost::shared_ptr<ThreadPool> ThreadPoolPtr;
 
 class ScalarOfVector {
 public:
@@ -33,6 +36,11 @@ class VectorOfVector {
 public:
   virtual VectorXd operator()(const VectorXd& x) const = 0;
   VectorXd call(const VectorXd& x) const {return operator()(x);}
+  /**
+   * Value and exact Jacobian in one evaluation, for functions that can differentiate themselves (see autodiff.hpp).
+   * Returns false if they can't, and then the Jacobian is computed numerically
+   */
+  virtual bool valueAndJacobian(const VectorXd& x, VectorXd& y, MatrixXd& jac) const {return false;}
   virtual ~VectorOfVector() {}
 
   typedef function<VectorXd(VectorXd)> boost_func;
@@ -53,15 +61,59 @@ public:
   //  static MatrixOfVectorPtr construct(const c_func&);
 };
 
+/**
+Sparsity pattern of a Jacobian, stored as the rows that can be nonzero in each column.
+Columns that have no row in common are structurally orthogonal, so a forward difference can perturb them
+together and still tell their derivatives apart (Curtis, Powell and Reid).
+*/
+class JacobianSparsity {
+public:
+  JacobianSparsity() : rows_(0) {}
+  JacobianSparsity(int rows, int cols) : rows_(rows), col_rows_(cols) {}
+  /** Pattern of the nonzeros of jac. Entries that just happen to vanish where jac was computed are missed */
+  static JacobianSparsity fromJacobian(const MatrixXd& jac);
+
+  void addNonzero(int row, int col);
+  void addBlock(int row, int col, int n_rows, int n_cols);
+
+  int rows() const {return rows_;}
+  int cols() const {return col_rows_.size();}
+  const std::vector<int>& colRows(int col) const {return col_rows_[col];}
+  /** Groups of structurally orthogonal columns, from greedy coloring of the columns with the most nonzeros first */
+  std::vector< std::vector<int> > colorColumns() const;
+
+private:
+  int rows_;
+  std::vector< std::vector<int> > col_rows_; // sorted
+};
 
 VectorXd calcForwardNumGrad(const ScalarOfVector& f, const VectorXd& x, double epsilon);
 MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, double epsilon);
+/** Same, when y = f(x) is already known */
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, const VectorXd& y, double epsilon);
+/**
+Forward difference Jacobian with one evaluation per group of columns (see JacobianSparsity::colorColumns).
+Entries outside the pattern are zero. With a pool, the groups are evaluated in parallel, so f must be thread-safe
+*/
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, double epsilon,
+    const JacobianSparsity& sparsity, const std::vector< std::vector<int> >& colors, ThreadPool* pool=NULL);
+/** Same, when y = f(x) is already known */
+MatrixXd calcForwardNumJac(const VectorOfVector& f, const VectorXd& x, const VectorXd& y, double epsilon,
+    const JacobianSparsity& sparsity, const std::vector< std::vector<int> >& colors, ThreadPool* pool=NULL);
 void calcGradAndDiagHess(const ScalarOfVector& f, const VectorXd& x, double epsilon,
     double& y, VectorXd& grad, VectorXd& hess);
 void calcGradHess(ScalarOfVectorPtr f, const VectorXd& x, double epsilon,
     double& y, VectorXd& grad, MatrixXd& hess);
 VectorOfVectorPtr forwardNumGrad(ScalarOfVectorPtr f, double epsilon);
 MatrixOfVectorPtr forwardNumJac(VectorOfVectorPtr f, double epsilon);
+/** Jacobian of f with the given sparsity pattern. The columns are colored once, here */
+MatrixOfVectorPtr forwardNumJac(VectorOfVectorPtr f, double epsilon, const JacobianSparsity& sparsity,
+    ThreadPoolPtr pool=ThreadPoolPtr());
+/**
+Jacobian of f whose sparsity pattern is detected from a dense numerical Jacobian at the first point it's
+called with. Only use it if the pattern doesn't depend on the point
+*/
+MatrixOfVectorPtr forwardNumJacDetectSparsity(VectorOfVectorPtr f, double epsilon, ThreadPoolPtr pool=ThreadPoolPtr());
 
 
 
@@ -3,11 +3,14 @@
 #include "utils/logging.hpp"
 #include <boost/foreach.hpp>
 #include "solver_interface.hpp"
+#include "deferred_model.hpp"
+#include "thread_pool.hpp"
 #include "expr_ops.hpp"
 #include <cmath>
 #include <cstdio>
 #include "sco_common.hpp"
 #include "utils/stl_to_string.hpp"
+#include "utils/clock.hpp"
 #include "macros.h"
 #include <boost/format.hpp>
 using namespace std;
@@ -22,8 +25,10 @@ std::ostream& operator<<(std::ostream& o, const OptResults& r) {
     << "status: " << statusToString(r.status) << endl
     << "cost values: " << Str(r.cost_vals) << endl
     << "constraint violations: " << Str(r.cnt_viols) << endl
+    << "constraint penalty coefficients: " << Str(r.cnt_coeffs) << endl
     << "n func evals: " << r.n_func_evals << endl
-    << "n qp solves: " << r.n_qp_solves << endl;
+    << "n qp solves: " << r.n_qp_solves << endl
+    << "best point feasible: " << r.best_feasible << endl;
   return o;
 }
 
@@ -33,35 +38,165 @@ std::ostream& operator<<(std::ostream& o, const OptResults& r) {
 
 
 
-static DblVec evaluateCosts(vector<CostPtr>& costs, const DblVec& x) {
-  DblVec out(costs.size());
-  for (size_t i=0; i < costs.size(); ++i) {
-    out[i] = costs[i]->value(x);
+// bodies of the parallel loops. each call only writes out[i]
+struct EvaluateCost {
+  vector<CostPtr>& costs;
+  const DblVec& x;
+  DblVec& out;
+  EvaluateCost(vector<CostPtr>& costs, const DblVec& x, DblVec& out) : costs(costs), x(x), out(out) {}
+  void operator()(int i) const {out[i] = costs[i]->value(x);}
+};
+struct EvaluateConstraintViol {
+  vector<ConstraintPtr>& cnts;
+  const DblVec& x;
+  DblVec& out;
+  EvaluateConstraintViol(vector<ConstraintPtr>& cnts, const DblVec& x, DblVec& out) : cnts(cnts), x(x), out(out) {}
+  void operator()(int i) const {out[i] = cnts[i]->violation(x);}
+};
+// every cost and constraint at several points. each call handles one cost or constraint, so that an object is
+// never used by two threads at once. the points are visited last to first, so the first one is evaluated last
+struct EvaluateAtPoints {
+  vector<CostPtr>& costs;
+  vector<ConstraintPtr>& cnts;
+  const vector<DblVec>& xs;
+  vector<DblVec>& cost_vals;
+  vector<DblVec>& cnt_viols;
+  EvaluateAtPoints(vector<CostPtr>& costs, vector<ConstraintPtr>& cnts, const vector<DblVec>& xs, vector<DblVec>& cost_vals,
+      vector<DblVec>& cnt_viols) : costs(costs), cnts(cnts), xs(xs), cost_vals(cost_vals), cnt_viols(cnt_viols) {}
+  void operator()(int i) const {
+    int n_costs = costs.size();
+    for (int k=xs.size()-1; k >= 0; --k) {
+      if (i < n_costs) cost_vals[k][i] = costs[i]->value(xs[k]);
+      else cnt_viols[k][i-n_costs] = cnts[i-n_costs]->violation(xs[k]);
+    }
+  }
+};
+typedef boost::shared_ptr<DeferredVarModel> DeferredVarModelPtr;
+struct ConvexifyCost {
+  vector<CostPtr>& costs;
+  const DblVec& x;
+  vector<DeferredVarModelPtr>& models;
+  vector<ConvexObjectivePtr>& out;
+  DblVec& times;
+  ConvexifyCost(vector<CostPtr>& costs, const DblVec& x, vector<DeferredVarModelPtr>& models, vector<ConvexObjectivePtr>& out,
+      DblVec& times) : costs(costs), x(x), models(models), out(out), times(times) {}
+  void operator()(int i) const {
+    if (out[i]) return;
+    double start = GetClock();
+    out[i] = costs[i]->convex(x, models[i].get());
+    times[i] = GetClock() - start;
+  }
+};
+struct ConvexifyConstraint {
+  vector<ConstraintPtr>& cnts;
+  const DblVec& x;
+  Model* model;
+  vector<ConvexConstraintsPtr>& out;
+  DblVec& times;
+  ConvexifyConstraint(vector<ConstraintPtr>& cnts, const DblVec& x, Model* model, vector<ConvexConstraintsPtr>& out,
+      DblVec& times) : cnts(cnts), x(x), model(model), out(out), times(times) {}
+  void operator()(int i) const {
+    double start = GetClock();
+    out[i] = cnts[i]->convex(x, model);
+    times[i] = GetClock() - start;
   }
+};
+
+static DblVec evaluateCosts(vector<CostPtr>& costs, const DblVec& x, ThreadPool* pool) {
+  DblVec out(costs.size());
+  EvaluateCost body(costs, x, out);
+  if (pool) pool->parallelFor(costs.size(), body);
+  else for (size_t i=0; i < costs.size(); ++i) body(i);
   return out;
 }
-static DblVec evaluateConstraintViols(vector<ConstraintPtr>& constraints, const DblVec& x) {
+static DblVec evaluateConstraintViols(vector<ConstraintPtr>& constraints, const DblVec& x, ThreadPool* pool) {
   DblVec out(constraints.size());
-  for (size_t i=0; i < constraints.size(); ++i) {
-    out[i] = constraints[i]->violation(x);
+  EvaluateConstraintViol body(constraints, x, out);
+  if (pool) pool->parallelFor(constraints.size(), body);
+  else for (size_t i=0; i < constraints.size(); ++i) body(i);
+  return out;
+}
+static void evaluateAtPoints(vector<CostPtr>& costs, vector<ConstraintPtr>& constraints, const vector<DblVec>& xs,
+    vector<DblVec>& cost_vals, vector<DblVec>& cnt_viols, ThreadPool* pool) {
+  cost_vals.assign(xs.size(), DblVec(costs.size()));
+  cnt_viols.assign(xs.size(), DblVec(constraints.size()));
+  EvaluateAtPoints body(costs, constraints, xs, cost_vals, cnt_viols);
+  int n = costs.size() + constraints.size();
+  if (pool) pool->parallelFor(n, body);
+  else for (int i=0; i < n; ++i) body(i);
+}
+// costs with a cached convexification in constant_models are not convexified again (and take no time).
+// in parallel, every cost adds its auxiliary variables to a DeferredVarModel of its own, and they are created
+// in the real model afterwards, in the order of the costs, which gives the same model as the serial loop
+static vector<ConvexObjectivePtr> convexifyCosts(vector<CostPtr>& costs, const vector<ConvexObjectivePtr>& constant_models,
+    const DblVec& x, Model* model, ThreadPool* pool, DblVec& times) {
+  times.assign(costs.size(), 0);
+  if (!pool) {
+    vector<ConvexObjectivePtr> out(constant_models);
+    for (size_t i=0; i < costs.size(); ++i) {
+      if (out[i]) continue;
+      double start = GetClock();
+      out[i] = costs[i]->convex(x,  model);
+      times[i] = GetClock() - start;
+    }
+    return out;
+  }
+  vector<DeferredVarModelPtr> deferred(costs.size());
+  for (size_t i=0; i < costs.size(); ++i) deferred[i].reset(new DeferredVarModel());
+  // declared after deferred, so that on error the objectives go away before the models they refer to
+  vector<ConvexObjectivePtr> out(constant_models);
+  pool->parallelFor(costs.size(), ConvexifyCost(costs, x, deferred, out, times));
+  for (size_t i=0; i < costs.size(); ++i) {
+    if (out[i] != constant_models[i]) deferred[i]->commit(*out[i], model);
   }
   return out;
 }
-static vector<ConvexObjectivePtr> convexifyCosts(vector<CostPtr>& costs, const DblVec& x, Model* model) {
+// convexify the costs that declare themselves convex and constant, and merge their objectives into one block
+static vector<ConvexObjectivePtr> convexifyConstantCosts(vector<CostPtr>& costs, const DblVec& x, Model* model,
+    IndexQuadExpr& constant_objective) {
   vector<ConvexObjectivePtr> out(costs.size());
+  IndexQuadExpr sum;
   for (size_t i=0; i < costs.size(); ++i) {
-    out[i] = costs[i]->convex(x,  model);
+    if (!costs[i]->isConvexConstant()) continue;
+    out[i] = costs[i]->convex(x, model);
+    if (!out[i]->vars_.empty() || !out[i]->eqs_.empty() || !out[i]->ineqs_.empty()) {
+      PRINT_AND_THROW(boost::format("cost %s is declared convex and constant but adds variables or constraints")%costs[i]->name());
+    }
+    exprInc(sum, out[i]->quad_);
+    exprInc(sum, out[i]->index_quad_);
   }
+  constant_objective = combineTerms(sum);
   return out;
 }
-static vector<ConvexConstraintsPtr> convexifyConstraints(vector<ConstraintPtr>& cnts, const DblVec& x, Model* model) {
+// ConvexConstraints only keep a pointer to the model until addConstraintsToModel(), so the constraints
+// can be convexified against the real model in parallel
+static vector<ConvexConstraintsPtr> convexifyConstraints(vector<ConstraintPtr>& cnts, const DblVec& x, Model* model, ThreadPool* pool,
+    DblVec& times) {
   vector<ConvexConstraintsPtr> out(cnts.size());
-  for (size_t i=0; i < cnts.size(); ++i) {
-    out[i] = cnts[i]->convex(x, model);
-  }
+  times.resize(cnts.size());
+  ConvexifyConstraint body(cnts, x, model, out, times);
+  if (pool) pool->parallelFor(cnts.size(), body);
+  else for (size_t i=0; i < cnts.size(); ++i) body(i);
   return out;
 }
 
+template <typename ConvexModelPtr>
+static void removeFromModel(vector<ConvexModelPtr>& models) {
+  BOOST_FOREACH(ConvexModelPtr& m, models) if (m->inModel()) m->removeFromModel();
+  models.clear();
+}
+
+// count the affine and quadratic terms of the convex objectives, except for the cached ones in constant_models
+static void countObjectiveTerms(const vector<ConvexObjectivePtr>& costs, const vector<ConvexObjectivePtr>& constant_models,
+    size_t& n_aff, size_t& n_quad) {
+  for (size_t i=0; i < costs.size(); ++i) {
+    const ConvexObjectivePtr& co = costs[i];
+    if (i < constant_models.size() && co == constant_models[i]) continue;
+    n_aff += co->quad_.affexpr.size() + co->index_quad_.affexpr.size();
+    n_quad += co->quad_.size() + co->index_quad_.size();
+  }
+}
+
 DblVec evaluateModelCosts(vector<ConvexObjectivePtr>& costs, const DblVec& x) {
   DblVec out(costs.size());
   for (size_t i=0; i < costs.size(); ++i) {
@@ -90,7 +225,7 @@ static vector<string> getCntNames(const vector<ConstraintPtr>& cnts) {
 
 void printCostInfo(const vector<double>& old_cost_vals, const vector<double>& model_cost_vals, const vector<double>& new_cost_vals,
                   const vector<double>& old_cnt_vals, const vector<double>& model_cnt_vals, const vector<double>& new_cnt_vals,
-    const vector<string>& cost_names, const vector<string>& cnt_names, double merit_coeff) {
+    const vector<string>& cost_names, const vector<string>& cnt_names, const vector<double>& merit_coeffs) {
     printf("%15s | %10s | %10s | %10s | %10s\n", "", "oldexact", "dapprox", "dexact", "ratio");
     printf("%15s | %10s---%10s---%10s---%10s\n", "COSTS", "----------", "----------", "----------", "----------");
     for (size_t i=0; i < old_cost_vals.size(); ++i) {
@@ -106,6 +241,7 @@ void printCostInfo(const vector<double>& old_cost_vals, const vector<double>& mo
     for (size_t i=0; i < old_cnt_vals.size(); ++i) {
       double approx_improve = old_cnt_vals[i] - model_cnt_vals[i];
       double exact_improve = old_cnt_vals[i] - new_cnt_vals[i];
+      double merit_coeff = merit_coeffs[i];
       if (fabs(approx_improve > 1e-8)) 
         printf("%15s | %10.3e | %10.3e | %10.3e | %10.3e\n", cnt_names[i].c_str(), merit_coeff*old_cnt_vals[i], merit_coeff*approx_improve, merit_coeff*exact_improve, exact_improve/approx_improve); 
       else 
@@ -114,16 +250,17 @@ void printCostInfo(const vector<double>& old_cost_vals, const vector<double>& mo
 
 }
 
-// todo: use different coeffs for each constraint
-vector<ConvexObjectivePtr> cntsToCosts(const vector<ConvexConstraintsPtr>& cnts, double err_coeff, Model* model) {
+// err_coeffs[i] is the penalty coefficient of cnts[i]
+vector<ConvexObjectivePtr> cntsToCosts(const vector<ConvexConstraintsPtr>& cnts, const DblVec& err_coeffs, Model* model) {
+  assert(cnts.size() == err_coeffs.size());
   vector<ConvexObjectivePtr> out;
-  BOOST_FOREACH(const ConvexConstraintsPtr& cnt, cnts) {
+  for (size_t i=0; i < cnts.size(); ++i) {
     ConvexObjectivePtr obj(new ConvexObjective(model));
-    BOOST_FOREACH(const AffExpr& aff, cnt->eqs_) {
-      obj->addAbs(aff, err_coeff);
+    BOOST_FOREACH(const AffExpr& aff, cnts[i]->eqs_) {
+      obj->addAbs(aff, err_coeffs[i]);
     }
-    BOOST_FOREACH(const AffExpr& aff, cnt->ineqs_) {
-      obj->addHinge(aff, err_coeff);
+    BOOST_FOREACH(const AffExpr& aff, cnts[i]->ineqs_) {
+      obj->addHinge(aff, err_coeffs[i]);
     }
     out.push_back(obj);
   }
@@ -171,6 +308,9 @@ void BasicTrustRegionSQP::initParameters() {
 
   merit_error_coeff_ = 10;
   trust_box_size_ = 1e-1;
+  persistent_structure_ = true;
+  num_threads_ = 1;
+  num_trust_box_sizes_ = 1;
 
 
 }
@@ -180,10 +320,43 @@ void BasicTrustRegionSQP::setProblem(OptProbPtr prob) {
   model_ = prob->getModel();
 }
 
+double BasicTrustRegionSQP::merit(const DblVec& cost_vals, const DblVec& cnt_viols) const {
+  assert(cnt_viols.size() == cnt_coeffs_.size());
+  double out = vecSum(cost_vals);
+  for (size_t i=0; i < cnt_viols.size(); ++i) out += cnt_coeffs_[i] * cnt_viols[i];
+  return out;
+}
+bool BasicTrustRegionSQP::cntsSatisfied() const {
+  return results_.cnt_viols.empty() || vecMax(results_.cnt_viols) < cnt_tolerance_;
+}
+
+void BasicTrustRegionSQP::initPenalties() {
+  cnt_coeffs_.assign(prob_->getConstraints().size(), merit_error_coeff_);
+}
+// only the violated constraints get a larger coefficient, so that one stubborn constraint doesn't make the
+// penalties of all the others steep too
+bool BasicTrustRegionSQP::adjustPenalties(int n_adjustments) {
+  for (size_t i=0; i < cnt_coeffs_.size(); ++i) {
+    if (results_.cnt_viols[i] >= cnt_tolerance_) cnt_coeffs_[i] *= merit_coeff_increase_ratio_;
+  }
+  LOG_INFO("not all constraints are satisfied. new penalty coefficients: %s", CSTR(cnt_coeffs_));
+  return n_adjustments + 1 < max_merit_coeff_increases_;
+}
+
+void BasicTrustRegionSQP::updateBest(const DblVec& x, const DblVec& cost_vals, const DblVec& cnt_viols) {
+  // the merits are compared with the current coefficients, which may have grown since best_x was found
+  if (results_.best_x.empty() || merit(cost_vals, cnt_viols) < merit(best_cost_vals_, best_cnt_viols_)) {
+    results_.best_x = x;
+    results_.best_feasible = cnt_viols.empty() || vecMax(cnt_viols) < cnt_tolerance_;
+    best_cost_vals_ = cost_vals;
+    best_cnt_viols_ = cnt_viols;
+  }
+}
+
 void BasicTrustRegionSQP::adjustTrustRegion(double ratio) {
   trust_box_size_ *= ratio;
 }
-void BasicTrustRegionSQP::setTrustBoxConstraints(const DblVec& x) {
+void BasicTrustRegionSQP::setTrustBoxConstraints(const DblVec& x, double trust_box_size) {
   vector<Var>& vars = prob_->getVars();
   assert(vars.size() == x.size());
   DblVec& lb=prob_->getLowerBounds(), ub=prob_->getUpperBounds();
@@ -191,8 +364,8 @@ void BasicTrustRegionSQP::setTrustBoxConstraints(const DblVec& x) {
   vector<bool> incmask = prob_->getIncrementMask();
   if (incmask.empty()) incmask = vector<bool>(x.size(), false);
   for (size_t i=0; i < x.size(); ++i) {
-    lbtrust[i] = fmax((incmask[i] ? 0 : x[i]) - trust_box_size_, lb[i]);
-    ubtrust[i] = fmin((incmask[i] ? 0 : x[i]) + trust_box_size_, ub[i]);
+    lbtrust[i] = fmax((incmask[i] ? 0 : x[i]) - trust_box_size, lb[i]);
+    ubtrust[i] = fmin((incmask[i] ? 0 : x[i]) + trust_box_size, ub[i]);
   }
   model_->setVarBounds(vars, lbtrust, ubtrust);
 }
@@ -235,36 +408,90 @@ OptStatus BasicTrustRegionSQP::optimize() {
   assert(prob_->getCosts().size() > 0 || constraints.size() > 0);
 
   OptStatus retval = INVALID;
-
-  for (int merit_increases=0; merit_increases < max_merit_coeff_increases_; ++merit_increases) { /* merit adjustment loop */
+  double start_time = GetClock(); // max_time_ is read at every check, so a callback can change it
+
+  model_->setPersistentStructure(persistent_structure_);
+  if (num_threads_ <= 1) pool_.reset();
+  else if (!pool_ || pool_->numThreads() != num_threads_) pool_.reset(new ThreadPool(num_threads_));
+  vector<ConvexObjectivePtr> cost_models, cnt_cost_models;
+  vector<ConvexConstraintsPtr> cnt_models;
+  IndexQuadExpr constant_objective;
+  vector<ConvexObjectivePtr> constant_models = convexifyConstantCosts(prob_->getCosts(), x_, model_.get(), constant_objective);
+  initPenalties();
+
+  for (int n_adjustments=0; ; ++n_adjustments) { /* merit adjustment loop */
     for (int iter=1; ; ++iter) { /* sqp loop */
+      results_.iterations.push_back(IterationRecord());
+      IterationRecord& record = results_.iterations.back();
+      record.merit_coeff = cnt_coeffs_.empty() ? merit_error_coeff_ : vecMax(cnt_coeffs_);
+      record.trust_box_size = trust_box_size_;
+      double phase_start = GetClock();
       callCallbacks(x_);
+      record.callback_time = GetClock() - phase_start;
 
       LOG_DEBUG("current iterate: %s", CSTR(x_));
       LOG_INFO("iteration %i", iter);
 
       // speedup: if you just evaluated the cost when doing the line search, use that
       if (results_.cost_vals.empty()) { //only happens on the first iteration
-        results_.cnt_viols = evaluateConstraintViols(constraints, x_);
-        results_.cost_vals = evaluateCosts(prob_->getCosts(), x_);
+        phase_start = GetClock();
+        results_.cnt_viols = evaluateConstraintViols(constraints, x_, pool_.get());
+        results_.cost_vals = evaluateCosts(prob_->getCosts(), x_, pool_.get());
         assert(results_.n_func_evals == 0);
         ++results_.n_func_evals;
+        updateBest(x_, results_.cost_vals, results_.cnt_viols);
+        record.eval_time += GetClock() - phase_start;
+      }
+
+      if (GetClock() - start_time > max_time_) {
+        LOG_INFO("time limit");
+        retval = OPT_TIME_LIMIT;
+        goto cleanup;
       }
 
-      vector<ConvexObjectivePtr> cost_models = convexifyCosts(prob_->getCosts(),x_, model_.get());
-      vector<ConvexConstraintsPtr> cnt_models = convexifyConstraints(constraints, x_, model_.get());
-      vector<ConvexObjectivePtr> cnt_cost_models = cntsToCosts(cnt_models, merit_error_coeff_, model_.get());
+      // release the previous convexification in the order it was created, so that in persistent mode
+      // each cost gets back the same auxiliary variables and rows as in the last iteration
+      phase_start = GetClock();
+      RecordStats records_before = model_->getRecordStats();
+      removeFromModel(cost_models);
+      removeFromModel(cnt_cost_models);
+      removeFromModel(cnt_models);
+      record.model_time += GetClock() - phase_start;
+      phase_start = GetClock();
+      cost_models = convexifyCosts(prob_->getCosts(), constant_models, x_, model_.get(), pool_.get(), record.cost_convexify_times);
+      cnt_models = convexifyConstraints(constraints, x_, model_.get(), pool_.get(), record.cnt_convexify_times);
+      cnt_cost_models = cntsToCosts(cnt_models, cnt_coeffs_, model_.get());
+      record.convexify_time = GetClock() - phase_start;
+      phase_start = GetClock();
       model_->update();
       BOOST_FOREACH(ConvexObjectivePtr& cost, cost_models)cost->addConstraintsToModel();
       BOOST_FOREACH(ConvexObjectivePtr& cost, cnt_cost_models)cost->addConstraintsToModel();
       model_->update();
-      QuadExpr objective;
-      BOOST_FOREACH(ConvexObjectivePtr& co, cost_models)exprInc(objective, co->quad_);
-      BOOST_FOREACH(ConvexObjectivePtr& co, cnt_cost_models){
-      exprInc(objective, co->quad_);
-    }
+      RecordStats records_after = model_->getRecordStats();
+      results_.record_stats.push_back(RecordStats(records_after.n_created - records_before.n_created,
+          records_after.n_heap_allocs - records_before.n_heap_allocs));
+      LOG_DEBUG("created %i variable/constraint records, %i heap allocations", results_.record_stats.back().n_created,
+          results_.record_stats.back().n_heap_allocs);
+      IndexQuadExpr objective = constant_objective;
+      size_t n_aff = objective.affexpr.size(), n_quad = objective.size();
+      countObjectiveTerms(cost_models, constant_models, n_aff, n_quad);
+      countObjectiveTerms(cnt_cost_models, vector<ConvexObjectivePtr>(), n_aff, n_quad);
+      objective.reserve(n_aff, n_quad);
+      for (size_t i=0; i < cost_models.size(); ++i) {
+        if (cost_models[i] == constant_models[i]) continue;
+        exprInc(objective, cost_models[i]->quad_);
+        exprInc(objective, cost_models[i]->index_quad_);
+      }
+      BOOST_FOREACH(ConvexObjectivePtr& co, cnt_cost_models) {
+        exprInc(objective, co->quad_);
+        exprInc(objective, co->index_quad_);
+      }
 //    objective = cleanupExpr(objective);
       model_->setObjective(objective);
+      record.model_time += GetClock() - phase_start;
+      record.n_vars = model_->getVars().size();
+      record.n_cnts = model_->getCnts().size();
+      record.n_nonzeros = model_->getNumNonzeros();
 
 //    if (logging::filter() >= IPI_LEVEL_DEBUG) {
 //      DblVec model_cost_vals;
@@ -274,79 +501,128 @@ OptStatus BasicTrustRegionSQP::optimize() {
 //      LOG_DEBUG("model costs %s should equalcosts  %s", printer(model_cost_vals), printer(cost_vals));
 //    }
 
+      // the auxiliary variables and constraint rows were just recreated, so only the iterate is known.
+      // after a rejected step, the model only differs in the trust region, so the last solution is used
+      DblVec warm_primal = x_, warm_dual;
       while (trust_box_size_ >= min_trust_box_size_) {
 
-        setTrustBoxConstraints(x_);
-        CvxOptStatus status = model_->optimize();
-        ++results_.n_qp_solves;
-        if (status != CVX_SOLVED) {
-          LOG_ERROR("convex solver failed! set LOG_DEBUG_LEVEL=DEBUG to see solver output. saving model to /tmp/fail.lp");
-          model_->writeToFile("/tmp/fail.lp");
-          retval = OPT_FAILED;
+        if (GetClock() - start_time > max_time_) {
+          LOG_INFO("time limit");
+          retval = OPT_TIME_LIMIT;
           goto cleanup;
         }
-        DblVec model_var_vals = model_->getVarValues(model_->getVars());
-
-        DblVec model_cost_vals = evaluateModelCosts(cost_models, model_var_vals);
-        DblVec model_cnt_viols = evaluateModelCntViols(cnt_models, model_var_vals);
 
-        // the n variables of the OptProb happen to be the first n variables in the Model
-        DblVec new_x(model_var_vals.begin(), model_var_vals.begin() + x_.size());
-
-        if (GetLogLevel() >= util::LevelDebug) {
-          DblVec model_cnt_viols2 = evaluateModelCosts(cnt_cost_models, model_var_vals);
-          LOG_DEBUG("SHOULD BE THE SAME: %.2f*%s ?= %s", merit_error_coeff_, CSTR(model_cnt_viols), CSTR(model_cnt_viols2));
+        // solve at trust_box_size_ and, speculatively, at the sizes the trust region would shrink to if the
+        // steps are rejected. the QPs only differ in the variable bounds
+        phase_start = GetClock();
+        vector<DblVec> model_var_vals, new_xs;
+        bool out_of_time = false;
+        for (double box_size = trust_box_size_; (int)model_var_vals.size() < num_trust_box_sizes_; box_size *= trust_shrink_ratio_) {
+          if (!model_var_vals.empty()) {
+            if (box_size < min_trust_box_size_) break;
+            // the points already solved are still evaluated, since one of them may be the best so far
+            if (GetClock() - start_time > max_time_) {
+              out_of_time = true;
+              break;
+            }
+            warm_primal = model_var_vals.back();
+            warm_dual = model_->getDualValues(model_->getCnts());
+          }
+          setTrustBoxConstraints(x_, box_size);
+          model_->setWarmStart(warm_primal, warm_dual);
+          CvxOptStatus status = model_->optimize();
+          ++results_.n_qp_solves;
+          ++record.n_qp_solves;
+          if (status != CVX_SOLVED) {
+            record.qp_time += GetClock() - phase_start;
+            LOG_ERROR("convex solver failed! set LOG_DEBUG_LEVEL=DEBUG to see solver output. saving model to /tmp/fail.lp");
+            model_->writeToFile("/tmp/fail.lp");
+            retval = OPT_FAILED;
+            goto cleanup;
+          }
+          model_var_vals.push_back(model_->getVarValues(model_->getVars()));
+          // the n variables of the OptProb happen to be the first n variables in the Model
+          new_xs.push_back(DblVec(model_var_vals.back().begin(), model_var_vals.back().begin() + x_.size()));
         }
-
-        DblVec new_cost_vals = evaluateCosts(prob_->getCosts(), new_x);
-        DblVec new_cnt_viols = evaluateConstraintViols(constraints, new_x);
-        ++results_.n_func_evals;
-
-        double old_merit = vecSum(results_.cost_vals) + merit_error_coeff_ * vecSum(results_.cnt_viols);
-        double model_merit = vecSum(model_cost_vals) + merit_error_coeff_ * vecSum(model_cnt_viols);
-        double new_merit = vecSum(new_cost_vals) + merit_error_coeff_ * vecSum(new_cnt_viols);
-        double approx_merit_improve = old_merit - model_merit;
-        double exact_merit_improve = old_merit - new_merit;
-        double merit_improve_ratio = exact_merit_improve / approx_merit_improve;
-
-        if (util::GetLogLevel() >= util::LevelInfo) {
-          LOG_INFO("");
-          printCostInfo(results_.cost_vals, model_cost_vals, new_cost_vals,
-                        results_.cnt_viols, model_cnt_viols, new_cnt_viols, cost_names,
-                        cnt_names, merit_error_coeff_);
-          printf("%15s | %10.3e | %10.3e | %10.3e | %10.3e\n", "TOTAL", old_merit, approx_merit_improve, exact_merit_improve, merit_improve_ratio);
+        record.qp_time += GetClock() - phase_start;
+
+        phase_start = GetClock();
+        vector<DblVec> all_cost_vals, all_cnt_viols;
+        evaluateAtPoints(prob_->getCosts(), constraints, new_xs, all_cost_vals, all_cnt_viols, pool_.get());
+        results_.n_func_evals += new_xs.size();
+        ++record.n_eval_rounds;
+        for (size_t k=0; k < new_xs.size(); ++k) updateBest(new_xs[k], all_cost_vals[k], all_cnt_viols[k]);
+        record.eval_time += GetClock() - phase_start;
+        if (out_of_time) {
+          LOG_INFO("time limit");
+          retval = OPT_TIME_LIMIT;
+          goto cleanup;
         }
 
-        //cout << "approx merit improve: " << approx_merit_improve << endl;
-
-        if (approx_merit_improve < -1e-4) {
-          LOG_ERROR("approximate merit function got worse (%.3e). (convexification is probably wrong to zeroth order)", approx_merit_improve);
-        }
-        if (approx_merit_improve < min_approx_improve_) {
-          LOG_INFO("converged because improvement was small (%.3e < %.3e)", approx_merit_improve, min_approx_improve_);
-          retval = OPT_CONVERGED;
-          goto penaltyadjustment;
-        }
-        if (approx_merit_improve / old_merit < min_approx_improve_frac_) {
-          LOG_INFO(
-              "converged because improvement ratio was small (%.3e < %.3e)",
-              approx_merit_improve/old_merit, min_approx_improve_frac_);
-          retval = OPT_CONVERGED;
-          goto penaltyadjustment;
-        } 
-        else if (exact_merit_improve < 0 || merit_improve_ratio < improve_ratio_threshold_) {
-          adjustTrustRegion(trust_shrink_ratio_);
-          LOG_INFO("shrunk trust region. new box size: %.4f",
-              trust_box_size_);
-        } else {
-          x_ = new_x;
-          results_.cost_vals = new_cost_vals;
-          results_.cnt_viols = new_cnt_viols;
-          adjustTrustRegion(trust_expand_ratio_);
-          LOG_INFO("expanded trust region. new box size: %.4f",trust_box_size_);
-          break;
+        // the steps are checked in the order they would have been tried one at a time
+        for (size_t k=0; k < new_xs.size(); ++k) {
+          DblVec model_cost_vals = evaluateModelCosts(cost_models, model_var_vals[k]);
+          DblVec model_cnt_viols = evaluateModelCntViols(cnt_models, model_var_vals[k]);
+          const DblVec& new_x = new_xs[k];
+
+          if (GetLogLevel() >= util::LevelDebug) {
+            DblVec model_cnt_viols2 = evaluateModelCosts(cnt_cost_models, model_var_vals[k]);
+            LOG_DEBUG("SHOULD BE THE SAME: %s*%s ?= %s", CSTR(cnt_coeffs_), CSTR(model_cnt_viols), CSTR(model_cnt_viols2));
+          }
+
+          const DblVec& new_cost_vals = all_cost_vals[k];
+          const DblVec& new_cnt_viols = all_cnt_viols[k];
+
+          double old_merit = merit(results_.cost_vals, results_.cnt_viols);
+          double model_merit = merit(model_cost_vals, model_cnt_viols);
+          double new_merit = merit(new_cost_vals, new_cnt_viols);
+          double approx_merit_improve = old_merit - model_merit;
+          double exact_merit_improve = old_merit - new_merit;
+          double merit_improve_ratio = exact_merit_improve / approx_merit_improve;
+
+          if (util::GetLogLevel() >= util::LevelInfo) {
+            LOG_INFO("");
+            printCostInfo(results_.cost_vals, model_cost_vals, new_cost_vals,
+                          results_.cnt_viols, model_cnt_viols, new_cnt_viols, cost_names,
+                          cnt_names, cnt_coeffs_);
+            printf("%15s | %10.3e | %10.3e | %10.3e | %10.3e\n", "TOTAL", old_merit, approx_merit_improve, exact_merit_improve, merit_improve_ratio);
+          }
+
+          //cout << "approx merit improve: " << approx_merit_improve << endl;
+
+          if (approx_merit_improve < -1e-4) {
+            LOG_ERROR("approximate merit function got worse (%.3e). (convexification is probably wrong to zeroth order)", approx_merit_improve);
+          }
+          if (approx_merit_improve < min_approx_improve_) {
+            LOG_INFO("converged because improvement was small (%.3e < %.3e)", approx_merit_improve, min_approx_improve_);
+            retval = OPT_CONVERGED;
+            goto penaltyadjustment;
+          }
+          if (approx_merit_improve / old_merit < min_approx_improve_frac_) {
+            LOG_INFO(
+                "converged because improvement ratio was small (%.3e < %.3e)",
+                approx_merit_improve/old_merit, min_approx_improve_frac_);
+            retval = OPT_CONVERGED;
+            goto penaltyadjustment;
+          } 
+          else if (exact_merit_improve < 0 || merit_improve_ratio < improve_ratio_threshold_) {
+            adjustTrustRegion(trust_shrink_ratio_);
+            LOG_INFO("shrunk trust region. new box size: %.4f",
+                trust_box_size_);
+          } else {
+            x_ = new_x;
+            results_.cost_vals = new_cost_vals;
+            results_.cnt_viols = new_cnt_viols;
+            adjustTrustRegion(trust_expand_ratio_);
+            LOG_INFO("expanded trust region. new box size: %.4f",trust_box_size_);
+            goto stepaccepted;
+          }
         }
+        // all rejected. the model only differs in the trust region, so the last solution is used
+        warm_primal = model_var_vals.back();
+        warm_dual = model_->getDualValues(model_->getCnts());
       }
+      stepaccepted:
 
       if (trust_box_size_ < min_trust_box_size_) {
         LOG_INFO("converged because trust region is tiny");
@@ -356,17 +632,18 @@ OptStatus BasicTrustRegionSQP::optimize() {
         LOG_INFO("iteration limit");
         retval = OPT_ITERATION_LIMIT;
         goto cleanup;
+      } else if (stopSQPLoop(iter)) {
+        goto penaltyadjustment;
       }
     }
 
     penaltyadjustment:
-    if (results_.cnt_viols.empty() || vecMax(results_.cnt_viols) < cnt_tolerance_) {
+    if (cntsSatisfied()) {
       if (results_.cnt_viols.size() > 0) LOG_INFO("woo-hoo! constraints are satisfied (to tolerance %.2e)", cnt_tolerance_);
       goto cleanup;
     }
     else {
-      merit_error_coeff_ *= merit_coeff_increase_ratio_;
-      LOG_INFO("not all constraints are satisfied. increasing penalties to %.4f", merit_error_coeff_);
+      if (!adjustPenalties(n_adjustments)) break;
       trust_box_size_ = fmax(trust_box_size_, min_trust_box_size_ * 5);
     }
 
@@ -380,6 +657,12 @@ OptStatus BasicTrustRegionSQP::optimize() {
   cleanup:
   assert(retval != INVALID && "should never happen");
   results_.status = retval;
+  results_.cnt_coeffs = cnt_coeffs_;
+  if (retval == OPT_TIME_LIMIT) {
+    x_ = results_.best_x;
+    results_.cost_vals = best_cost_vals_;
+    results_.cnt_viols = best_cnt_viols_;
+  }
   results_.total_cost = vecSum(results_.cost_vals);
   LOG_INFO("\n==================\n%s==================", CSTR(results_));
   callCallbacks(x_);
@@ -389,4 +672,41 @@ OptStatus BasicTrustRegionSQP::optimize() {
 }
 
 
+AugmentedLagrangianSQP::AugmentedLagrangianSQP() {
+  initALParameters();
+}
+AugmentedLagrangianSQP::AugmentedLagrangianSQP(OptProbPtr prob) : BasicTrustRegionSQP(prob) {
+  initALParameters();
+}
+
+void AugmentedLagrangianSQP::initALParameters() {
+  max_inner_iter_ = 5;
+  max_multiplier_updates_ = 20;
+  penalty_ = 100;
+  penalty_increase_ratio_ = 10;
+  viol_decrease_ratio_ = .25;
+  penalty_step_ = penalty_;
+  last_viol_ = INFINITY;
+}
+
+bool AugmentedLagrangianSQP::stopSQPLoop(int iter) {
+  return iter >= max_inner_iter_ && !cntsSatisfied();
+}
+
+bool AugmentedLagrangianSQP::adjustPenalties(int n_adjustments) {
+  if (n_adjustments == 0) {
+    penalty_step_ = penalty_;
+    last_viol_ = INFINITY;
+  }
+  double viol = vecSum(results_.cnt_viols);
+  if (viol > viol_decrease_ratio_ * last_viol_) penalty_step_ *= penalty_increase_ratio_;
+  last_viol_ = viol;
+  for (size_t i=0; i < cnt_coeffs_.size(); ++i) {
+    if (results_.cnt_viols[i] >= cnt_tolerance_) cnt_coeffs_[i] += penalty_step_ * results_.cnt_viols[i];
+  }
+  LOG_INFO("not all constraints are satisfied. new multipliers: %s", CSTR(cnt_coeffs_));
+  return n_adjustments + 1 < max_multiplier_updates_;
+}
+
+
 }
@@ -2,12 +2,15 @@
 #include <string>
 #include "modeling.hpp"
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 /*
  * Algorithms for non-convex, constrained optimization
  */
 
 namespace sco {
 
+class ThreadPool;
+
 using std::string;
 using std::vector;
 
@@ -15,12 +18,14 @@ using std::vector;
 enum OptStatus {
   OPT_CONVERGED,
   OPT_ITERATION_LIMIT, // hit iteration limit before convergence
+  OPT_TIME_LIMIT, // hit time limit before convergence
   OPT_FAILED,
   INVALID
 };
 static const char* OptStatus_strings[]  = {
   "CONVERGED",
   "ITERATION_LIMIT",
+  "TIME_LIMIT",
   "FAILED",
   "INVALID"
 };
@@ -29,6 +34,22 @@ inline string statusToString(OptStatus status) {
 }
 
 
+/** Where the time of one SQP iteration went (in seconds), and the size of its convex subproblem */
+struct IterationRecord {
+  double merit_coeff, trust_box_size; // at the start of the iteration. merit_coeff is the largest constraint coefficient
+  double callback_time,
+         convexify_time,
+         model_time, // removing the last convexification and adding the new one to the Model
+         qp_time, // all QP solves of the iteration, including the ones after which the trust region was shrunk
+         eval_time; // true and model costs and constraint violations at the QP solutions
+  DblVec cost_convexify_times, cnt_convexify_times; // per cost and constraint, in the order of the OptProb
+  int n_qp_solves;
+  int n_eval_rounds; // of the costs and constraints at QP solutions. less than n_qp_solves with num_trust_box_sizes_ > 1
+  int n_vars, n_cnts, n_nonzeros; // of the convex subproblem
+  IterationRecord() : merit_coeff(0), trust_box_size(0), callback_time(0), convexify_time(0), model_time(0), qp_time(0),
+      eval_time(0), n_qp_solves(0), n_eval_rounds(0), n_vars(0), n_cnts(0), n_nonzeros(0) {}
+};
+
 struct OptResults {
   DblVec x; // solution estimate
   OptStatus status;
@@ -36,6 +57,11 @@ struct OptResults {
   vector<double> cost_vals;
   DblVec cnt_viols;
   int n_func_evals, n_qp_solves;
+  vector<RecordStats> record_stats; // variable/constraint records created while building each convex subproblem
+  DblVec best_x; // point with the lowest merit evaluated so far. on OPT_TIME_LIMIT, x, cost_vals and cnt_viols are those of this point
+  bool best_feasible; // whether best_x satisfies the constraints (to cnt_tolerance_)
+  DblVec cnt_coeffs; // final penalty coefficient of each constraint in the merit function
+  vector<IterationRecord> iterations;
   void clear() {
     x.clear();
     status = INVALID;
@@ -43,6 +69,11 @@ struct OptResults {
     cnt_viols.clear();
     n_func_evals = 0;
     n_qp_solves = 0;
+    record_stats.clear();
+    best_x.clear();
+    best_feasible = false;
+    cnt_coeffs.clear();
+    iterations.clear();
   }
   OptResults() {clear();}
 };
@@ -87,13 +118,24 @@ public:
          trust_shrink_ratio_, // if improvement is less than improve_ratio_threshold, shrink trust region by this ratio
          trust_expand_ratio_, // see above
          cnt_tolerance_, // after convergence of penalty subproblem, if constraint violation is less than this, we're done
-         max_merit_coeff_increases_, // number of times that we jack up penalty coefficient
-         merit_coeff_increase_ratio_, // ratio that we increate coeff each time
-         max_time_ // not yet implemented
+         max_merit_coeff_increases_, // number of times that we jack up penalty coefficients
+         merit_coeff_increase_ratio_, // ratio that we increase the coefficients of the violated constraints each time
+         max_time_ // wall-clock limit in seconds since optimize() was called, checked before convexifying and before each QP solve
          ;
-  double merit_error_coeff_, // initial penalty coefficient
+  double merit_error_coeff_, // initial penalty coefficient of every constraint
          trust_box_size_ // current size of trust region (component-wise)
          ;
+  bool persistent_structure_; // reuse the auxiliary variables and rows of the convex subproblem across iterations (see Model::setPersistentStructure)
+  int num_threads_; // evaluate and convexify costs and constraints on this many threads. they must be thread-safe if > 1. doesn't change the result
+  /**
+   * Number of trust region sizes tried per round, each trust_shrink_ratio_ times the last, starting at trust_box_size_.
+   * The QPs are solved one after the other, and then the costs and constraints are evaluated at all the solutions
+   * in one parallel loop, so that a series of rejected steps takes one round of evaluations. The largest size whose
+   * step is accepted is used, which gives the same steps as trying one size at a time (up to the warm starts of the
+   * QP solver), at the price of the evaluations of the smaller steps if the first one is accepted. Only pays off with
+   * num_threads_ > 1
+   */
+  int num_trust_box_sizes_;
 
   BasicTrustRegionSQP();
   BasicTrustRegionSQP(OptProbPtr prob);
@@ -101,9 +143,52 @@ public:
   OptStatus optimize();
 protected:
   void adjustTrustRegion(double ratio);
-  void setTrustBoxConstraints(const vector<double>& x);
+  void setTrustBoxConstraints(const vector<double>& x, double trust_box_size);
   void initParameters();
+  void updateBest(const DblVec& x, const DblVec& cost_vals, const DblVec& cnt_viols);
+  /** costs + sum_i cnt_coeffs_[i] * cnt_viols[i] */
+  double merit(const DblVec& cost_vals, const DblVec& cnt_viols) const;
+  bool cntsSatisfied() const; // at results_.x, to cnt_tolerance_
+  /** Set cnt_coeffs_ before the first iteration */
+  virtual void initPenalties();
+  /**
+   * Called when the SQP loop stopped with constraints still violated. Adjust cnt_coeffs_, or return false to give up.
+   * n_adjustments is the number of earlier calls
+   */
+  virtual bool adjustPenalties(int n_adjustments);
+  /** Whether to stop the SQP loop after iteration iter and adjust the penalties before it converges */
+  virtual bool stopSQPLoop(int iter) {return false;}
   ModelPtr model_;
+  boost::shared_ptr<ThreadPool> pool_; // NULL unless num_threads_ > 1
+  DblVec best_cost_vals_, best_cnt_viols_; // at results_.best_x
+  DblVec cnt_coeffs_; // penalty coefficient of each constraint in the merit function
+};
+
+class AugmentedLagrangianSQP : public BasicTrustRegionSQP {
+  /*
+   * Method of multipliers for the l1 penalty of BasicTrustRegionSQP.
+   * The coefficient of each constraint in the merit function is an estimate of the size of its multiplier. It starts at
+   * merit_error_coeff_. Instead of running the SQP loop to convergence and then multiplying the coefficients of the
+   * violated constraints by merit_coeff_increase_ratio_, the SQP loop is stopped after max_inner_iter_ iterations if constraints are violated,
+   * and the coefficient of each violated constraint grows by penalty_step_ * violation. penalty_step_ starts at penalty_
+   * and only grows, by penalty_increase_ratio_, when the total violation didn't go down to viol_decrease_ratio_ times that
+   * of the last update.
+   * So the constraints that are almost satisfied get small increments.
+   */
+public:
+  double max_inner_iter_, // SQP iterations between multiplier updates, while constraints are violated
+         max_multiplier_updates_, // replaces max_merit_coeff_increases_
+         penalty_, // initial step of the multiplier update
+         penalty_increase_ratio_,
+         viol_decrease_ratio_;
+
+  AugmentedLagrangianSQP();
+  AugmentedLagrangianSQP(OptProbPtr prob);
+protected:
+  void initALParameters();
+  bool adjustPenalties(int n_adjustments);
+  bool stopSQPLoop(int iter);
+  double penalty_step_, last_viol_; // of the current run
 };
 
 
@@ -0,0 +1,58 @@
+#include "quad_csc.hpp"
+#include "index_expr.hpp"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace sco {
+
+void QuadCSC::update(const IndexQuadExpr& expr, int n) {
+  update(expr.inds1.data(), expr.inds2.data(), expr.coeffs.data(), expr.size(), n);
+}
+
+void QuadCSC::update(const int* inds1, const int* inds2, const double* coeffs, size_t nterms, int n) {
+  pattern_changed_ = !(n == n_ && nterms == term_inds1_.size()
+      && std::equal(inds1, inds1+nterms, term_inds1_.begin())
+      && std::equal(inds2, inds2+nterms, term_inds2_.begin()));
+  if (pattern_changed_) buildPattern(inds1, inds2, nterms, n);
+
+  std::fill(values_.begin(), values_.end(), 0.);
+  for (size_t k=0; k < nterms; ++k) values_[term2entry_[k]] += coeffs[k];
+}
+
+void QuadCSC::buildPattern(const int* inds1, const int* inds2, size_t nterms, int n) {
+  n_ = n;
+  term_inds1_.assign(inds1, inds1+nterms);
+  term_inds2_.assign(inds2, inds2+nterms);
+  ++n_pattern_builds_;
+
+  // sort the terms by (column, row) of the upper triangle
+  typedef pair<long long, int> KeyTerm;
+  vector<KeyTerm> keys(nterms);
+  for (size_t k=0; k < nterms; ++k) {
+    long long row = min(inds1[k], inds2[k]), col = max(inds1[k], inds2[k]);
+    keys[k] = KeyTerm(col*n + row, k);
+  }
+  sort(keys.begin(), keys.end());
+
+  term2entry_.resize(nterms);
+  col_ptr_.assign(n+1, 0);
+  row_ind_.clear();
+  col_ind_.clear();
+  long long last_key = -1;
+  for (size_t k=0; k < nterms; ++k) {
+    if (keys[k].first != last_key) {
+      last_key = keys[k].first;
+      int col = last_key / n, row = last_key % n;
+      row_ind_.push_back(row);
+      col_ind_.push_back(col);
+      ++col_ptr_[col+1];
+    }
+    term2entry_[keys[k].second] = row_ind_.size()-1;
+  }
+  for (int j=0; j < n; ++j) col_ptr_[j+1] += col_ptr_[j];
+  values_.resize(row_ind_.size());
+}
+
+}
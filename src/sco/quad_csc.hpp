@@ -0,0 +1,54 @@
+#pragma once
+#include "sco_fwd.hpp"
+#include "solver_interface.hpp"
+
+/**
+
+@file quad_csc.hpp
+
+Canonical sparse form of the quadratic part of an objective.
+
+The terms c*x_i*x_j of a QuadExpr or IndexQuadExpr come in any order, with duplicates and with either
+variable first. QuadCSC sums them into an upper triangular matrix H in compressed sparse column form,
+where H(i,j), i <= j, is the coefficient of x_i*x_j. The sparsity pattern and the position of every term
+in it are remembered, and as long as the terms refer to the same variables in the same order as in the
+previous call, only the values are scattered into the existing pattern. A backend can check
+patternChanged() to decide whether its symbolic analysis is still valid.
+
+*/
+
+namespace sco {
+
+class QuadCSC {
+public:
+  QuadCSC() : n_(0), pattern_changed_(false), n_pattern_builds_(0) {}
+
+  /** Canonicalize the terms coeffs[k]*x_{inds1[k]}*x_{inds2[k]} over n variables */
+  void update(const int* inds1, const int* inds2, const double* coeffs, size_t nterms, int n);
+  void update(const IndexQuadExpr& expr, int n);
+
+  int cols() const {return n_;}
+  int nonZeros() const {return row_ind_.size();}
+  const IntVec& colPtr() const {return col_ptr_;}
+  const IntVec& rowInd() const {return row_ind_;}
+  /** Column of each entry, i.e. the expanded colPtr(), for APIs that take triplets */
+  const IntVec& colInd() const {return col_ind_;}
+  const DblVec& values() const {return values_;}
+
+  /** Whether the last update() had to rebuild the pattern */
+  bool patternChanged() const {return pattern_changed_;}
+  int numPatternBuilds() const {return n_pattern_builds_;}
+
+private:
+  void buildPattern(const int* inds1, const int* inds2, size_t nterms, int n);
+
+  int n_;
+  IntVec term_inds1_, term_inds2_; // terms of the last update
+  IntVec term2entry_;
+  IntVec col_ptr_, row_ind_, col_ind_;
+  DblVec values_;
+  bool pattern_changed_;
+  int n_pattern_builds_;
+};
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <new>
+#include <boost/foreach.hpp>
+
+/**
+
+@file record_pool.hpp
+
+Storage for the VarRep and CntRep records of a Model.
+
+Records are carved out of fixed-size chunks, which are never freed or moved while the pool exists, so a
+Var or Cnt handle stays valid for as long as its record is alive. Destroyed records go to a free list and
+are handed out again by the next create(). The models destroy the records of removed variables and
+constraints together in update(), so the auxiliary records of one SQP iteration are recycled by the next
+one without touching the heap.
+
+*/
+
+namespace sco {
+
+template <class T, int ChunkSize=256>
+class RecordPool {
+public:
+  RecordPool() : n_created_(0), n_heap_allocs_(0) {}
+  /** Records that are still alive are not destroyed, so the owner has to destroy them first */
+  ~RecordPool() {
+    BOOST_FOREACH(char* chunk, chunks_) ::operator delete(chunk);
+  }
+
+  T* create(const T& init) {
+    if (free_.empty()) grow();
+    T* rec = free_.back();
+    free_.pop_back();
+    ++n_created_;
+    return new (rec) T(init);
+  }
+  void destroy(T* rec) {
+    rec->~T();
+    free_.push_back(rec);
+  }
+
+  /** Number of records created so far */
+  int numCreated() const {return n_created_;}
+  /** Number of chunks allocated so far */
+  int numHeapAllocations() const {return n_heap_allocs_;}
+
+private:
+  void grow() {
+    char* chunk = static_cast<char*>(::operator new(ChunkSize * sizeof(T)));
+    chunks_.push_back(chunk);
+    ++n_heap_allocs_;
+    // reversed, so that records are handed out in address order
+    T* recs = reinterpret_cast<T*>(chunk);
+    for (int i=ChunkSize-1; i >= 0; --i) free_.push_back(recs + i);
+  }
+
+  std::vector<char*> chunks_;
+  std::vector<T*> free_;
+  int n_created_, n_heap_allocs_;
+
+  RecordPool(const RecordPool&);
+  RecordPool& operator=(const RecordPool&);
+};
+
+}
@@ -0,0 +1,330 @@
+#include "recording_model.hpp"
+#include "utils/clock.hpp"
+#include "utils/logging.hpp"
+#include "macros.h"
+#include <boost/foreach.hpp>
+#include <iostream>
+#include <set>
+#include <sstream>
+using namespace std;
+
+namespace sco {
+
+static const int QP_RECORD_MAGIC = 0x51504353; // "SCPQ"
+static const int QP_RECORD_VERSION = 2; // 1 didn't have the solver
+
+template <class T>
+static void writeRaw(ostream& o, const T& x) {
+  o.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+template <class T>
+static void writeVec(ostream& o, const vector<T>& v) {
+  writeRaw<int>(o, v.size());
+  if (!v.empty()) o.write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(T));
+}
+template <class T>
+static void readRaw(istream& i, T& x) {
+  i.read(reinterpret_cast<char*>(&x), sizeof(T));
+  if (!i) PRINT_AND_THROW("truncated QP record");
+}
+template <class T>
+static void readVec(istream& i, vector<T>& v) {
+  int n;
+  readRaw(i, n);
+  if (n < 0) PRINT_AND_THROW("corrupt QP record");
+  v.resize(n);
+  if (n > 0) i.read(reinterpret_cast<char*>(&v[0]), n * sizeof(T));
+  if (!i) PRINT_AND_THROW("truncated QP record");
+}
+
+void writeQPRecord(ostream& o, const QPRecord& rec) {
+  writeRaw(o, QP_RECORD_MAGIC);
+  writeRaw(o, QP_RECORD_VERSION);
+  writeVec(o, rec.lbs);
+  writeVec(o, rec.ubs);
+  writeVec(o, rec.row_types);
+  writeVec(o, rec.row_ptr);
+  writeVec(o, rec.row_inds);
+  writeVec(o, rec.row_vals);
+  writeVec(o, rec.row_consts);
+  writeRaw(o, rec.obj_const);
+  writeVec(o, rec.lin_inds);
+  writeVec(o, rec.lin_vals);
+  writeVec(o, rec.quad_inds1);
+  writeVec(o, rec.quad_inds2);
+  writeVec(o, rec.quad_vals);
+  writeVec(o, rec.warm_primal);
+  writeVec(o, rec.warm_dual);
+  writeRaw(o, rec.solver);
+  writeRaw(o, rec.status);
+  writeRaw(o, rec.objective);
+  writeRaw(o, rec.solve_time);
+}
+
+bool readQPRecord(istream& i, QPRecord& rec) {
+  int magic, version;
+  i.read(reinterpret_cast<char*>(&magic), sizeof(int));
+  if (i.gcount() == 0 && i.eof()) return false;
+  if (!i || magic != QP_RECORD_MAGIC) PRINT_AND_THROW("not a QP record");
+  readRaw(i, version);
+  if (version != 1 && version != QP_RECORD_VERSION) PRINT_AND_THROW("unsupported QP record version " << version);
+  readVec(i, rec.lbs);
+  readVec(i, rec.ubs);
+  readVec(i, rec.row_types);
+  readVec(i, rec.row_ptr);
+  readVec(i, rec.row_inds);
+  readVec(i, rec.row_vals);
+  readVec(i, rec.row_consts);
+  readRaw(i, rec.obj_const);
+  readVec(i, rec.lin_inds);
+  readVec(i, rec.lin_vals);
+  readVec(i, rec.quad_inds1);
+  readVec(i, rec.quad_inds2);
+  readVec(i, rec.quad_vals);
+  readVec(i, rec.warm_primal);
+  readVec(i, rec.warm_dual);
+  rec.solver = -1;
+  if (version >= 2) readRaw(i, rec.solver);
+  readRaw(i, rec.status);
+  readRaw(i, rec.objective);
+  readRaw(i, rec.solve_time);
+  return true;
+}
+
+IndexQuadExpr QPRecord::objectiveExpr() const {
+  IndexQuadExpr out(obj_const);
+  out.reserve(lin_inds.size(), quad_inds1.size());
+  for (size_t k=0; k < lin_inds.size(); ++k) {
+    out.affexpr.inds.push_back(lin_inds[k]);
+    out.affexpr.coeffs.push_back(lin_vals[k]);
+  }
+  for (size_t k=0; k < quad_inds1.size(); ++k) {
+    out.inds1.push_back(quad_inds1[k]);
+    out.inds2.push_back(quad_inds2[k]);
+    out.coeffs.push_back(quad_vals[k]);
+  }
+  return out;
+}
+
+VarVector loadQPRecord(const QPRecord& rec, Model& model, CvxSolverID solver) {
+  VarVector vars(rec.numVars());
+  for (int j=0; j < rec.numVars(); ++j) {
+    stringstream name;
+    name << "x_" << j;
+    vars[j] = model.addVar(name.str(), rec.lbs[j], rec.ubs[j]);
+  }
+  model.update();
+  for (int i=0; i < rec.numRows(); ++i) {
+    AffExpr aff(rec.row_consts[i]);
+    for (int k=rec.row_ptr[i]; k < rec.row_ptr[i+1]; ++k) {
+      aff.coeffs.push_back(rec.row_vals[k]);
+      aff.vars.push_back(vars[rec.row_inds[k]]);
+    }
+    if (rec.row_types[i] == EQ) model.addEqCnt(aff, "");
+    else model.addIneqCnt(aff, "");
+  }
+  model.update();
+  model.setObjective(rec.objectiveExpr());
+  model.setWarmStart(rec.warm_primal, rec.solver == solver ? rec.warm_dual : DblVec());
+  return vars;
+}
+
+RecordingModel::RecordingModel(ModelPtr model, CvxSolverID solver, const string& fname) :
+    model_(model), solver_(solver), file_(fname.c_str(), ios::out | ios::binary | ios::app), n_recorded_(0), persistent_(false) {
+  if (!file_.good()) PRINT_AND_THROW("couldn't open " << fname << " for recording QPs");
+}
+
+Var RecordingModel::addVar(const string& name) {
+  return addVar(name, -INFINITY, INFINITY);
+}
+Var RecordingModel::addVar(const string& name, double lb, double ub) {
+  Var var = model_->addVar(name, lb, ub);
+  bounds_[var.var_rep] = make_pair(lb, ub);
+  return var;
+}
+
+Cnt RecordingModel::recordRow(const Cnt& cnt, const AffExpr& expr, ConstraintType type) {
+  Row& row = rows_[cnt.cnt_rep];
+  row.expr = expr;
+  row.type = type;
+  return cnt;
+}
+Cnt RecordingModel::addEqCnt(const AffExpr& expr, const string& name) {
+  return recordRow(model_->addEqCnt(expr, name), expr, EQ);
+}
+Cnt RecordingModel::addIneqCnt(const AffExpr& expr, const string& name) {
+  return recordRow(model_->addIneqCnt(expr, name), expr, INEQ);
+}
+Cnt RecordingModel::addIneqCnt(const QuadExpr&, const string&) {
+  PRINT_AND_THROW("quadratic constraints can't be recorded");
+}
+vector<Cnt> RecordingModel::addEqCnts(const AffExprBlock& block) {
+  vector<Cnt> out = model_->addEqCnts(block);
+  for (size_t i=0; i < out.size(); ++i) recordRow(out[i], block.row(i), EQ);
+  return out;
+}
+vector<Cnt> RecordingModel::addIneqCnts(const AffExprBlock& block) {
+  vector<Cnt> out = model_->addIneqCnts(block);
+  for (size_t i=0; i < out.size(); ++i) recordRow(out[i], block.row(i), INEQ);
+  return out;
+}
+
+// in persistent mode, the backend keeps removed variables fixed at zero and removed rows empty
+void RecordingModel::removeVar(const Var& var) {
+  if (persistent_) bounds_[var.var_rep] = make_pair(0., 0.);
+  model_->removeVar(var);
+}
+void RecordingModel::removeCnt(const Cnt& cnt) {
+  if (persistent_) rows_[cnt.cnt_rep].expr = AffExpr();
+  model_->removeCnt(cnt);
+}
+
+void RecordingModel::update() {
+  model_->update();
+  // forget the records the backend deleted, before their addresses can be reused, and drop the
+  // removed variables from the remaining rows like the backend does
+  VarVector vars = model_->getVars();
+  if (bounds_.size() > vars.size()) {
+    set<VarRep*> live;
+    BOOST_FOREACH(const Var& var, vars) live.insert(var.var_rep);
+    for (map<VarRep*, pair<double, double> >::iterator it = bounds_.begin(); it != bounds_.end();) {
+      if (live.count(it->first)) ++it;
+      else bounds_.erase(it++);
+    }
+    for (map<CntRep*, Row>::iterator it = rows_.begin(); it != rows_.end(); ++it) {
+      AffExpr& expr = it->second.expr;
+      size_t knew = 0;
+      for (size_t k=0; k < expr.size(); ++k) {
+        if (live.count(expr.vars[k].var_rep)) {
+          expr.vars[knew] = expr.vars[k];
+          expr.coeffs[knew] = expr.coeffs[k];
+          ++knew;
+        }
+      }
+      expr.vars.resize(knew);
+      expr.coeffs.resize(knew);
+    }
+  }
+  vector<Cnt> cnts = model_->getCnts();
+  if (rows_.size() > cnts.size()) {
+    set<CntRep*> live;
+    BOOST_FOREACH(const Cnt& cnt, cnts) live.insert(cnt.cnt_rep);
+    for (map<CntRep*, Row>::iterator it = rows_.begin(); it != rows_.end();) {
+      if (live.count(it->first)) ++it;
+      else rows_.erase(it++);
+    }
+  }
+}
+
+void RecordingModel::setPersistentStructure(bool persistent) {
+  persistent_ = persistent;
+  model_->setPersistentStructure(persistent);
+}
+void RecordingModel::setVarStages(const VarVector& vars, const IntVec& stages) {
+  model_->setVarStages(vars, stages);
+}
+
+void RecordingModel::setVarBounds(const Var& var, double lower, double upper) {
+  bounds_[var.var_rep] = make_pair(lower, upper);
+  model_->setVarBounds(var, lower, upper);
+}
+void RecordingModel::setVarBounds(const VarVector& vars, const vector<double>& lower, const vector<double>& upper) {
+  for (size_t i=0; i < vars.size(); ++i) bounds_[vars[i].var_rep] = make_pair(lower[i], upper[i]);
+  model_->setVarBounds(vars, lower, upper);
+}
+
+double RecordingModel::getVarValue(const Var& var) const {
+  return model_->getVarValue(var);
+}
+vector<double> RecordingModel::getVarValues(const VarVector& vars) const {
+  return model_->getVarValues(vars);
+}
+vector<double> RecordingModel::getDualValues(const vector<Cnt>& cnts) const {
+  return model_->getDualValues(cnts);
+}
+
+void RecordingModel::setWarmStart(const vector<double>& primal, const vector<double>& dual) {
+  warm_primal_ = primal;
+  warm_dual_ = dual;
+  model_->setWarmStart(primal, dual);
+}
+
+CvxOptStatus RecordingModel::optimize() {
+  QPRecord rec;
+  VarVector vars = model_->getVars();
+  rec.lbs.resize(vars.size());
+  rec.ubs.resize(vars.size());
+  for (size_t j=0; j < vars.size(); ++j) {
+    map<VarRep*, pair<double, double> >::const_iterator it = bounds_.find(vars[j].var_rep);
+    assert(it != bounds_.end());
+    rec.lbs[j] = it->second.first;
+    rec.ubs[j] = it->second.second;
+  }
+  vector<Cnt> cnts = model_->getCnts();
+  rec.row_types.reserve(cnts.size());
+  rec.row_ptr.reserve(cnts.size()+1);
+  rec.row_consts.reserve(cnts.size());
+  BOOST_FOREACH(const Cnt& cnt, cnts) {
+    map<CntRep*, Row>::const_iterator it = rows_.find(cnt.cnt_rep);
+    assert(it != rows_.end());
+    const AffExpr& expr = it->second.expr;
+    for (size_t k=0; k < expr.size(); ++k) {
+      rec.row_inds.push_back(expr.vars[k].var_rep->index);
+      rec.row_vals.push_back(expr.coeffs[k]);
+    }
+    rec.row_types.push_back(it->second.type);
+    rec.row_ptr.push_back(rec.row_inds.size());
+    rec.row_consts.push_back(expr.constant);
+  }
+  rec.obj_const = objective_.affexpr.constant;
+  rec.lin_inds.assign(objective_.affexpr.inds.begin(), objective_.affexpr.inds.end());
+  rec.lin_vals.assign(objective_.affexpr.coeffs.begin(), objective_.affexpr.coeffs.end());
+  rec.quad_inds1.assign(objective_.inds1.begin(), objective_.inds1.end());
+  rec.quad_inds2.assign(objective_.inds2.begin(), objective_.inds2.end());
+  rec.quad_vals.assign(objective_.coeffs.begin(), objective_.coeffs.end());
+  // a warm start only applies to the next solve
+  rec.warm_primal.swap(warm_primal_);
+  rec.warm_dual.swap(warm_dual_);
+  rec.solver = solver_;
+
+  double tstart = util::GetClock();
+  CvxOptStatus status = model_->optimize();
+  rec.solve_time = util::GetClock() - tstart;
+  rec.status = status;
+  if (status == CVX_SOLVED) rec.objective = objective_.value(model_->getVarValues(vars));
+
+  writeQPRecord(file_, rec);
+  file_.flush();
+  ++n_recorded_;
+  return status;
+}
+
+void RecordingModel::setObjective(const AffExpr& expr) {
+  setObjective(QuadExpr(expr));
+}
+void RecordingModel::setObjective(const QuadExpr& expr) {
+  objective_ = IndexQuadExpr(expr);
+  model_->setObjective(expr);
+}
+void RecordingModel::setObjective(const IndexQuadExpr& expr) {
+  objective_ = expr;
+  model_->setObjective(expr);
+}
+void RecordingModel::writeToFile(const string& fname) {
+  model_->writeToFile(fname);
+}
+
+VarVector RecordingModel::getVars() const {
+  return model_->getVars();
+}
+vector<Cnt> RecordingModel::getCnts() const {
+  return model_->getCnts();
+}
+RecordStats RecordingModel::getRecordStats() const {
+  return model_->getRecordStats();
+}
+int RecordingModel::getNumNonzeros() const {
+  return model_->getNumNonzeros();
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "sco_fwd.hpp"
+#include "solver_interface.hpp"
+#include "index_expr.hpp"
+#include <cmath>
+#include <fstream>
+#include <iosfwd>
+#include <map>
+
+/**
+
+@file recording_model.hpp
+
+Capture of the convex subproblems solved by the optimizer, for benchmarking solvers offline.
+
+RecordingModel wraps the Model of another backend and forwards every call to it. Each call to optimize()
+also appends a QPRecord to a binary file: the variable bounds, the constraint rows, the objective and the
+warm start that were passed to the backend, followed by the status, objective value and solve time that
+came back. Records are self-contained, so a recording can be replayed against any backend without the
+problem that produced it (see bin/sco-replay-qps). Only what goes through the Model interface is recorded:
+a replay starts from a fresh backend, without state a backend carries between solves, like the step size
+and bound multipliers of ADMMModel, so it may take longer than the recorded solve.
+
+Setting the environment variable TRAJOPT_RECORD_QPS=<file> makes createModel() return a RecordingModel
+that appends to <file>.
+
+*/
+
+namespace sco {
+
+/** One convex subproblem. Variables are numbered by their position in Model::getVars() */
+struct QPRecord {
+  DblVec lbs, ubs;
+  // constraint rows in compressed sparse row form: sum_k row_vals[k] x[row_inds[k]] + row_consts[i] (== or <=) 0
+  IntVec row_types; // ConstraintType
+  IntVec row_ptr, row_inds;
+  DblVec row_vals, row_consts;
+  // objective: obj_const + sum lin_vals[k] x[lin_inds[k]] + sum quad_vals[k] x[quad_inds1[k]] x[quad_inds2[k]]
+  double obj_const;
+  IntVec lin_inds;
+  DblVec lin_vals;
+  IntVec quad_inds1, quad_inds2;
+  DblVec quad_vals;
+  DblVec warm_primal, warm_dual;
+  int solver; // CvxSolverID of the recorded backend, which the sign of warm_dual depends on. -1 if unknown
+  // result of the recorded solve
+  int status; // CvxOptStatus
+  double objective, solve_time;
+
+  QPRecord() : row_ptr(1, 0), obj_const(0), solver(-1), status(CVX_FAILED), objective(NAN), solve_time(0) {}
+  int numVars() const {return lbs.size();}
+  int numRows() const {return row_types.size();}
+  IndexQuadExpr objectiveExpr() const;
+};
+
+void writeQPRecord(std::ostream& o, const QPRecord& rec);
+/** Returns false at the end of the stream. Throws if the data is not a QPRecord */
+bool readQPRecord(std::istream& i, QPRecord& rec);
+/**
+Add the variables, constraints, objective and warm start of rec to an empty model of the given solver. Returns the
+variables. The duals of the warm start are dropped if rec was recorded with another solver, since the backends
+don't agree on their sign
+*/
+VarVector loadQPRecord(const QPRecord& rec, Model& model, CvxSolverID solver);
+
+class RecordingModel : public Model {
+public:
+  /** Appends to the file fname. solver is the backend of model */
+  RecordingModel(ModelPtr model, CvxSolverID solver, const string& fname);
+
+  Var addVar(const string& name);
+  Var addVar(const string& name, double lb, double ub);
+  Cnt addEqCnt(const AffExpr&, const string& name);
+  Cnt addIneqCnt(const AffExpr&, const string& name);
+  /** Quadratic constraints can't be recorded, so this throws */
+  Cnt addIneqCnt(const QuadExpr&, const string& name);
+  vector<Cnt> addEqCnts(const AffExprBlock&);
+  vector<Cnt> addIneqCnts(const AffExprBlock&);
+
+  void removeVar(const Var& var);
+  void removeCnt(const Cnt& cnt);
+
+  void update();
+  void setPersistentStructure(bool persistent);
+  void setVarStages(const VarVector& vars, const IntVec& stages);
+  void setVarBounds(const Var& var, double lower, double upper);
+  void setVarBounds(const VarVector& vars, const vector<double>& lower, const vector<double>& upper);
+  double getVarValue(const Var& var) const;
+  vector<double> getVarValues(const VarVector& vars) const;
+  vector<double> getDualValues(const vector<Cnt>& cnts) const;
+  void setWarmStart(const vector<double>& primal, const vector<double>& dual);
+  CvxOptStatus optimize();
+
+  void setObjective(const AffExpr&);
+  void setObjective(const QuadExpr&);
+  void setObjective(const IndexQuadExpr&);
+  void writeToFile(const string& fname);
+
+  VarVector getVars() const;
+  vector<Cnt> getCnts() const;
+  RecordStats getRecordStats() const;
+  int getNumNonzeros() const;
+
+  ModelPtr inner() const {return model_;}
+  int numRecorded() const {return n_recorded_;}
+
+private:
+  Cnt recordRow(const Cnt& cnt, const AffExpr& expr, ConstraintType type);
+
+  ModelPtr model_;
+  CvxSolverID solver_;
+  std::ofstream file_;
+  int n_recorded_;
+  bool persistent_;
+
+  struct Row {
+    AffExpr expr;
+    ConstraintType type;
+  };
+  // what the backend was told, since it can't be read back
+  std::map<VarRep*, std::pair<double, double> > bounds_;
+  std::map<CntRep*, Row> rows_;
+  IndexQuadExpr objective_;
+  DblVec warm_primal_, warm_dual_;
+
+  RecordingModel(const RecordingModel&);
+  RecordingModel& operator=(const RecordingModel&);
+};
+
+}
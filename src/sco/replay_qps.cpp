@@ -0,0 +1,85 @@
+#include "recording_model.hpp"
+#include "solver_interface.hpp"
+#include "utils/clock.hpp"
+#include "utils/config.hpp"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+using namespace sco;
+using namespace util;
+using namespace std;
+
+/**
+Replays the QPs recorded with TRAJOPT_RECORD_QPS against a solver, and prints the solve time and the objective
+of each one next to the recorded ones. The QPs are warm started like the recorded ones, except for the multipliers
+when the recording was made with another solver.
+
+  sco-replay-qps --file=qps.bin --solver=CUSTOM
+*/
+
+static const char* statusName(int status) {
+  switch (status) {
+  case CVX_SOLVED: return "SOLVED";
+  case CVX_INFEASIBLE: return "INFEASIBLE";
+  default: return "FAILED";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  string fname, solver_name = "CUSTOM";
+  bool verbose = true;
+  {
+    Config config;
+    config.add(new Parameter<string>("file", &fname, "recording written with TRAJOPT_RECORD_QPS"));
+    config.add(new Parameter<string>("solver", &solver_name, "GUROBI or CUSTOM"));
+    config.add(new Parameter<bool>("verbose", &verbose, "print a line per QP"));
+    CommandParser parser(config);
+    parser.read(argc, argv);
+  }
+  CvxSolverID solver;
+  if (solver_name == "GUROBI") solver = SOLVER_GUROBI;
+  else if (solver_name == "CUSTOM") solver = SOLVER_CUSTOM;
+  else {
+    cerr << "unknown solver " << solver_name << ". valid values: GUROBI CUSTOM" << endl;
+    return 1;
+  }
+  ifstream file(fname.c_str(), ios::in | ios::binary);
+  if (!file.good()) {
+    cerr << "couldn't open " << fname << endl;
+    return 1;
+  }
+
+  if (verbose) printf("%5s %7s %7s %10s %10s %10s %10s %11s %11s %10s\n", "qp", "vars", "rows", "status",
+      "replayed", "time", "replayed", "objective", "replayed", "delta");
+  int n_qps = 0, n_status_changed = 0;
+  double total_time = 0, total_replay_time = 0, total_load_time = 0, max_rel_delta = 0;
+  QPRecord rec;
+  while (readQPRecord(file, rec)) {
+    // a fresh model per QP, since the recorded ones share no structure once serialized
+    ModelPtr model = createModel(solver);
+    double tstart = GetClock();
+    VarVector vars = loadQPRecord(rec, *model, solver);
+    double load_time = GetClock() - tstart;
+    tstart = GetClock();
+    CvxOptStatus status = model->optimize();
+    double replay_time = GetClock() - tstart;
+    double objective = (status == CVX_SOLVED) ? rec.objectiveExpr().value(model->getVarValues(vars)) : NAN;
+    double delta = objective - rec.objective;
+    if (status == CVX_SOLVED && rec.status == CVX_SOLVED) {
+      max_rel_delta = std::max(max_rel_delta, fabs(delta) / std::max(1., fabs(rec.objective)));
+    }
+    if (status != rec.status) ++n_status_changed;
+    if (verbose) printf("%5i %7i %7i %10s %10s %10.4f %10.4f %11.5g %11.5g %10.3g\n", n_qps, rec.numVars(), rec.numRows(),
+        statusName(rec.status), statusName(status), rec.solve_time, replay_time, rec.objective, objective, delta);
+    total_time += rec.solve_time;
+    total_replay_time += replay_time;
+    total_load_time += load_time;
+    ++n_qps;
+  }
+
+  printf("%i QPs. recorded solve time %.4f s, replayed %.4f s (plus %.4f s to build the models)\n",
+      n_qps, total_time, total_replay_time, total_load_time);
+  printf("status changed for %i QPs. max relative objective difference %.3g\n", n_status_changed, max_rel_delta);
+  return 0;
+}
@@ -4,6 +4,10 @@
 namespace sco {
 class GurobiModel;
 typedef boost::shared_ptr<GurobiModel> GurobiModelPtr;
+class ADMMModel;
+typedef boost::shared_ptr<ADMMModel> ADMMModelPtr;
+class RecordingModel;
+typedef boost::shared_ptr<RecordingModel> RecordingModelPtr;
 class ConvexObjective;
 typedef boost::shared_ptr<ConvexObjective> ConvexObjectivePtr;
 class ConvexConstraints;
@@ -40,4 +44,10 @@ class AffExpr;
 typedef boost::shared_ptr<AffExpr> AffExprPtr;
 class QuadExpr;
 typedef boost::shared_ptr<QuadExpr> QuadExprPtr;
+class IndexAffExpr;
+typedef boost::shared_ptr<IndexAffExpr> IndexAffExprPtr;
+class IndexQuadExpr;
+typedef boost::shared_ptr<IndexQuadExpr> IndexQuadExprPtr;
+class AffExprBlock;
+typedef boost::shared_ptr<AffExprBlock> AffExprBlockPtr;
 }
\ No newline at end of file
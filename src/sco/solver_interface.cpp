@@ -1,6 +1,15 @@
 #include "solver_interface.hpp"
+#include "index_expr.hpp"
+#include "recording_model.hpp"
+#include "utils/logging.hpp"
 #include <iostream>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
 #include <boost/foreach.hpp>
+#include <algorithm>
+#include <climits>
+#include "macros.h"
 using namespace std;
 
 namespace sco {
@@ -33,6 +42,72 @@ double QuadExpr::value(const double* x) const {
   }
   return out;
 }
+AffExprBlock::AffExprBlock(const vector<AffExpr>& exprs) : row_ptr(1, 0) {
+  size_t nnz = 0;
+  BOOST_FOREACH(const AffExpr& expr, exprs) nnz += expr.size();
+  row_ptr.reserve(exprs.size()+1);
+  coeffs.reserve(nnz);
+  vars.reserve(nnz);
+  constants.reserve(exprs.size());
+  BOOST_FOREACH(const AffExpr& expr, exprs) append(expr);
+}
+void AffExprBlock::append(const AffExpr& expr) {
+  coeffs.insert(coeffs.end(), expr.coeffs.begin(), expr.coeffs.end());
+  vars.insert(vars.end(), expr.vars.begin(), expr.vars.end());
+  constants.push_back(expr.constant);
+  row_ptr.push_back(vars.size());
+}
+AffExpr AffExprBlock::row(int i) const {
+  AffExpr out(constants[i]);
+  out.coeffs.assign(coeffs.begin() + row_ptr[i], coeffs.begin() + row_ptr[i+1]);
+  out.vars.assign(vars.begin() + row_ptr[i], vars.begin() + row_ptr[i+1]);
+  return out;
+}
+
+void RowCompressor::compress(const AffExprBlock& block, IntVec& row_ptr, IntVec& inds, DblVec& vals) {
+  int nrows = block.rows();
+  row_ptr.resize(nrows+1);
+  row_ptr[0] = 0;
+  inds.clear();
+  vals.clear();
+  inds.reserve(block.vars.size());
+  vals.reserve(block.vars.size());
+  for (int i=0; i < nrows; ++i) {
+    if (stamp_ == INT_MAX) {
+      std::fill(mark_.begin(), mark_.end(), 0);
+      stamp_ = 0;
+    }
+    ++stamp_;
+    // scatter into the dense array, remembering the distinct indices
+    int start = inds.size();
+    for (int k=block.row_ptr[i]; k < block.row_ptr[i+1]; ++k) {
+      int ind = block.vars[k].var_rep->index;
+      if (ind >= (int)work_.size()) {
+        work_.resize(ind+1, 0);
+        mark_.resize(ind+1, 0);
+      }
+      if (mark_[ind] != stamp_) {
+        mark_[ind] = stamp_;
+        work_[ind] = 0;
+        inds.push_back(ind);
+      }
+      work_[ind] += block.coeffs[k];
+    }
+    // gather in index order
+    std::sort(inds.begin() + start, inds.end());
+    int end = start;
+    for (size_t k=start; k < inds.size(); ++k) {
+      double val = work_[inds[k]];
+      if (val != 0) {
+        inds[end++] = inds[k];
+        vals.push_back(val);
+      }
+    }
+    inds.resize(end);
+    row_ptr[i+1] = end;
+  }
+}
+
 //double QuadExpr::value() const {
 //  double out = affexpr.value();
 //  for (size_t i=0; i < size(); ++i) {
@@ -46,6 +121,19 @@ Var Model::addVar(const string& name, double lb, double ub) {
   setVarBounds(v, lb, ub);
   return v;
 }
+vector<Cnt> Model::addEqCnts(const AffExprBlock& block) {
+  vector<Cnt> out(block.rows());
+  for (int i=0; i < block.rows(); ++i) out[i] = addEqCnt(block.row(i), "");
+  return out;
+}
+vector<Cnt> Model::addIneqCnts(const AffExprBlock& block) {
+  vector<Cnt> out(block.rows());
+  for (int i=0; i < block.rows(); ++i) out[i] = addIneqCnt(block.row(i), "");
+  return out;
+}
+void Model::setObjective(const IndexQuadExpr& expr) {
+  setObjective(toQuadExpr(expr, getVars()));
+}
 void Model::removeVars(const VarVector& vars) {
   BOOST_FOREACH(const Var& var, vars) removeVar(var);
 }
@@ -91,12 +179,53 @@ ostream& operator<<(ostream& o, const QuadExpr& e) {
 }
 
 
-ModelPtr createModel(CvxSolverID solver) {
-  extern ModelPtr createGurobiModel();
-  return createGurobiModel();
+vector<CvxSolverID> availableSolvers() {
+  vector<CvxSolverID> out;
+#ifdef HAVE_GUROBI
+  out.push_back(SOLVER_GUROBI);
+#endif
+  out.push_back(SOLVER_CUSTOM);
+  return out;
 }
 
+CvxSolverID defaultSolver() {
+  char* solver_env = getenv("TRAJOPT_CONVEX_SOLVER");
+  if (solver_env == NULL) return availableSolvers()[0];
+  string solver_str(solver_env);
+  if (solver_str == "GUROBI") return SOLVER_GUROBI;
+  else if (solver_str == "CUSTOM") return SOLVER_CUSTOM;
+  else PRINT_AND_THROW("Invalid value for environment variable TRAJOPT_CONVEX_SOLVER: " << solver_str << ". Valid values: GUROBI CUSTOM");
+}
 
+static ModelPtr createBackend(CvxSolverID solver) {
+#ifdef HAVE_GUROBI
+  extern ModelPtr createGurobiModel();
+#endif
+  extern ModelPtr createADMMModel();
+  switch (solver) {
+  case SOLVER_GUROBI:
+#ifdef HAVE_GUROBI
+    return createGurobiModel();
+#else
+    PRINT_AND_THROW("sco was built without Gurobi. use SOLVER_CUSTOM instead");
+#endif
+  case SOLVER_CUSTOM:
+    return createADMMModel();
+  default:
+    PRINT_AND_THROW("invalid solver id " << solver);
+  }
+}
 
+ModelPtr createModel(CvxSolverID solver) {
+  ModelPtr model = createBackend(solver);
+  char* record_env = getenv("TRAJOPT_RECORD_QPS");
+  if (record_env != NULL && record_env[0] != '\0') {
+    LOG_INFO("recording QPs to %s", record_env);
+    model.reset(new RecordingModel(model, solver, record_env));
+  }
+  return model;
 }
 
+
+
+}
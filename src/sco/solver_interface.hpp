@@ -39,6 +39,14 @@ typedef vector<AffExpr> AffExprVector;
 typedef vector<QuadExpr> QuadExprVector;
 typedef util::BasicArray<QuadExpr> QuadExprArray;
 
+/** Bookkeeping of the VarRep/CntRep records of a Model (see record_pool.hpp) */
+struct RecordStats {
+  int n_created, // records created, not counting variables and constraints reused in persistent mode
+      n_heap_allocs; // heap allocations made for them
+  RecordStats() : n_created(0), n_heap_allocs(0) {}
+  RecordStats(int n_created, int n_heap_allocs) : n_created(n_created), n_heap_allocs(n_heap_allocs) {}
+};
+
 /** @brief Convex optimization problem
  
 Gotchas:
@@ -53,6 +61,9 @@ public:
   virtual Cnt addEqCnt(const AffExpr&, const string& name)=0; // expr == 0
   virtual Cnt addIneqCnt(const AffExpr&, const string& name)=0; // expr <= 0
   virtual Cnt addIneqCnt(const QuadExpr&, const string& name)=0; // expr <= 0
+  /** Add every row of the block as a constraint row == 0 (or row <= 0). Returns the constraints in row order */
+  virtual vector<Cnt> addEqCnts(const AffExprBlock&);
+  virtual vector<Cnt> addIneqCnts(const AffExprBlock&);
 
   virtual void removeVar(const Var& var) = 0;
   virtual void removeCnt(const Cnt& cnt) = 0;
@@ -60,17 +71,48 @@ public:
   virtual void removeCnts(const vector<Cnt>& cnts);
 
   virtual void update() = 0; // call after adding/deleting stuff
+  /**
+   * In persistent mode, removed variables and constraints are kept in the backend and handed out again,
+   * in the order they were removed, by the next addVar/addEqCnt/addIneqCnt, which then only push the new
+   * bounds, coefficients and right hand side. A removed variable is fixed to zero and a removed constraint
+   * is emptied until it's reused. This keeps the number of rows and columns and the variable indices fixed
+   * when the same convex subproblem structure is rebuilt every iteration.
+   * Turning it off deletes the parked variables and constraints (call update() afterwards).
+   */
+  virtual void setPersistentStructure(bool persistent)=0;
+  /**
+   * Hint that the problem is a trajectory: vars[i] belongs to time step stages[i], and constraints and
+   * objective terms only couple nearby steps. Backends that can exploit the banded structure use it to order
+   * the factorization by time step. Variables without a stage (-1, or added later) are placed next to the
+   * steps they are coupled with. Ignored by default.
+   */
+  virtual void setVarStages(const VarVector& vars, const IntVec& stages) {}
   virtual void setVarBounds(const Var& var, double lower, double upper)=0;
   virtual void setVarBounds(const VarVector& vars, const vector<double>& lower, const vector<double>& upper);
   virtual double getVarValue(const Var& var) const=0;
   virtual vector<double> getVarValues(const VarVector& vars) const;
+  /** Dual values (multipliers) of the constraints after optimize(), in the sign convention of the backend */
+  virtual vector<double> getDualValues(const vector<Cnt>& cnts) const=0;
+  /**
+   * Initial guess for the next call to optimize().
+   * primal[i] is the value of the i-th variable of getVars() and dual[i] is the multiplier of the i-th
+   * constraint of getCnts(), as returned by getDualValues(). Either vector can be shorter than the number of
+   * variables/constraints, e.g. empty, in which case the rest get no initial guess.
+   */
+  virtual void setWarmStart(const vector<double>& primal, const vector<double>& dual)=0;
   virtual CvxOptStatus optimize()=0;
 
   virtual void setObjective(const AffExpr&)=0;
   virtual void setObjective(const QuadExpr&)=0;
+  /** Objective in terms of variable indices (see index_expr.hpp). By default it's converted with getVars() */
+  virtual void setObjective(const IndexQuadExpr&);
   virtual void writeToFile(const string& fname)=0;
 
   virtual VarVector getVars() const=0;
+  virtual vector<Cnt> getCnts() const=0;
+  virtual RecordStats getRecordStats() const=0;
+  /** Number of nonzero coefficients in the constraint rows, as of the last update() */
+  virtual int getNumNonzeros() const=0;
 
   virtual ~Model() {}
 
@@ -123,6 +165,37 @@ struct AffExpr { // affine expression
   double value(const vector<double>& x) const;
 };
 
+/**
+Affine expressions stored in compressed sparse row form. Row i is
+  sum_{k=row_ptr[i]}^{row_ptr[i+1]-1} coeffs[k]*vars[k] + constants[i]
+and may contain the same variable several times.
+*/
+struct AffExprBlock {
+  IntVec row_ptr;
+  vector<double> coeffs;
+  vector<Var> vars;
+  vector<double> constants;
+  AffExprBlock() : row_ptr(1, 0) {}
+  explicit AffExprBlock(const vector<AffExpr>& exprs);
+  void append(const AffExpr& expr);
+  int rows() const {return constants.size();}
+  AffExpr row(int i) const;
+};
+
+/**
+Turns the rows of an AffExprBlock into variable indices with duplicates summed, zeros dropped and indices sorted
+within each row. The coefficients are accumulated in a dense array over the variables, which is kept between calls.
+*/
+class RowCompressor {
+public:
+  RowCompressor() : stamp_(0) {}
+  void compress(const AffExprBlock& block, IntVec& row_ptr, IntVec& inds, DblVec& vals);
+private:
+  DblVec work_;
+  IntVec mark_; // mark_[i] == stamp_ if variable i appeared in the current row
+  int stamp_;
+};
+
 struct QuadExpr {
   AffExpr affexpr;
   vector<double> coeffs;
@@ -146,8 +219,13 @@ ostream& operator<<(ostream&, const QuadExpr&);
 
 enum CvxSolverID {
   SOLVER_GUROBI,
-  SOLVER_CUSTOM
+  SOLVER_CUSTOM // built-in sparse ADMM solver, see admm_interface.hpp
 };
+/** Solvers that sco was compiled with, in order of preference */
+vector<CvxSolverID> availableSolvers();
+/** Solver chosen by environment variable TRAJOPT_CONVEX_SOLVER=GUROBI|CUSTOM, otherwise the first available one */
+CvxSolverID defaultSolver();
+/** If environment variable TRAJOPT_RECORD_QPS is set, the model records its QPs to that file (see recording_model.hpp) */
 ModelPtr createModel(CvxSolverID);
 
 }
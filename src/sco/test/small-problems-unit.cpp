@@ -2,11 +2,14 @@
 #include "sco/solver_interface.hpp"
 #include "sco/expr_op_overloads.hpp"
 #include "sco/modeling_utils.hpp"
+#include "sco/autodiff.hpp"
+#include "sco/thread_pool.hpp"
 #include "sco/sco_common.hpp"
 #include "utils/logging.hpp"
 #include <cmath>
 #include <boost/assign/list_of.hpp>
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <Eigen/Dense>
@@ -20,8 +23,8 @@ using namespace Eigen;
 
 
 
-void setupProblem(OptProbPtr& probptr, size_t nvars) {
-  probptr.reset(new OptProb());
+void setupProblem(OptProbPtr& probptr, size_t nvars, CvxSolverID solver) {
+  probptr.reset(new OptProb(solver));
   vector<string> var_names;
   for (size_t i=0; i < nvars; ++i) {
     var_names.push_back( (boost::format("x_%i")%i).str() );
@@ -40,10 +43,10 @@ void expectAllNear(const DblVec& x, const DblVec& y, double abstol) {
 double f_QuadraticSeparable(const VectorXd& x) {
   return x(0)*x(0) + sq(x(1) - 1) + sq(x(2)-2);
 }
-TEST(SQP, QuadraticSeparable)  {
+void testQuadraticSeparable(CvxSolverID solver_id)  {
   // if the problem is exactly a QP, it should be solved in one iteration
   OptProbPtr prob;
-  setupProblem(prob, 3);
+  setupProblem(prob, 3, solver_id);
   prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_QuadraticSeparable), prob->getVars(), "f")));
   BasicTrustRegionSQP solver(prob);
   solver.trust_box_size_ = 100;
@@ -54,12 +57,15 @@ TEST(SQP, QuadraticSeparable)  {
   expectAllNear(solver.x(), list_of(0)(1)(2), 1e-3);
   // todo: checks on number of iterations and function evaluates
 }
+TEST(SQP, QuadraticSeparable)  {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testQuadraticSeparable(solver_id);
+}
 double f_QuadraticNonseparable(const VectorXd& x) {
   return sq(x(0) - x(1) + 3*x(2)) + sq(x(0)-1) + sq(x(2) - 2);
 }
-TEST(SQP, QuadraticNonseparable)  {
+void testQuadraticNonseparable(CvxSolverID solver_id)  {
   OptProbPtr prob;
-  setupProblem(prob, 3);
+  setupProblem(prob, 3, solver_id);
   prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_QuadraticNonseparable), prob->getVars(), "f",  true)));
   BasicTrustRegionSQP solver(prob);
   solver.trust_box_size_ = 100;
@@ -72,14 +78,107 @@ TEST(SQP, QuadraticNonseparable)  {
   expectAllNear(solver.x(), list_of(1)(7)(2), .01);
   // todo: checks on number of iterations and function evaluates
 }
+TEST(SQP, QuadraticNonseparable)  {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testQuadraticNonseparable(solver_id);
+}
 
+// sum_i (x_i - i)^2, which counts its convexifications
+class ConstantQuadraticCost : public Cost {
+public:
+  ConstantQuadraticCost(const VarVector& vars) : Cost("constant"), n_convex(0) {
+    for (size_t i=0; i < vars.size(); ++i) exprInc(expr_, exprSquare(exprSub(AffExpr(vars[i]), (double)i)));
+  }
+  double value(const vector<double>& x) {return expr_.value(x);}
+  ConvexObjectivePtr convex(const vector<double>& x, Model* model) {
+    ++n_convex;
+    ConvexObjectivePtr out(new ConvexObjective(model));
+    out->addQuadExpr(expr_);
+    return out;
+  }
+  bool isConvexConstant() const {return true;}
+  int n_convex;
+private:
+  QuadExpr expr_;
+};
+double f_Shifted(const VectorXd& x) {
+  return sq(x(0) + x(1) - 3) + sq(x(2) - x(1));
+}
+void testConstantConvexCost(CvxSolverID solver_id) {
+  OptProbPtr prob;
+  setupProblem(prob, 3, solver_id);
+  boost::shared_ptr<ConstantQuadraticCost> cost(new ConstantQuadraticCost(prob->getVars()));
+  prob->addCost(cost);
+  prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_Shifted), prob->getVars(), "f", true)));
+  BasicTrustRegionSQP solver(prob);
+  solver.trust_box_size_ = 100;
+  solver.min_approx_improve_ = 1e-8;
+  vector<double> x = list_of(3)(4)(5);
+  solver.initialize(x);
+  OptStatus status = solver.optimize();
+  ASSERT_EQ(status, OPT_CONVERGED);
+  // minimizer of x0^2 + (x1-1)^2 + (x2-2)^2 + (x0+x1-3)^2 + (x2-x1)^2
+  expectAllNear(solver.x(), list_of(.625)(1.75)(1.875), 1e-3);
+  EXPECT_EQ(cost->n_convex, 1);
+}
+TEST(SQP, ConstantConvexCost)  {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testConstantConvexCost(solver_id);
+}
+
+// |x_i - target|, which adds auxiliary variables to the model
+class AbsCost : public Cost {
+public:
+  AbsCost(const Var& var, double target) : Cost("abs"), var_(var), target_(target) {}
+  double value(const vector<double>& x) {return fabs(var_.value(x) - target_);}
+  ConvexObjectivePtr convex(const vector<double>& x, Model* model) {
+    ConvexObjectivePtr out(new ConvexObjective(model));
+    out->addAbs(exprSub(AffExpr(var_), target_), 1);
+    return out;
+  }
+private:
+  Var var_;
+  double target_;
+};
+double f_Rosenbrock(const VectorXd& x) {
+  double out = 0;
+  for (int i=0; i+1 < x.size(); ++i) out += sq(x(i+1) - sq(x(i))) + .1*sq(1 - x(i));
+  return out;
+}
+VectorXd g_Ball(const VectorXd& x) {
+  VectorXd out(1);
+  out(0) = x.squaredNorm() - 4;
+  return out;
+}
+OptResults solveWithThreads(CvxSolverID solver_id, int num_threads) {
+  OptProbPtr prob;
+  setupProblem(prob, 6, solver_id);
+  for (int i=0; i < 6; ++i) prob->addCost(CostPtr(new AbsCost(prob->getVars()[i], .1*i)));
+  prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_Rosenbrock), prob->getVars(), "f", true)));
+  prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_Ball), prob->getVars(), INEQ, "g")));
+  BasicTrustRegionSQP solver(prob);
+  solver.num_threads_ = num_threads;
+  solver.initialize(DblVec(6, 1.5));
+  solver.optimize();
+  return solver.results();
+}
+TEST(SQP, ParallelConvexification) {
+  // the convex subproblems are built in the same order, so the results are identical, not just close
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptResults serial = solveWithThreads(solver_id, 1), parallel = solveWithThreads(solver_id, 4);
+    EXPECT_EQ(serial.status, parallel.status);
+    EXPECT_EQ(serial.n_qp_solves, parallel.n_qp_solves);
+    EXPECT_TRUE(serial.x == parallel.x);
+    EXPECT_TRUE(serial.cost_vals == parallel.cost_vals);
+    EXPECT_TRUE(serial.cnt_viols == parallel.cnt_viols);
+  }
+}
 
 void testProblem(ScalarOfVectorPtr f, VectorOfVectorPtr g, ConstraintType cnt_type,
   const DblVec& init, const DblVec& sol) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
     OptProbPtr prob;
     size_t n = init.size();
     assert (sol.size() == n);
-    setupProblem(prob, n);
+    setupProblem(prob, n, solver_id);
     prob->addCost(CostPtr(new CostFromFunc(f, prob->getVars(), "f", true)));
     prob->addConstr(ConstraintPtr(new ConstraintFromFunc(g, prob->getVars(), cnt_type,"g")));
     BasicTrustRegionSQP solver(prob);
@@ -92,6 +191,21 @@ void testProblem(ScalarOfVectorPtr f, VectorOfVectorPtr g, ConstraintType cnt_ty
     OptStatus status = solver.optimize();
     EXPECT_EQ(status, OPT_CONVERGED);
     expectAllNear(solver.x(), sol, .01);
+    // the auxiliary variables and rows of the first convex subproblem are reused afterwards
+    const vector<RecordStats>& record_stats = solver.results().record_stats;
+    for (size_t i=1; i < record_stats.size(); ++i) {
+      EXPECT_EQ(record_stats[i].n_created, 0);
+      EXPECT_EQ(record_stats[i].n_heap_allocs, 0);
+    }
+    // every QP solve is accounted to an iteration
+    int n_qp_solves = 0;
+    BOOST_FOREACH(const IterationRecord& record, solver.results().iterations) {
+      n_qp_solves += record.n_qp_solves;
+      EXPECT_EQ(record.cost_convexify_times.size(), 1);
+      EXPECT_GE(record.n_vars, n);
+    }
+    EXPECT_EQ(n_qp_solves, solver.results().n_qp_solves);
+  }
 }
 // http://www.ai7.uni-bayreuth.de/test_problem_coll.pdf
 
@@ -148,3 +262,313 @@ TEST(SQP, TP6) {
 TEST(SQP, TP7) {
   testProblem(ScalarOfVector::construct(&f_TP7), VectorOfVector::construct(&g_TP7), EQ, list_of(2)(2), list_of(0.)(sqrtf(3.)));
 }
+
+OptResults solveTP2(CvxSolverID solver_id, int num_trust_box_sizes) {
+  OptProbPtr prob;
+  setupProblem(prob, 2, solver_id);
+  prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_TP2), prob->getVars(), "f", true)));
+  prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_TP2), prob->getVars(), INEQ, "g")));
+  BasicTrustRegionSQP solver(prob);
+  solver.num_threads_ = 4;
+  solver.trust_box_size_ = 10; // so that steps get rejected
+  solver.num_trust_box_sizes_ = num_trust_box_sizes;
+  solver.initialize(list_of(-2)(1));
+  solver.optimize();
+  return solver.results();
+}
+static int countEvalRounds(const OptResults& results) {
+  int out = 0;
+  BOOST_FOREACH(const IterationRecord& record, results.iterations) out += record.n_eval_rounds;
+  return out;
+}
+TEST(SQP, SpeculativeTrustBoxSizes) {
+  // the same steps as shrinking the trust region one size at a time, up to the warm starts of the QPs,
+  // with fewer rounds of evaluations
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptResults serial = solveTP2(solver_id, 1), speculative = solveTP2(solver_id, 3);
+    EXPECT_EQ(serial.status, OPT_CONVERGED);
+    EXPECT_EQ(speculative.status, OPT_CONVERGED);
+    expectAllNear(speculative.x, serial.x, 1e-4);
+    EXPECT_EQ(serial.iterations.size(), speculative.iterations.size());
+    EXPECT_EQ(countEvalRounds(serial), serial.n_qp_solves);
+    EXPECT_LT(countEvalRounds(speculative), countEvalRounds(serial));
+  }
+}
+
+// sets the time limit to 0 before the given iteration
+struct RunOutOfTime {
+  BasicTrustRegionSQP* solver;
+  int iter, n_calls;
+  RunOutOfTime(BasicTrustRegionSQP* solver, int iter) : solver(solver), iter(iter), n_calls(0) {}
+  void operator()(OptProb*, DblVec&) {
+    if (++n_calls == iter) solver->max_time_ = 0;
+  }
+};
+TEST(SQP, TimeLimit) {
+  // with no time at all, the optimizer stops before the first QP and returns the starting point
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 2, solver_id);
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_TP1), prob->getVars(), "f", true)));
+    prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_TP1), prob->getVars(), INEQ, "g")));
+    BasicTrustRegionSQP solver(prob);
+    solver.max_time_ = 0;
+    solver.initialize(list_of(-2)(1));
+    EXPECT_EQ(solver.optimize(), OPT_TIME_LIMIT);
+    EXPECT_EQ(solver.results().n_qp_solves, 0);
+    EXPECT_TRUE(solver.results().best_x == solver.x());
+    EXPECT_TRUE(solver.results().best_feasible);
+
+    // running out of time after some steps were accepted returns the best point found so far
+    solver.max_time_ = INFINITY;
+    solver.addCallback(RunOutOfTime(&solver, 3));
+    DblVec start = list_of(-2.)(1.);
+    solver.initialize(start);
+    EXPECT_EQ(solver.optimize(), OPT_TIME_LIMIT);
+    const OptResults& results = solver.results();
+    EXPECT_GT(results.n_qp_solves, 0);
+    EXPECT_TRUE(results.best_x == solver.x());
+    EXPECT_FALSE(solver.x() == start);
+    Vector2d best(results.best_x[0], results.best_x[1]);
+    ASSERT_EQ(results.cost_vals.size(), 1);
+    EXPECT_EQ(results.cost_vals[0], f_TP1(best));
+    ASSERT_EQ(results.cnt_viols.size(), 1);
+    EXPECT_EQ(results.cnt_viols[0], fmax(g_TP1(best)(0), 0.));
+    EXPECT_EQ(results.best_feasible, results.cnt_viols[0] < solver.cnt_tolerance_);
+    EXPECT_LE(results.total_cost, f_TP1(Vector2d(-2, 1)));
+  }
+}
+
+OptResults solveTP7(CvxSolverID solver_id, bool augmented_lagrangian) {
+  OptProbPtr prob;
+  setupProblem(prob, 2, solver_id);
+  prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_TP7), prob->getVars(), "f", true)));
+  prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_TP7), prob->getVars(), EQ, "g")));
+  boost::shared_ptr<BasicTrustRegionSQP> solver(augmented_lagrangian ? new AugmentedLagrangianSQP(prob) : new BasicTrustRegionSQP(prob));
+  // too small for the multiplier of g (sqrt(3)/2), so the penalty has to be increased
+  solver->merit_error_coeff_ = .1;
+  solver->min_trust_box_size_ = 1e-5;
+  solver->min_approx_improve_ = 1e-10;
+  solver->initialize(list_of(2)(2));
+  solver->optimize();
+  return solver->results();
+}
+TEST(SQP, AugmentedLagrangian) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptResults basic = solveTP7(solver_id, false), al = solveTP7(solver_id, true);
+    EXPECT_EQ(basic.status, OPT_CONVERGED);
+    EXPECT_EQ(al.status, OPT_CONVERGED);
+    expectAllNear(al.x, list_of(0.)(sqrtf(3.)), .01);
+    // the multiplier is raised in small steps instead of restarting the SQP loop with 10 times the penalty
+    EXPECT_LT(al.n_qp_solves, basic.n_qp_solves);
+  }
+}
+
+VectorXd g_Loose(const VectorXd& x) {
+  VectorXd out(1);
+  out(0) = x(1) - 10;
+  return out;
+}
+TEST(SQP, PerConstraintPenalties) {
+  // only the coefficient of the violated constraint is increased
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 2, solver_id);
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_TP7), prob->getVars(), "f", true)));
+    prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_TP7), prob->getVars(), EQ, "g")));
+    prob->addConstr(ConstraintPtr(new ConstraintFromFunc(VectorOfVector::construct(&g_Loose), prob->getVars(), INEQ, "loose")));
+    BasicTrustRegionSQP solver(prob);
+    solver.merit_error_coeff_ = .1;
+    solver.min_trust_box_size_ = 1e-5;
+    solver.min_approx_improve_ = 1e-10;
+    solver.initialize(list_of(2)(2));
+    ASSERT_EQ(solver.optimize(), OPT_CONVERGED);
+    expectAllNear(solver.x(), list_of(0.)(sqrtf(3.)), .01);
+    const DblVec& coeffs = solver.results().cnt_coeffs;
+    ASSERT_EQ(coeffs.size(), 2);
+    EXPECT_GT(coeffs[0], sqrt(3.)/2); // the multiplier of g
+    EXPECT_EQ(coeffs[1], .1);
+  }
+}
+
+// g_TP7 and a few more functions, written for any scalar type
+struct TP7Err {
+  template <class T>
+  Matrix<T, Dynamic, 1> operator()(const Matrix<T, Dynamic, 1>& x) const {
+    Matrix<T, Dynamic, 1> out(3);
+    out(0) = sq(1+sq(x(0))) + sq(x(1)) - 4;
+    out(1) = sin(x(0)) * exp(x(1)) / (2 + cos(x(1)));
+    out(2) = atan2(x(1), x(0)) + sqrt(x.squaredNorm()) + log(1 + x(0)*x(0)) + pow(x(1), 3.);
+    return out;
+  }
+};
+TEST(AutoDiff, Jacobian) {
+  VectorOfVectorPtr f = AutoDiffVectorOfVector<TP7Err>::construct(TP7Err());
+  Vector2d x(.3, -1.2);
+  VectorXd y;
+  MatrixXd jac;
+  ASSERT_TRUE(f->valueAndJacobian(x, y, jac));
+  EXPECT_TRUE(y.isApprox(f->call(x)));
+  MatrixXd num_jac = calcForwardNumJac(*f, x, 1e-7);
+  EXPECT_TRUE(jac.isApprox(num_jac, 1e-5));
+}
+struct TP7Cnt {
+  template <class T>
+  Matrix<T, Dynamic, 1> operator()(const Matrix<T, Dynamic, 1>& x) const {return TP7Err()(x).head(1);}
+};
+TEST(AutoDiff, TP7) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 2, solver_id);
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_TP7), prob->getVars(), "f", true)));
+    prob->addConstr(ConstraintPtr(new ConstraintFromFunc(AutoDiffVectorOfVector<TP7Cnt>::construct(TP7Cnt()), prob->getVars(), EQ, "g")));
+    BasicTrustRegionSQP solver(prob);
+    solver.max_iter_ = 1000;
+    solver.min_trust_box_size_ = 1e-5;
+    solver.min_approx_improve_ = 1e-10;
+    solver.merit_error_coeff_ = 1;
+    solver.initialize(list_of(2)(2));
+    EXPECT_EQ(solver.optimize(), OPT_CONVERGED);
+    expectAllNear(solver.x(), list_of(0.)(sqrtf(3.)), .01);
+  }
+}
+
+// f_i = sin(x_i) * x_{i+1}, which has a bidiagonal Jacobian
+struct BidiagonalFunc : public VectorOfVector {
+  mutable int n_evals;
+  BidiagonalFunc() : n_evals(0) {}
+  VectorXd operator()(const VectorXd& x) const {
+    ++n_evals;
+    VectorXd out(x.size()-1);
+    for (int i=0; i+1 < x.size(); ++i) out(i) = sin(x(i)) * x(i+1);
+    return out;
+  }
+};
+TEST(NumDiff, ColoredJacobian) {
+  int n = 8;
+  JacobianSparsity sparsity(n-1, n);
+  for (int i=0; i+1 < n; ++i) {
+    sparsity.addNonzero(i, i);
+    sparsity.addNonzero(i, i+1);
+  }
+  vector< vector<int> > colors = sparsity.colorColumns();
+  EXPECT_EQ(colors.size(), 2);
+
+  boost::shared_ptr<BidiagonalFunc> f(new BidiagonalFunc());
+  VectorXd x = VectorXd::LinSpaced(n, -1, 2);
+  MatrixXd dense = calcForwardNumJac(*f, x, 1e-6);
+  f->n_evals = 0;
+  MatrixXd colored = calcForwardNumJac(*f, x, 1e-6, sparsity, colors);
+  EXPECT_EQ(f->n_evals, 1 + 2);
+  EXPECT_TRUE(colored.isApprox(dense, 1e-6));
+
+  ThreadPool pool(3);
+  EXPECT_TRUE(calcForwardNumJac(*f, x, 1e-6, sparsity, colors, &pool) == colored);
+
+  // the detected pattern is the same as the declared one
+  MatrixOfVectorPtr jac = forwardNumJacDetectSparsity(f, 1e-6);
+  EXPECT_TRUE(jac->call(x) == dense);
+  f->n_evals = 0;
+  EXPECT_TRUE(jac->call(x) == colored);
+  EXPECT_EQ(f->n_evals, 1 + 2);
+}
+
+TEST(NumDiff, ConvexReusesValue) {
+  OptProbPtr prob;
+  setupProblem(prob, 4, availableSolvers()[0]);
+  boost::shared_ptr<BidiagonalFunc> f(new BidiagonalFunc());
+  ConstraintFromFunc cnt(f, prob->getVars(), EQ, "g");
+  CostFromErrFunc cost(f, prob->getVars(), VectorXd(), SQUARED, "f");
+  DblVec x = list_of(.5)(1.)(-1.)(2.);
+
+  cnt.value(x);
+  cost.value(x);
+  f->n_evals = 0;
+  cnt.convex(x, prob->getModel().get());
+  cost.convex(x, prob->getModel().get());
+  EXPECT_EQ(f->n_evals, 2*4);
+
+  // a different point is evaluated again
+  x[0] = .6;
+  f->n_evals = 0;
+  cnt.convex(x, prob->getModel().get());
+  EXPECT_EQ(f->n_evals, 1 + 4);
+
+  // with a sparsity pattern, only the groups of columns are evaluated
+  JacobianSparsity sparsity(3, 4);
+  for (int i=0; i < 3; ++i) sparsity.addBlock(i, i, 1, 2);
+  ConstraintFromFunc sparse_cnt(f, sparsity, prob->getVars(), EQ, "h");
+  sparse_cnt.value(x);
+  f->n_evals = 0;
+  sparse_cnt.convex(x, prob->getModel().get());
+  EXPECT_EQ(f->n_evals, 2);
+}
+
+double f_DistToTwo(const VectorXd& x) {
+  return (x.array() - 2).square().sum();
+}
+TEST(SQP, FixedByLinearConstraints) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 4, solver_id);
+    VarVector vars = prob->getVars();
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_DistToTwo), vars, "f")));
+    // x_0 == 1 fixes x_0, and then x_1 - x_0 == 0 fixes x_1. the other two stay constraints
+    prob->addLinearConstr(exprSub(AffExpr(vars[0]), 1.), EQ);
+    prob->addLinearConstr(exprSub(AffExpr(vars[1]), AffExpr(vars[0])), EQ);
+    prob->addLinearConstr(exprSub(AffExpr(vars[1]), AffExpr(vars[2])), INEQ);
+    prob->addLinearConstr(exprSub(exprAdd(AffExpr(vars[2]), vars[3]), 5.), EQ);
+    prob->getModel()->update();
+    EXPECT_EQ(prob->getLowerBounds()[0], 1);
+    EXPECT_EQ(prob->getUpperBounds()[1], 1);
+    EXPECT_EQ(prob->getModel()->getCnts().size(), 2);
+
+    BasicTrustRegionSQP solver(prob);
+    solver.initialize(DblVec(4, 0));
+    ASSERT_EQ(solver.optimize(), OPT_CONVERGED);
+    expectAllNear(solver.x(), list_of(1.)(1.)(2.5)(2.5), 1e-4);
+  }
+}
+TEST(SQP, FixedVariablesKeepTheirBounds) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 2, solver_id);
+    VarVector vars = prob->getVars();
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_DistToTwo), vars, "f")));
+    prob->addLinearConstr(exprSub(AffExpr(vars[0]), 1.), EQ);
+    prob->setLowerBounds(DblVec(2, -10));
+    prob->setUpperBounds(DblVec(2, 10));
+    EXPECT_EQ(prob->getLowerBounds()[0], 1);
+    EXPECT_EQ(prob->getUpperBounds()[0], 1);
+    EXPECT_EQ(prob->getLowerBounds()[1], -10);
+    EXPECT_THROW(prob->setLowerBounds(DblVec(2, 5)), std::runtime_error);
+    EXPECT_THROW(prob->setUpperBounds(DblVec(2, -5)), std::runtime_error);
+    EXPECT_EQ(prob->getLowerBounds()[1], -10);
+
+    BasicTrustRegionSQP solver(prob);
+    solver.initialize(DblVec(2, 0));
+    ASSERT_EQ(solver.optimize(), OPT_CONVERGED);
+    expectAllNear(solver.x(), list_of(1.)(2.), 1e-4);
+  }
+}
+TEST(SQP, BoundsDontFixVariables) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) {
+    OptProbPtr prob;
+    setupProblem(prob, 2, solver_id);
+    VarVector vars = prob->getVars();
+    prob->addCost(CostPtr(new CostFromFunc(ScalarOfVector::construct(&f_DistToTwo), vars, "f")));
+    // x_1 is only held at 0 by its bounds, so x_0 - x_1 == 0 stays a constraint
+    prob->setLowerBounds(list_of(-10.)(0.));
+    prob->setUpperBounds(list_of(10.)(0.));
+    prob->addLinearConstr(exprSub(AffExpr(vars[0]), AffExpr(vars[1])), EQ);
+    prob->getModel()->update();
+    EXPECT_EQ(prob->getModel()->getCnts().size(), 1);
+
+    prob->setLowerBounds(DblVec(2, -10));
+    prob->setUpperBounds(DblVec(2, 10));
+    BasicTrustRegionSQP solver(prob);
+    solver.initialize(DblVec(2, 0));
+    ASSERT_EQ(solver.optimize(), OPT_CONVERGED);
+    expectAllNear(solver.x(), list_of(2.)(2.), 1e-4);
+  }
+}
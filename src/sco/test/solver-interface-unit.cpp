@@ -2,7 +2,12 @@
 #include "sco/solver_interface.hpp"
 #include "utils/logging.hpp"
 #include "sco/expr_ops.hpp"
+#include "sco/admm_interface.hpp"
+#include "sco/index_expr.hpp"
+#include "sco/quad_csc.hpp"
+#include "sco/recording_model.hpp"
 #include <cstdio>
+#include <fstream>
 #include <boost/foreach.hpp>
 #include <iostream>
 #include "utils/stl_to_string.hpp"
@@ -12,8 +17,8 @@ using namespace sco;
 
 
 
-TEST(solver_interface, setup_problem) {
-  ModelPtr solver = createModel(SOLVER_GUROBI);
+void testSetupProblem(CvxSolverID solver_id) {
+  ModelPtr solver = createModel(solver_id);
   vector<Var> vars;
   for (int i=0; i < 3; ++i) {
     char namebuf[5];
@@ -50,3 +55,393 @@ TEST(solver_interface, setup_problem) {
   EXPECT_EQ(solver->getVars().size(), 2);
 
 }
+TEST(solver_interface, setup_problem) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testSetupProblem(solver_id);
+}
+
+void testPersistentStructure(CvxSolverID solver_id) {
+  // minimize t s.t. |x| <= t, built twice with different bounds on x
+  ModelPtr model = createModel(solver_id);
+  model->setPersistentStructure(true);
+  Var x = model->addVar("x", 2, 3);
+  model->update();
+
+  Var t = model->addVar("t", 0, INFINITY);
+  model->update();
+  vector<Cnt> cnts;
+  cnts.push_back(model->addIneqCnt(exprSub(AffExpr(x), t), "pos"));
+  cnts.push_back(model->addIneqCnt(exprSub(exprMult(x, -1.), t), "neg"));
+  model->update();
+  model->setObjective(AffExpr(t));
+  ASSERT_EQ(model->optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model->getVarValue(t), 2, 1e-4);
+
+  // the removed variable and rows stay parked in the model
+  model->removeCnts(cnts);
+  model->removeVar(t);
+  model->update();
+  EXPECT_EQ(model->getVars().size(), 2);
+  EXPECT_EQ(model->getCnts().size(), 2);
+  model->setVarBounds(x, -5, -4);
+  model->setObjective(AffExpr(x));
+  ASSERT_EQ(model->optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model->getVarValue(x), -5, 1e-4);
+
+  // and are handed out again in the same order
+  Var t2 = model->addVar("t2", 0, INFINITY);
+  model->update();
+  EXPECT_EQ(t2.var_rep, t.var_rep);
+  Cnt pos = model->addIneqCnt(exprSub(AffExpr(x), t2), "pos");
+  Cnt neg = model->addIneqCnt(exprSub(exprMult(x, -1.), t2), "neg");
+  model->update();
+  EXPECT_EQ(pos.cnt_rep, cnts[0].cnt_rep);
+  EXPECT_EQ(neg.cnt_rep, cnts[1].cnt_rep);
+  model->setObjective(AffExpr(t2));
+  ASSERT_EQ(model->optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model->getVarValue(t2), 4, 1e-4);
+
+  // rebuilding the same structure keeps the sparsity pattern of the KKT matrix
+  ADMMModel* admm = dynamic_cast<ADMMModel*>(model.get());
+  int n_analyses = admm ? admm->numAnalyses() : 0;
+  model->removeCnt(pos);
+  model->removeCnt(neg);
+  model->removeVar(t2);
+  model->update();
+  t2 = model->addVar("t2", 0, INFINITY);
+  model->update();
+  pos = model->addIneqCnt(exprSub(exprMult(x, 2.), t2), "pos");
+  neg = model->addIneqCnt(exprSub(exprMult(x, -2.), t2), "neg");
+  model->update();
+  model->setObjective(AffExpr(t2));
+  ASSERT_EQ(model->optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model->getVarValue(t2), 8, 1e-4);
+  if (admm) {
+    EXPECT_EQ(admm->numAnalyses(), n_analyses);
+  }
+
+  model->removeCnt(pos);
+  model->removeCnt(neg);
+  model->removeVar(t2);
+  model->setPersistentStructure(false);
+  model->update();
+  EXPECT_EQ(model->getVars().size(), 1);
+  EXPECT_EQ(model->getCnts().size(), 0);
+}
+TEST(solver_interface, persistent_structure) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testPersistentStructure(solver_id);
+}
+
+TEST(solver_interface, row_compressor) {
+  VarRep r0(0, "x0", NULL), r1(1, "x1", NULL), r2(2, "x2", NULL);
+  Var x0(&r0), x1(&r1), x2(&r2);
+  AffExprVector exprs(2);
+  exprInc(exprs[0], exprMult(x2, 2.));
+  exprInc(exprs[0], x0);
+  exprInc(exprs[0], exprMult(x2, 3.));
+  exprInc(exprs[0], x1);
+  exprInc(exprs[0], exprMult(x1, -1.));
+  exprs[0].constant = 4;
+  exprInc(exprs[1], x1);
+  AffExprBlock block(exprs);
+  ASSERT_EQ(block.rows(), 2);
+  EXPECT_EQ(block.row(0).size(), 5);
+
+  RowCompressor compressor;
+  IntVec row_ptr, inds;
+  DblVec vals;
+  compressor.compress(block, row_ptr, inds, vals);
+  // row 0 is x0 + 5*x2 after summing duplicates and dropping the zero
+  ASSERT_EQ(row_ptr.size(), 3);
+  EXPECT_EQ(row_ptr[1], 2);
+  EXPECT_EQ(row_ptr[2], 3);
+  EXPECT_EQ(inds[0], 0);
+  EXPECT_EQ(inds[1], 2);
+  EXPECT_EQ(inds[2], 1);
+  EXPECT_EQ(vals[0], 1);
+  EXPECT_EQ(vals[1], 5);
+  EXPECT_EQ(vals[2], 1);
+}
+
+void testAddCntBlock(CvxSolverID solver_id) {
+  // minimize x + y s.t. 1 - x - y + y <= 0, 2 - y <= 0, x - y == -3
+  ModelPtr model = createModel(solver_id);
+  Var x = model->addVar("x"), y = model->addVar("y");
+  model->update();
+  AffExprBlock ineqs;
+  AffExpr aff(1.);
+  exprDec(aff, x);
+  exprDec(aff, y);
+  exprInc(aff, y);
+  ineqs.append(aff);
+  ineqs.append(exprSub(AffExpr(2.), y));
+  vector<Cnt> cnts = model->addIneqCnts(ineqs);
+  vector<Cnt> eq_cnts = model->addEqCnts(AffExprBlock(AffExprVector(1, exprAdd(exprSub(AffExpr(x), y), 3.))));
+  model->update();
+  EXPECT_EQ(cnts.size(), 2);
+  EXPECT_EQ(eq_cnts.size(), 1);
+  EXPECT_EQ(model->getCnts().size(), 3);
+  model->setObjective(exprAdd(AffExpr(x), y));
+  ASSERT_EQ(model->optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model->getVarValue(x), 1, 1e-4);
+  EXPECT_NEAR(model->getVarValue(y), 4, 1e-4);
+}
+TEST(solver_interface, add_cnt_block) {
+  BOOST_FOREACH(CvxSolverID solver_id, availableSolvers()) testAddCntBlock(solver_id);
+}
+
+TEST(solver_interface, index_expr) {
+  VarRep r0(0, "x0", NULL), r1(1, "x1", NULL);
+  Var x0(&r0), x1(&r1);
+  DblVec x(2);
+  x[0] = 2;
+  x[1] = -3;
+
+  // (x0 - 2 x1 + 1)^2 + 3 x0
+  AffExpr aff = exprAdd(exprSub(AffExpr(x0), exprMult(x1, 2)), 1.);
+  QuadExpr quad = exprAdd(exprSquare(aff), exprMult(x0, 3));
+  IndexQuadExpr iquad = exprSquare(IndexAffExpr(aff));
+  IndexAffExpr lin = exprMult(IndexAffExpr(x0), 3);
+  exprInc(iquad, lin);
+  EXPECT_NEAR(iquad.value(x), quad.value(x), 1e-10);
+  EXPECT_NEAR(IndexQuadExpr(quad).value(x), quad.value(x), 1e-10);
+  VarVector vars;
+  vars.push_back(x0);
+  vars.push_back(x1);
+  EXPECT_NEAR(toQuadExpr(iquad, vars).value(x), quad.value(x), 1e-10);
+
+  // x0*x1 and x1*x0 are the same term
+  IndexQuadExpr combined = combineTerms(iquad);
+  EXPECT_EQ(combined.size(), 3);
+  EXPECT_EQ(combined.affexpr.size(), 2);
+  EXPECT_NEAR(combined.value(x), quad.value(x), 1e-10);
+
+  // absorbing into an empty expression takes over the terms
+  IndexQuadExpr sum, copy = iquad;
+  exprAbsorb(sum, iquad);
+  EXPECT_EQ(iquad.size(), 0);
+  EXPECT_EQ(iquad.affexpr.constant, 0);
+  EXPECT_NEAR(sum.value(x), quad.value(x), 1e-10);
+  exprAbsorb(sum, copy);
+  EXPECT_NEAR(sum.value(x), 2*quad.value(x), 1e-10);
+
+  // growing past the inline buffer and swapping between inline and heap storage
+  IndexVec big, small(2, 7);
+  for (int i=0; i < 100; ++i) big.push_back(i);
+  big.swap(small);
+  ASSERT_EQ(big.size(), 2);
+  ASSERT_EQ(small.size(), 100);
+  EXPECT_EQ(big[1], 7);
+  EXPECT_EQ(small[99], 99);
+
+  // adding an expression to itself grows the buffer it's reading from
+  IndexQuadExpr twice = combined;
+  exprInc(twice, twice);
+  EXPECT_NEAR(twice.value(x), 2*combined.value(x), 1e-10);
+  small.append(small.data(), small.size());
+  ASSERT_EQ(small.size(), 200);
+  EXPECT_EQ(small[199], 99);
+}
+
+TEST(solver_interface, quad_csc) {
+  // 2 x1*x0 + x2^2 - x0*x1 + 3 x0*x2 + x2^2
+  int inds1[] = {1, 2, 0, 0, 2}, inds2[] = {0, 2, 1, 2, 2};
+  double coeffs[] = {2, 1, -1, 3, 1};
+  QuadCSC hessian;
+  hessian.update(inds1, inds2, coeffs, 5, 3);
+  EXPECT_TRUE(hessian.patternChanged());
+  ASSERT_EQ(hessian.nonZeros(), 3);
+  int col_ptr[] = {0, 0, 1, 3}, row_ind[] = {0, 0, 2};
+  double values[] = {1, 3, 2};
+  for (int j=0; j < 4; ++j) EXPECT_EQ(hessian.colPtr()[j], col_ptr[j]);
+  for (int k=0; k < 3; ++k) {
+    EXPECT_EQ(hessian.rowInd()[k], row_ind[k]);
+    EXPECT_EQ(hessian.values()[k], values[k]);
+  }
+
+  // same terms with new coefficients only scatter the values
+  coeffs[4] = 5;
+  hessian.update(inds1, inds2, coeffs, 5, 3);
+  EXPECT_FALSE(hessian.patternChanged());
+  EXPECT_EQ(hessian.values()[2], 6);
+  EXPECT_EQ(hessian.numPatternBuilds(), 1);
+
+  inds2[0] = 1;
+  hessian.update(inds1, inds2, coeffs, 5, 3);
+  EXPECT_TRUE(hessian.patternChanged());
+  EXPECT_EQ(hessian.nonZeros(), 4);
+}
+
+TEST(solver_interface, admm_constrained_qp) {
+  // minimize (x-1)^2 + (y-2)^2 + x*y  s.t.  x + y == 1, x - y <= -2, y <= 5
+  // optimum is on the boundary x = -1/2, y = 3/2
+  ADMMModel model;
+  Var x = model.addVar("x"), y = model.addVar("y", -INFINITY, 5);
+  model.update();
+  AffExpr eq = exprSub(exprAdd(AffExpr(x), y), 1.);
+  AffExpr ineq = exprAdd(exprSub(AffExpr(x), y), 2.);
+  model.addEqCnt(eq, "eq");
+  model.addIneqCnt(ineq, "ineq");
+  model.update();
+  QuadExpr obj = exprAdd(exprSquare(exprSub(AffExpr(x), 1.)), exprSquare(exprSub(AffExpr(y), 2.)));
+  exprInc(obj, exprMult(x, y));
+  model.setObjective(obj);
+  ASSERT_EQ(model.optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model.getVarValue(x), -.5, 1e-6);
+  EXPECT_NEAR(model.getVarValue(y), 1.5, 1e-6);
+  EXPECT_EQ(model.numAnalyses(), 1);
+
+  // only the bounds changed, so the KKT factorization can be reused
+  int n_factorizations = model.numFactorizations();
+  model.setVarBounds(x, -10, -.75);
+  ASSERT_EQ(model.optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model.getVarValue(x), -.75, 1e-6);
+  EXPECT_NEAR(model.getVarValue(y), 1.75, 1e-6);
+  EXPECT_EQ(model.numAnalyses(), 1);
+  EXPECT_LE(model.numFactorizations() - n_factorizations, 1);
+
+  // warm starting from the previous solution should take fewer iterations than a cold start
+  DblVec primal = model.getVarValues(model.getVars()), dual = model.getDualValues(model.getCnts());
+  model.setVarBounds(x, -10, -.8);
+  ASSERT_EQ(model.optimize(), CVX_SOLVED);
+  int cold_iters = model.lastIterations();
+  model.setVarBounds(x, -10, -.75);
+  ASSERT_EQ(model.optimize(), CVX_SOLVED);
+  model.setVarBounds(x, -10, -.8);
+  model.setWarmStart(primal, dual);
+  ASSERT_EQ(model.optimize(), CVX_SOLVED);
+  EXPECT_NEAR(model.getVarValue(x), -.8, 1e-6);
+  EXPECT_LE(model.lastIterations(), cold_iters);
+
+  model.setVarBounds(x, 0, 10);
+  EXPECT_EQ(model.optimize(), CVX_INFEASIBLE);
+}
+
+// smooth path through n_steps x n_dof variables with fixed endpoints and a box constraint per step
+static void setupChainQP(ADMMModel& model, int n_steps, int n_dof, bool stages) {
+  vector<Var> vars;
+  IntVec var_stages;
+  for (int t=0; t < n_steps; ++t) {
+    for (int j=0; j < n_dof; ++j) {
+      vars.push_back(model.addVar("x", -10, 10));
+      var_stages.push_back(t);
+    }
+  }
+  model.update();
+  if (stages) model.setVarStages(vars, var_stages);
+  QuadExpr obj;
+  for (int t=0; t+1 < n_steps; ++t) {
+    for (int j=0; j < n_dof; ++j) {
+      exprInc(obj, exprSquare(exprSub(AffExpr(vars[(t+1)*n_dof+j]), AffExpr(vars[t*n_dof+j]))));
+    }
+  }
+  for (int j=0; j < n_dof; ++j) {
+    model.addEqCnt(exprSub(AffExpr(vars[j]), 0.), "start");
+    model.addEqCnt(exprSub(AffExpr(vars[(n_steps-1)*n_dof+j]), double(j+1)), "end");
+  }
+  for (int t=1; t+1 < n_steps; ++t) {
+    // x_t0 + x_t1 - x_{t-1}0 <= 1.5, which couples consecutive steps
+    AffExpr aff = exprAdd(AffExpr(vars[t*n_dof]), AffExpr(vars[t*n_dof+1]));
+    exprDec(aff, AffExpr(vars[(t-1)*n_dof]));
+    model.addIneqCnt(exprSub(aff, 1.5), "box");
+  }
+  model.update();
+  model.setObjective(obj);
+}
+
+TEST(solver_interface, admm_stage_ordering) {
+  int n_dof = 3;
+  ADMMModel plain, staged;
+  setupChainQP(plain, 40, n_dof, false);
+  setupChainQP(staged, 40, n_dof, true);
+  ASSERT_EQ(plain.optimize(), CVX_SOLVED);
+  ASSERT_EQ(staged.optimize(), CVX_SOLVED);
+  DblVec xplain = plain.getVarValues(plain.getVars()), xstaged = staged.getVarValues(staged.getVars());
+  for (size_t i=0; i < xplain.size(); ++i) EXPECT_NEAR(xplain[i], xstaged[i], 1e-4);
+
+  // the factor stays within the band, so it grows linearly with the number of steps
+  ADMMModel staged2;
+  setupChainQP(staged2, 80, n_dof, true);
+  ASSERT_EQ(staged2.optimize(), CVX_SOLVED);
+  EXPECT_LT(staged2.numFactorNonzeros(), 2.2 * staged.numFactorNonzeros());
+}
+
+TEST(solver_interface, record_and_replay) {
+  string fname = "/tmp/sco-record-test.bin";
+  std::remove(fname.c_str());
+  {
+    RecordingModel model(ModelPtr(new ADMMModel()), SOLVER_CUSTOM, fname);
+    Var x = model.addVar("x"), y = model.addVar("y", -INFINITY, 5), z = model.addVar("z");
+    model.update();
+    model.addEqCnt(exprSub(exprAdd(AffExpr(x), y), 1.), "eq");
+    AffExprBlock block;
+    block.append(exprAdd(exprSub(AffExpr(x), y), 2.));
+    block.append(exprSub(AffExpr(z), 3.));
+    model.addIneqCnts(block);
+    model.update();
+    QuadExpr obj = exprAdd(exprSquare(exprSub(AffExpr(x), 1.)), exprSquare(exprSub(AffExpr(y), 2.)));
+    exprInc(obj, exprSquare(AffExpr(z)));
+    model.setObjective(obj);
+    ASSERT_EQ(model.optimize(), CVX_SOLVED);
+    // the removed variable is gone from the second record
+    model.removeVar(z);
+    model.update();
+    model.setVarBounds(x, -10, -.75);
+    model.setObjective(exprAdd(exprSquare(exprSub(AffExpr(x), 1.)), exprSquare(exprSub(AffExpr(y), 2.))));
+    model.setWarmStart(model.getVarValues(model.getVars()), DblVec());
+    ASSERT_EQ(model.optimize(), CVX_SOLVED);
+    EXPECT_EQ(model.numRecorded(), 2);
+  }
+
+  ifstream file(fname.c_str(), ios::in | ios::binary);
+  vector<QPRecord> recs;
+  QPRecord rec;
+  while (readQPRecord(file, rec)) recs.push_back(rec);
+  ASSERT_EQ(recs.size(), 2);
+  EXPECT_EQ(recs[0].numVars(), 3);
+  EXPECT_EQ(recs[0].numRows(), 3);
+  EXPECT_EQ(recs[1].numVars(), 2);
+  EXPECT_EQ(recs[1].lbs[0], -10);
+  EXPECT_EQ(recs[1].warm_primal.size(), 2);
+  EXPECT_EQ(recs[1].solver, SOLVER_CUSTOM);
+  EXPECT_NEAR(recs[0].objective, 2.5, 1e-5); // x = -1/2, y = 3/2, z = 0
+  BOOST_FOREACH(const QPRecord& rec, recs) {
+    ADMMModel replay;
+    VarVector vars = loadQPRecord(rec, replay, SOLVER_CUSTOM);
+    ASSERT_EQ(replay.optimize(), CVX_SOLVED);
+    EXPECT_NEAR(rec.objectiveExpr().value(replay.getVarValues(vars)), rec.objective, 1e-5);
+  }
+  std::remove(fname.c_str());
+}
+
+TEST(solver_interface, admm_fixed_vars) {
+  // fixing x with its bounds gives the same solution and multipliers as fixing it with a constraint row
+  ADMMModel row_model, fixed_model;
+  Cnt row_eq, fixed_eq;
+  for (int fixed=0; fixed < 2; ++fixed) {
+    ADMMModel& model = fixed ? fixed_model : row_model;
+    Var x = model.addVar("x"), y = model.addVar("y", -INFINITY, 5);
+    model.update();
+    if (fixed) model.setVarBounds(x, -.75, -.75);
+    else model.addEqCnt(exprAdd(AffExpr(x), .75), "fix");
+    Cnt eq = model.addEqCnt(exprSub(exprAdd(AffExpr(x), y), 1.), "eq");
+    model.update();
+    QuadExpr obj = exprAdd(exprSquare(exprSub(AffExpr(x), 1.)), exprSquare(exprSub(AffExpr(y), 2.)));
+    exprInc(obj, exprMult(x, y));
+    model.setObjective(obj);
+    ASSERT_EQ(model.optimize(), CVX_SOLVED);
+    (fixed ? fixed_eq : row_eq) = eq;
+  }
+  DblVec xrow = row_model.getVarValues(row_model.vars), xfixed = fixed_model.getVarValues(fixed_model.vars);
+  EXPECT_EQ(xfixed[0], -.75);
+  EXPECT_NEAR(xfixed[1], 1.75, 1e-6);
+  EXPECT_NEAR(xrow[1], 1.75, 1e-6);
+  EXPECT_NEAR(fixed_model.getDualValues(vector<Cnt>(1, fixed_eq))[0], row_model.getDualValues(vector<Cnt>(1, row_eq))[0], 1e-5);
+  EXPECT_LT(fixed_model.numFactorNonzeros(), row_model.numFactorNonzeros());
+
+  // fixing every variable leaves nothing to solve
+  fixed_model.setVarBounds(fixed_model.vars[1], 1.75, 1.75);
+  ASSERT_EQ(fixed_model.optimize(), CVX_SOLVED);
+  EXPECT_EQ(fixed_model.getVarValue(fixed_model.vars[1]), 1.75);
+  fixed_model.setVarBounds(fixed_model.vars[1], 2, 2);
+  EXPECT_EQ(fixed_model.optimize(), CVX_INFEASIBLE);
+}
@@ -0,0 +1,95 @@
+#include "thread_pool.hpp"
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+using namespace std;
+
+namespace sco {
+
+ThreadPool::ThreadPool(int num_threads) :
+    task_(NULL), n_tasks_(0), next_task_(0), n_busy_(0), batch_(0), stopping_(false), error_index_(-1) {
+  for (int i=1; i < num_threads; ++i) workers_.push_back(new boost::thread(boost::bind(&ThreadPool::workerLoop, this)));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  start_cv_.notify_all();
+  BOOST_FOREACH(boost::thread* worker, workers_) {
+    worker->join();
+    delete worker;
+  }
+}
+
+void ThreadPool::parallelFor(int n, const Task& task) {
+  if (n <= 0) return;
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    task_ = &task;
+    n_tasks_ = n;
+    next_task_ = 0;
+    error_index_ = -1;
+    ++batch_;
+  }
+  start_cv_.notify_all();
+  runTasks();
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (n_busy_ > 0) done_cv_.wait(lock);
+  task_ = NULL;
+  if (error_index_ >= 0) throw std::runtime_error(error_msg_);
+}
+
+void ThreadPool::workerLoop() {
+  unsigned seen_batch = 0;
+  while (true) {
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!stopping_ && batch_ == seen_batch) start_cv_.wait(lock);
+      if (stopping_) return;
+      seen_batch = batch_;
+      ++n_busy_;
+    }
+    runTasks();
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (--n_busy_ == 0) done_cv_.notify_all();
+    }
+  }
+}
+
+// a worker that wakes up late finds no index left and never touches task_
+void ThreadPool::runTasks() {
+  while (true) {
+    int i;
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (next_task_ >= n_tasks_) return;
+      i = next_task_++;
+    }
+    string msg;
+    bool failed = false;
+    try {
+      (*task_)(i);
+    }
+    catch (const std::exception& e) {
+      failed = true;
+      msg = e.what();
+    }
+    catch (...) {
+      failed = true;
+      msg = "unknown exception in parallel task";
+    }
+    if (failed) {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (error_index_ < 0 || i < error_index_) {
+        error_index_ = i;
+        error_msg_ = msg;
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/**
+
+@file thread_pool.hpp
+
+Fixed set of worker threads for the data-parallel loops of the optimizer.
+
+parallelFor(n, task) calls task(i) for every i in [0, n) and returns when all calls are done. The calling
+thread takes part in the work, so a pool of N threads starts N-1 workers. The calls are handed out in
+index order, but run concurrently and finish in any order, so a task should only write to a slot of its
+own, e.g. out[i]. If some calls throw, the exception of the lowest index is rethrown as a
+std::runtime_error after all the calls are done, so that the error does not depend on the timing.
+
+*/
+
+namespace sco {
+
+class ThreadPool {
+public:
+  typedef boost::function<void(int)> Task;
+
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  int numThreads() const {return workers_.size() + 1;}
+  void parallelFor(int n, const Task& task);
+
+private:
+  void workerLoop();
+  void runTasks();
+
+  boost::mutex mutex_;
+  boost::condition_variable start_cv_, done_cv_;
+  std::vector<boost::thread*> workers_;
+  const Task* task_;
+  int n_tasks_, next_task_, n_busy_;
+  unsigned batch_;
+  bool stopping_;
+  int error_index_;
+  std::string error_msg_;
+
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+};
+
+}
@@ -131,9 +131,19 @@ struct BeliefDynamicsErrCalculator : public VectorOfVector {
 	}
 };
 
+// the error is linear in theta1 with Jacobian -I, so the theta1 columns are differenced together
+static JacobianSparsity BeliefDynamicsSparsity(BeliefRobotAndDOFPtr brad) {
+	int b_dim = brad->GetBDim(), u_dim = brad->GetUDim();
+	JacobianSparsity sparsity(b_dim, 2*b_dim + u_dim);
+	sparsity.addBlock(0, 0, b_dim, b_dim);
+	for (int i=0; i < b_dim; ++i) sparsity.addNonzero(i, b_dim + i);
+	sparsity.addBlock(0, 2*b_dim, b_dim, u_dim);
+	return sparsity;
+}
+
 BeliefDynamicsConstraint2::BeliefDynamicsConstraint2(const VarVector& theta0_vars,	const VarVector& theta1_vars, const VarVector& u_vars,
 		BeliefRobotAndDOFPtr brad, const BoolVec& enabled) :
-		ConstraintFromFunc(VectorOfVectorPtr(new BeliefDynamicsErrCalculator(brad)),
+		ConstraintFromFunc(VectorOfVectorPtr(new BeliefDynamicsErrCalculator(brad)), BeliefDynamicsSparsity(brad),
 				concat(concat(theta0_vars, theta1_vars), u_vars), EQ, "BeliefDynamics2")
 {
 }
@@ -33,6 +33,7 @@ public:
 	CovarianceCost(const VarVector& rtSigma_vars, const MatrixXd& Q, BeliefRobotAndDOFPtr brad);
 	virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
 	virtual double value(const vector<double>&);
+	virtual bool isConvexConstant() const {return true;}
 private:
 	VarVector rtSigma_vars_;
 	MatrixXd Q_;
@@ -45,6 +46,7 @@ public:
 	ControlCost(const VarArray& traj, const VectorXd& coeffs);
 	virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
 	virtual double value(const vector<double>&);
+	virtual bool isConvexConstant() const {return true;}
 private:
 	VarArray vars_;
 	VectorXd coeffs_;
@@ -19,6 +19,7 @@
 #include <utils/stl_to_string.hpp>
 #include "utils/logging.hpp"
 #include "osgviewer/osgviewer.hpp"
+#include <boost/thread/mutex.hpp>
 using namespace util;
 using namespace std;
 using namespace trajopt;
@@ -291,6 +292,51 @@ class BulletCollisionChecker : public CollisionChecker {
 	btCollisionConfiguration* m_coll_config;
 	typedef map<const OR::KinBody::Link*, CollisionObjectWrapper*> Link2Cow;
 	Link2Cow m_link2cow;
+
+	/*
+	A copy of m_world for one thread. Its collision objects share their shapes with the ones of m_world.
+	LinksVsAll(rad, ...), CastVsAll and MultiCastVsAll check out a worker for the duration of the call, so they
+	can run concurrently, as long as nothing changes the OpenRAVE environment meanwhile. A worker is rebuilt
+	when m_world gains or loses objects. Like m_world, it only moves the objects of the bodies whose update stamp
+	changed since it last saw them, plus the links that the previous call placed somewhere else.
+	*/
+	struct Worker {
+		btCollisionConfiguration* coll_config;
+		btCollisionDispatcher* dispatcher;
+		btBroadphaseInterface* broadphase;
+		btCollisionWorld* world;
+		vector<COWPtr> cows;
+		Link2Cow link2cow;
+		int generation;
+		vector<KinBodyPtr> bodies; // copy of m_prevbodies, made by AcquireWorker
+		map<const KinBody*, int> stamps; // update stamps of the bodies when the objects were last placed
+		vector<CollisionObjectWrapper*> moved; // objects placed at the transforms passed to the last UpdateWorker
+		Worker(BulletCollisionChecker* cc);
+		~Worker();
+		CollisionObjectWrapper* GetCow(const KinBody::Link* link) {
+			Link2Cow::iterator it = link2cow.find(link);
+			return (it == link2cow.end()) ? 0 : it->second;
+		}
+	};
+	typedef boost::shared_ptr<Worker> WorkerPtr;
+	class ScopedWorker {
+		BulletCollisionChecker* m_cc;
+		WorkerPtr m_worker;
+	public:
+		ScopedWorker(BulletCollisionChecker* cc) : m_cc(cc), m_worker(cc->AcquireWorker()) {}
+		~ScopedWorker() {m_cc->ReleaseWorker(m_worker);}
+		Worker* operator->() {return m_worker.get();}
+		Worker& operator*() {return *m_worker;}
+	};
+	boost::mutex m_workers_mutex;
+	vector<WorkerPtr> m_idle_workers;
+	int m_generation; // incremented when the objects of m_world change
+	WorkerPtr AcquireWorker();
+	void ReleaseWorker(WorkerPtr worker);
+	void BuildWorker(Worker& worker);
+	// place the objects of the worker where OpenRAVE has them, and then links at tfs. Only updates the objects that moved
+	void UpdateWorker(Worker& worker, const vector<KinBody::LinkPtr>& links, const vector<btTransform>& tfs);
+
 	double m_contactDistance;
 	vector<KinBodyPtr> m_prevbodies;
 	typedef std::pair<const KinBody::Link*, const KinBody::Link*> LinkPair;
@@ -318,6 +364,7 @@ public:
 	// collision checking
 	virtual void AllVsAll(vector<Collision>& collisions);
 	virtual void LinksVsAll(const vector<KinBody::LinkPtr>& links, vector<Collision>& collisions);
+	virtual void LinksVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links, const DblVec& dofvals, vector<Collision>& collisions);
 	virtual void LinkVsAll(const KinBody::Link& link, vector<Collision>& collisions);
 	virtual void DiscreteCheckTrajectory(const TrajArray& traj, RobotAndDOFPtr rad, vector<Collision>& collisions);
 	virtual void DiscreteCheckSigma(RobotAndDOFPtr rad, Eigen::MatrixXd sigma_pts, vector<Collision>& collisions);
@@ -385,7 +432,7 @@ void nearCallback(btBroadphasePair& collisionPair,
 
 
 BulletCollisionChecker::BulletCollisionChecker(OR::EnvironmentBaseConstPtr env) :
-				  CollisionChecker(env) {
+				  CollisionChecker(env), m_generation(0) {
 	m_coll_config = new btDefaultCollisionConfiguration();
 	m_dispatcher = new btCollisionDispatcher(m_coll_config);
 	m_broadphase = new btDbvtBroadphase();
@@ -409,12 +456,14 @@ BulletCollisionChecker::~BulletCollisionChecker() {
 void BulletCollisionChecker::SetContactDistance(float dist) {
 	LOG_DEBUG("setting contact distance to %.2f", dist);
 	m_contactDistance = dist;
+	++m_generation; // for the contact processing threshold of the workers
 	SHAPE_EXPANSION = btVector3(1,1,1)*dist;
 	gContactBreakingThreshold = 2.001*dist; // wtf. when I set it to 2.0 there are no contacts with distance > 0
 	btCollisionObjectArray& objs = m_world->getCollisionObjectArray();
 	for (int i=0; i < objs.size(); ++i) {
 		objs[i]->setContactProcessingThreshold(dist);
 	}
+	m_world->updateAabbs(); // their margin is the contact breaking threshold
 	btCollisionDispatcher* dispatcher = static_cast<btCollisionDispatcher*>(m_world->getDispatcher());
 	dispatcher->setDispatcherFlags(dispatcher->getDispatcherFlags() & ~btCollisionDispatcher::CD_USE_RELATIVE_CONTACT_BREAKING_THRESHOLD);
 }
@@ -461,13 +510,29 @@ void BulletCollisionChecker::LinksVsAll(const vector<KinBody::LinkPtr>& links, v
 	//  return;
 
 	UpdateBulletFromRave();
-	m_world->updateAabbs();
 
 	BOOST_FOREACH(const KinBody::LinkPtr& link, links) {
 		LinkVsAll_NoUpdate(*link, collisions);// xxx just testing
 	}
 }
 
+void BulletCollisionChecker::LinksVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links, const DblVec& dofvals, vector<Collision>& collisions) {
+	vector<OR::Transform> link_tfs;
+	rad.GetLinkTransforms(dofvals, link_tfs);
+	vector<btTransform> tfs(links.size());
+	for (int i=0; i < links.size(); ++i) {
+		tfs[i] = toBt(rad.GetLinkTransform(link_tfs, *links[i]));
+	}
+	ScopedWorker worker(this);
+	UpdateWorker(*worker, links, tfs);
+
+	BOOST_FOREACH(const KinBody::LinkPtr& link, links) {
+		if (link->GetGeometries().empty()) continue;
+		CollisionObjectWrapper* cow = worker->GetCow(link.get());
+		CollisionCollector cc(collisions, cow, this);
+		worker->world->contactTest(cow, cc);
+	}
+}
 
 void BulletCollisionChecker::LinkVsAll(const KinBody::Link& link, vector<Collision>& collisions) {
 	UpdateBulletFromRave();
@@ -487,7 +552,8 @@ struct KinBodyCollisionData : public OpenRAVE::UserData {
 	OpenRAVE::KinBodyWeakPtr body;
 	std::vector<KinBody::Link*> links;
 	std::vector<COWPtr> cows;
-	KinBodyCollisionData(OR::KinBodyPtr _body) : body(_body) {}
+	int update_stamp; // of the body when the cows were last placed
+	KinBodyCollisionData(OR::KinBodyPtr _body) : body(_body), update_stamp(-1) {}
 };
 
 void BulletCollisionChecker::AddKinBody(const OR::KinBodyPtr& body) {
@@ -559,6 +625,7 @@ void BulletCollisionChecker::AddAndRemoveBodies(const vector<KinBodyPtr>& curVec
 		RemoveKinBody(body);
 	}
 	SetLinkIndices();
+	++m_generation;
 }
 
 void BulletCollisionChecker::SetLinkIndices() {
@@ -596,13 +663,116 @@ void BulletCollisionChecker::UpdateBulletFromRave() {
 		LOG_DEBUG("don't need to add or remove stuff");
 	}
 
+	// OpenRAVE changes the update stamp of a body whenever one of its links moves, so static bodies are skipped
+	LOG_DEBUG("%i objects in bullet world", m_world->getCollisionObjectArray().size());
+	BOOST_FOREACH(const KinBodyPtr& body, bodies) {
+		CDPtr cd = boost::static_pointer_cast<KinBodyCollisionData>(body->GetUserData("bt"));
+		if (!cd || cd->update_stamp == body->GetUpdateStamp()) continue;
+		BOOST_FOREACH(const COWPtr& cow, cd->cows) {
+			cow->setWorldTransform(toBt(cow->m_link->GetTransform()));
+			m_world->updateSingleAabb(cow.get());
+		}
+		cd->update_stamp = body->GetUpdateStamp();
+	}
+}
+
+BulletCollisionChecker::Worker::Worker(BulletCollisionChecker* cc) : generation(-1) {
+	coll_config = new btDefaultCollisionConfiguration();
+	dispatcher = new btCollisionDispatcher(coll_config);
+	broadphase = new btDbvtBroadphase();
+	world = new btCollisionWorld(dispatcher, broadphase, coll_config);
+	dispatcher->registerCollisionCreateFunc(BOX_SHAPE_PROXYTYPE,BOX_SHAPE_PROXYTYPE,
+			coll_config->getCollisionAlgorithmCreateFunc(CONVEX_SHAPE_PROXYTYPE, CONVEX_SHAPE_PROXYTYPE));
+	dispatcher->setNearCallback(&nearCallback);
+	dispatcher->m_userData = cc;
+	dispatcher->setDispatcherFlags(dispatcher->getDispatcherFlags() & ~btCollisionDispatcher::CD_USE_RELATIVE_CONTACT_BREAKING_THRESHOLD);
+}
+
+BulletCollisionChecker::Worker::~Worker() {
+	delete world;
+	delete broadphase;
+	delete dispatcher;
+	delete coll_config;
+}
+
+BulletCollisionChecker::WorkerPtr BulletCollisionChecker::AcquireWorker() {
+	boost::mutex::scoped_lock lock(m_workers_mutex);
+	vector<OR::KinBodyPtr> bodies;
+	m_env->GetBodies(bodies);
+	if (bodies != m_prevbodies) UpdateBulletFromRave();
+
+	WorkerPtr worker;
+	if (m_idle_workers.empty()) {
+		worker.reset(new Worker(this));
+	}
+	else {
+		worker = m_idle_workers.back();
+		m_idle_workers.pop_back();
+	}
+	if (worker->generation != m_generation) BuildWorker(*worker);
+	worker->bodies = m_prevbodies; // m_prevbodies can change as soon as the lock is released
+	return worker;
+}
+
+void BulletCollisionChecker::ReleaseWorker(WorkerPtr worker) {
+	boost::mutex::scoped_lock lock(m_workers_mutex);
+	m_idle_workers.push_back(worker);
+}
+
+void BulletCollisionChecker::BuildWorker(Worker& worker) {
+	LOG_DEBUG("building a copy of the bullet world");
+	BOOST_FOREACH(const COWPtr& cow, worker.cows) {
+		worker.world->removeCollisionObject(cow.get());
+	}
+	worker.cows.clear();
+	worker.link2cow.clear();
+	worker.stamps.clear();
+	worker.moved.clear();
 	btCollisionObjectArray& objs = m_world->getCollisionObjectArray();
-	LOG_DEBUG("%i objects in bullet world", objs.size());
 	for (int i=0; i < objs.size(); ++i) {
 		CollisionObjectWrapper* cow = static_cast<CollisionObjectWrapper*>(objs[i]);
+		COWPtr copy(new CollisionObjectWrapper(cow->m_link));
+		copy->m_data = cow->m_data; // keeps the shapes alive if the original is removed
+		copy->m_index = cow->m_index;
+		copy->setCollisionShape(cow->getCollisionShape());
+		copy->setWorldTransform(cow->getWorldTransform());
+		copy->setContactProcessingThreshold(m_contactDistance);
+		btBroadphaseProxy* proxy = cow->getBroadphaseHandle();
+		worker.world->addCollisionObject(copy.get(), proxy->m_collisionFilterGroup, proxy->m_collisionFilterMask);
+		worker.cows.push_back(copy);
+		worker.link2cow[cow->m_link] = copy.get();
+	}
+	worker.generation = m_generation;
+}
+
+void BulletCollisionChecker::UpdateWorker(Worker& worker, const vector<KinBody::LinkPtr>& links, const vector<btTransform>& tfs) {
+	vector<CollisionObjectWrapper*> dirty;
+	BOOST_FOREACH(CollisionObjectWrapper* cow, worker.moved) {
 		cow->setWorldTransform(toBt(cow->m_link->GetTransform()));
+		dirty.push_back(cow);
+	}
+	worker.moved.clear();
+	BOOST_FOREACH(const KinBodyPtr& body, worker.bodies) {
+		map<const KinBody*, int>::iterator it = worker.stamps.find(body.get());
+		if (it != worker.stamps.end() && it->second == body->GetUpdateStamp()) continue;
+		BOOST_FOREACH(const KinBody::LinkPtr& link, body->GetLinks()) {
+			if (CollisionObjectWrapper* cow = worker.GetCow(link.get())) {
+				cow->setWorldTransform(toBt(link->GetTransform()));
+				dirty.push_back(cow);
+			}
+		}
+		worker.stamps[body.get()] = body->GetUpdateStamp();
+	}
+	for (int i=0; i < links.size(); ++i) {
+		if (CollisionObjectWrapper* cow = worker.GetCow(links[i].get())) {
+			cow->setWorldTransform(tfs[i]);
+			worker.moved.push_back(cow);
+			dirty.push_back(cow);
+		}
+	}
+	BOOST_FOREACH(CollisionObjectWrapper* cow, dirty) {
+		worker.world->updateSingleAabb(cow);
 	}
-
 }
 
 
@@ -628,10 +798,8 @@ void BulletCollisionChecker::DiscreteCheckTrajectory(const TrajArray& traj, Robo
 	rad->GetAffectedLinks(links, true, inds);
 
 	if (traj.cols() == rad->GetDOF()) { // normal (mean) collision checking
-		RobotBase::RobotStateSaver save = rad->Save();
 		for (int iStep=0; iStep < traj.rows(); ++iStep) {
-			rad->SetDOFValues(toDblVec(traj.row(iStep).transpose()));
-			LinksVsAll(links, collisions);
+			LinksVsAll(*rad, links, toDblVec(traj.row(iStep).transpose()), collisions);
 		}
 	} else { // sigma points collision checking?
 		BeliefRobotAndDOFPtr brad = boost::static_pointer_cast<BeliefRobotAndDOF>(rad);
@@ -700,7 +868,6 @@ void ContinuousCheckShape(btCollisionShape* shape, const vector<btTransform>& tr
 
 void BulletCollisionChecker::ContinuousCheckTrajectory(const TrajArray& traj, RobotAndDOFPtr rad, vector<Collision>& collisions) {
 	UpdateBulletFromRave();
-	m_world->updateAabbs();
 
 	// first calculate transforms of all the relevant links at each step
 	vector<KinBody::LinkPtr> links;
@@ -724,12 +891,12 @@ void BulletCollisionChecker::ContinuousCheckTrajectory(const TrajArray& traj, Ro
 
 	typedef vector<btTransform> TransformVec;
 	vector<TransformVec> link2transforms(links.size(), TransformVec(traj.rows()));
-	RobotBase::RobotStateSaver save = rad->Save();
+	vector<OR::Transform> link_tfs;
 
 	for (int iStep=0; iStep < traj.rows(); ++iStep) {
-		rad->SetDOFValues(toDblVec(traj.row(iStep)));
+		rad->GetLinkTransforms(toDblVec(traj.row(iStep)), link_tfs);
 		for (int iLink = 0; iLink < links.size(); ++iLink) {
-			link2transforms[iLink][iStep] = toBt(links[iLink]->GetTransform());
+			link2transforms[iLink][iStep] = toBt(rad->GetLinkTransform(link_tfs, *links[iLink]));
 		}
 	}
 
@@ -954,25 +1121,24 @@ void BulletCollisionChecker::CheckShapeCast(btCollisionShape* shape, const btTra
 
 void BulletCollisionChecker::CastVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links,
 		const DblVec& startjoints, const DblVec& endjoints, vector<Collision>& collisions) {
-	OR::RobotBase::RobotStateSaver saver = rad.Save();
-	rad.SetDOFValues(startjoints);
 	int nlinks = links.size();
 	vector<btTransform> tbefore(nlinks), tafter(nlinks);
+	vector<OR::Transform> link_tfs;
+	rad.GetLinkTransforms(startjoints, link_tfs);
 	for (int i=0; i < nlinks; ++i) {
-		tbefore[i] = toBt(links[i]->GetTransform());
+		tbefore[i] = toBt(rad.GetLinkTransform(link_tfs, *links[i]));
 	}
-	rad.SetDOFValues(endjoints);
+	rad.GetLinkTransforms(endjoints, link_tfs);
 	for (int i=0; i < nlinks; ++i) {
-		tafter[i] = toBt(links[i]->GetTransform());
+		tafter[i] = toBt(rad.GetLinkTransform(link_tfs, *links[i]));
 	}
-	rad.SetDOFValues(startjoints);
-	UpdateBulletFromRave();
-	m_world->updateAabbs();
+	ScopedWorker worker(this);
+	UpdateWorker(*worker, links, tbefore);
 
 	for (int i=0; i < nlinks; ++i) {
-		assert(m_link2cow[links[i].get()] != NULL);
-		CollisionObjectWrapper* cow = m_link2cow[links[i].get()];
-		CheckShapeCast(cow->getCollisionShape(), tbefore[i], tafter[i], cow, m_world, collisions);
+		CollisionObjectWrapper* cow = worker->GetCow(links[i].get());
+		assert(cow != NULL);
+		CheckShapeCast(cow->getCollisionShape(), tbefore[i], tafter[i], cow, worker->world, collisions);
 	}
 	LOG_DEBUG("CastVsAll checked %i links and found %i collisions", (int)links.size(), (int)collisions.size());
 }
@@ -1170,23 +1336,26 @@ void BulletCollisionChecker::CheckShapeMultiCast(btCollisionShape* shape, const
 // multi_joints is a vector where each element is a vector of joint angles
 void BulletCollisionChecker::MultiCastVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links,
 		const vector<DblVec>& multi_joints, vector<Collision>& collisions) {
-	OR::RobotBase::RobotStateSaver saver = rad.Save();
 	int nlinks = links.size();
 	vector<vector<btTransform> > multi_tf(nlinks, vector<btTransform>(multi_joints.size())); // multi_tf[i_link][i_multi]
+	vector<OR::Transform> link_tfs;
 	for (int i_multi=0; i_multi<multi_joints.size(); i_multi++) {
-		rad.SetDOFValues(multi_joints[i_multi]);
+		rad.GetLinkTransforms(multi_joints[i_multi], link_tfs);
 		for (int i_link=0; i_link < nlinks; ++i_link) {
-			multi_tf[i_link][i_multi] = toBt(links[i_link]->GetTransform());
+			multi_tf[i_link][i_multi] = toBt(rad.GetLinkTransform(link_tfs, *links[i_link]));
 		}
 	}
-	rad.SetDOFValues(multi_joints[0]); // is this necessary?
-	UpdateBulletFromRave();
-	m_world->updateAabbs();
+	vector<btTransform> tfs0(nlinks);
+	for (int i_link=0; i_link < nlinks; ++i_link) {
+		tfs0[i_link] = multi_tf[i_link][0];
+	}
+	ScopedWorker worker(this);
+	UpdateWorker(*worker, links, tfs0);
 
 	for (int i_link=0; i_link < nlinks; ++i_link) {
-		assert(m_link2cow[links[i_link].get()] != NULL);
-		CollisionObjectWrapper* cow = m_link2cow[links[i_link].get()];
-		CheckShapeMultiCast(cow->getCollisionShape(), multi_tf[i_link], cow, m_world, collisions);
+		CollisionObjectWrapper* cow = worker->GetCow(links[i_link].get());
+		assert(cow != NULL);
+		CheckShapeMultiCast(cow->getCollisionShape(), multi_tf[i_link], cow, worker->world, collisions);
 	}
 	LOG_DEBUG("MultiCastVsAll checked %i links and found %i collisions\n", (int)links.size(), (int)collisions.size());
 }
@@ -1308,13 +1477,13 @@ void BulletCollisionChecker::PlotCastHull(btCollisionShape* shape, const vector<
 
 void BulletCollisionChecker::PlotCastHull(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links,
 		const vector<DblVec>& multi_joints, vector<OpenRAVE::GraphHandlePtr>& handles) {
-	OR::RobotBase::RobotStateSaver saver = rad.Save();
 	int nlinks = links.size();
 	vector<vector<btTransform> > multi_tf(nlinks, vector<btTransform>(multi_joints.size())); // multi_tf[i_link][i_multi]
+	vector<OR::Transform> link_tfs;
 	for (int i_multi=0; i_multi<multi_joints.size(); i_multi++) {
-		rad.SetDOFValues(multi_joints[i_multi]);
+		rad.GetLinkTransforms(multi_joints[i_multi], link_tfs);
 		for (int i_link=0; i_link < nlinks; ++i_link) {
-			multi_tf[i_link][i_multi] = toBt(links[i_link]->GetTransform());
+			multi_tf[i_link][i_multi] = toBt(rad.GetLinkTransform(link_tfs, *links[i_link]));
 		}
 	}
 
@@ -1,24 +1,106 @@
 #pragma once
+#include <list>
+#include <vector>
+#include <cstring>
+#include <boost/cstdint.hpp>
 
-template<class KeyT, class ValueT, unsigned bufsize>
+/**
+Least recently used cache, keyed on vectors of doubles.
+
+A lookup hashes the key, and only compares it value by value with the stored keys that have the same hash, so
+it succeeds only if the key is exactly equal to a stored one. The cache holds at most max_entries entries, and
+evicts the least recently used ones when the estimated size of the stored keys and values exceeds max_bytes.
+*/
+template<class ValueT>
 class Cache {
 public:
-  KeyT keybuf[bufsize]; // circular buffer
-  ValueT valbuf[bufsize]; // circular buffer
-  int m_i;
-  Cache() : m_i(0) {
-    memset(keybuf, 666, sizeof(keybuf));
-  }
-  void put(const KeyT& key, const ValueT& value) {
-    keybuf[m_i] = key;
-    valbuf[m_i] = value;
-    ++m_i;
-    if (m_i == bufsize) m_i = 0;
+  typedef std::vector<double> KeyT;
+
+  Cache(size_t max_entries=8, size_t max_bytes=1<<20) :
+    m_max_entries(max_entries), m_max_bytes(max_bytes), m_bytes(0), m_hits(0), m_misses(0) {}
+
+  /** nbytes is the estimated size of value, used to enforce max_bytes */
+  void put(const KeyT& key, const ValueT& value, size_t nbytes) {
+    nbytes += key.size()*sizeof(double);
+    if (m_max_entries == 0 || nbytes > m_max_bytes) return;
+    boost::uint64_t hash = hashKey(key);
+    typename std::list<Entry>::iterator it = find(key, hash);
+    if (it != m_entries.end()) erase(it);
+    m_entries.push_front(Entry(hash, key, value, nbytes));
+    m_bytes += nbytes;
+    evict();
   }
+  /** Returns NULL on a miss. The pointer stays valid until the next call to put, setLimits or clear */
   ValueT* get(const KeyT& key) {
-    KeyT* it = std::find(&keybuf[0], &keybuf[0] + bufsize, key);
-    return (it == &keybuf[0] + bufsize)
-        ? NULL
-        : &valbuf[it - &keybuf[0]];
+    typename std::list<Entry>::iterator it = find(key, hashKey(key));
+    if (it == m_entries.end()) {
+      ++m_misses;
+      return NULL;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it);
+    return &it->value;
+  }
+  void setLimits(size_t max_entries, size_t max_bytes) {
+    m_max_entries = max_entries;
+    m_max_bytes = max_bytes;
+    evict();
+  }
+  void clear() {
+    m_entries.clear();
+    m_bytes = 0;
+  }
+
+  size_t size() const {return m_entries.size();}
+  size_t bytes() const {return m_bytes;}
+  size_t hits() const {return m_hits;}
+  size_t misses() const {return m_misses;}
+
+  /** 64 bit FNV-1a hash of the bits of the values. 0 and -0 hash the same since they compare equal */
+  static boost::uint64_t hashKey(const KeyT& key) {
+    boost::uint64_t hash = 14695981039346656037ULL;
+    for (size_t i=0; i < key.size(); ++i) {
+      double val = key[i] == 0 ? 0 : key[i];
+      unsigned char bytes[sizeof(double)];
+      std::memcpy(bytes, &val, sizeof(double));
+      for (size_t j=0; j < sizeof(double); ++j) {
+        hash ^= bytes[j];
+        hash *= 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
+
+private:
+  struct Entry {
+    boost::uint64_t hash;
+    KeyT key;
+    ValueT value;
+    size_t nbytes;
+    Entry(boost::uint64_t hash, const KeyT& key, const ValueT& value, size_t nbytes) :
+      hash(hash), key(key), value(value), nbytes(nbytes) {}
+  };
+
+  typename std::list<Entry>::iterator find(const KeyT& key, boost::uint64_t hash) {
+    for (typename std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+      if (it->hash == hash && it->key == key) return it;
+    }
+    return m_entries.end();
   }
+  void erase(typename std::list<Entry>::iterator it) {
+    m_bytes -= it->nbytes;
+    m_entries.erase(it);
+  }
+  void evict() {
+    while (!m_entries.empty() && (m_entries.size() > m_max_entries || m_bytes > m_max_bytes)) {
+      erase(--m_entries.end());
+    }
+  }
+
+  std::list<Entry> m_entries; // most recently used first
+  size_t m_max_entries;
+  size_t m_max_bytes;
+  size_t m_bytes;
+  size_t m_hits;
+  size_t m_misses;
 };
@@ -41,22 +41,44 @@ void CollisionsToDistanceExpressions(const vector<Collision>& collisions, RobotA
   weights.clear();
   exprs.reserve(collisions.size());
   weights.reserve(collisions.size());
-  rad.SetDOFValues(dofvals); // since we'll be calculating jacobians
-  BOOST_FOREACH(const Collision& col, collisions) {
-    AffExpr dist(col.distance);
-    Link2Int::const_iterator itA = link2ind.find(col.linkA);
+
+  // jacobians of all the contact points, computed together
+  IntVec link_inds, rowsA(collisions.size(), -1), rowsB(collisions.size(), -1);
+  vector<OR::Vector> pts;
+  for (int i=0; i < collisions.size(); ++i) {
+    Link2Int::const_iterator itA = link2ind.find(collisions[i].linkA);
     if (itA != link2ind.end()) {
-      VectorXd dist_grad = toVector3d(col.normalB2A).transpose()*rad.PositionJacobian(itA->second, col.ptA);
-      exprInc(dist, varDot(dist_grad, vars));
-      exprInc(dist, -dist_grad.dot(toVectorXd(dofvals)));
+      rowsA[i] = 3*link_inds.size();
+      link_inds.push_back(itA->second);
+      pts.push_back(collisions[i].ptA);
     }
-    Link2Int::const_iterator itB = link2ind.find(col.linkB);
+    Link2Int::const_iterator itB = link2ind.find(collisions[i].linkB);
     if (itB != link2ind.end()) {
-      VectorXd dist_grad = -toVector3d(col.normalB2A).transpose()*rad.PositionJacobian(itB->second, col.ptB);
+      rowsB[i] = 3*link_inds.size();
+      link_inds.push_back(itB->second);
+      pts.push_back(collisions[i].ptB);
+    }
+  }
+  vector<OR::Transform> link_tfs;
+  rad.GetLinkTransforms(dofvals, link_tfs);
+  DblMatrix jacs;
+  rad.PositionJacobians(dofvals, link_tfs, link_inds, pts, jacs);
+
+  VectorXd dofvec = toVectorXd(dofvals);
+  for (int i=0; i < collisions.size(); ++i) {
+    const Collision& col = collisions[i];
+    AffExpr dist(col.distance);
+    if (rowsA[i] >= 0) {
+      VectorXd dist_grad = toVector3d(col.normalB2A).transpose()*jacs.middleRows(rowsA[i], 3);
       exprInc(dist, varDot(dist_grad, vars));
-      exprInc(dist, -dist_grad.dot(toVectorXd(dofvals)));
+      exprInc(dist, -dist_grad.dot(dofvec));
     }
-    if (itA != link2ind.end() || itB != link2ind.end()) {
+    if (rowsB[i] >= 0) {
+      VectorXd dist_grad = -toVector3d(col.normalB2A).transpose()*jacs.middleRows(rowsB[i], 3);
+      exprInc(dist, varDot(dist_grad, vars));
+      exprInc(dist, -dist_grad.dot(dofvec));
+    }
+    if (rowsA[i] >= 0 || rowsB[i] >= 0) {
       exprs.push_back(dist);
       weights.push_back(col.weight);
     }
@@ -123,16 +145,20 @@ void BeliefCollisionsToDistanceExpressions(const vector<Collision>& collisions,
 }
 
 void CollisionEvaluator::GetCollisionsCached(const DblVec& x, vector<Collision>& collisions) {
-  double key = vecSum(x);
+  DblVec key = getDblVec(x, GetVars());
   vector<Collision>* it = m_cache.get(key);
   if (it != NULL) {
-    RAVELOG_DEBUG("using cached collision check\n");
+    RAVELOG_DEBUG("using cached collision check (%i hits, %i misses)\n", (int)m_cache.hits(), (int)m_cache.misses());
     collisions = *it;
   }
   else {
-    RAVELOG_DEBUG("not using cached collision check\n");
+    RAVELOG_DEBUG("not using cached collision check (%i hits, %i misses)\n", (int)m_cache.hits(), (int)m_cache.misses());
     CalcCollisions(x, collisions);
-    m_cache.put(key, collisions);
+    size_t nbytes = collisions.capacity() * sizeof(Collision);
+    BOOST_FOREACH(const Collision& col, collisions) {
+      nbytes += col.mi.alpha.capacity()*sizeof(float) + col.mi.instance_ind.capacity()*sizeof(int);
+    }
+    m_cache.put(key, collisions, nbytes);
   }
 }
 
@@ -156,8 +182,7 @@ SingleTimestepCollisionEvaluator::SingleTimestepCollisionEvaluator(RobotAndDOFPt
 
 void SingleTimestepCollisionEvaluator::CalcCollisions(const DblVec& x, vector<Collision>& collisions) {
   DblVec dofvals = getDblVec(x, m_vars);
-  m_rad->SetDOFValues(dofvals);
-  m_cc->LinksVsAll(m_links, collisions);
+  m_cc->LinksVsAll(*m_rad, m_links, dofvals, collisions);
 }
 
 void SingleTimestepCollisionEvaluator::CalcDists(const DblVec& x, DblVec& dists, DblVec& weights) {
@@ -197,7 +222,6 @@ CastCollisionEvaluator::CastCollisionEvaluator(RobotAndDOFPtr rad, const VarVect
 void CastCollisionEvaluator::CalcCollisions(const DblVec& x, vector<Collision>& collisions) {
   DblVec dofvals0 = getDblVec(x, m_vars0);
   DblVec dofvals1 = getDblVec(x, m_vars1);
-  m_rad->SetDOFValues(dofvals0);
   m_cc->CastVsAll(*m_rad, m_links, dofvals0, dofvals1, collisions);
 }
 void CastCollisionEvaluator::CalcDistExpressions(const DblVec& x, vector<AffExpr>& exprs, DblVec& weights) {
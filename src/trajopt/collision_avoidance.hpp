@@ -15,11 +15,17 @@ struct CollisionEvaluator {
   virtual void CalcDistExpressions(const DblVec& x, vector<AffExpr>& exprs, DblVec& weights) = 0;
   virtual void CalcDists(const DblVec& x, DblVec& exprs, DblVec& weights) = 0;
   virtual void CalcCollisions(const DblVec& x, vector<Collision>& collisions) = 0;
+  /** the variables CalcCollisions depends on */
+  virtual VarVector GetVars() = 0;
+  /**
+  Same as CalcCollisions, but reuses the result of a previous call if the values of GetVars() are exactly the same,
+  so that e.g. value() and convex() of a cost at the same point only do one collision check
+  */
   void GetCollisionsCached(const DblVec& x, vector<Collision>&);
   virtual void CustomPlot(const DblVec& x, std::vector<OR::GraphHandlePtr>& handles) {}
   virtual ~CollisionEvaluator() {}
 
-  Cache<double, vector<Collision>, 3> m_cache;
+  Cache< vector<Collision> > m_cache;
 };
 typedef boost::shared_ptr<CollisionEvaluator> CollisionEvaluatorPtr;
 
@@ -41,6 +47,7 @@ public:
    */
   void CalcDists(const DblVec& x, DblVec& exprs, DblVec& weights); // appends to this vector
   void CalcCollisions(const DblVec& x, vector<Collision>& collisions);
+  VarVector GetVars() {return m_vars;}
 
   OR::EnvironmentBasePtr m_env;
   CollisionCheckerPtr m_cc;
@@ -56,6 +63,11 @@ public:
   InterpolatedCollisionEvaluator(RobotAndDOFPtr rad, const VarVector& vars0, const VarVector& vars1);
   void CalcDistExpressions(const DblVec& x, vector<AffExpr>& exprs, DblVec& weights); // appends to this vector
   void CalcDists(const DblVec& x, DblVec& dists, DblVec& weights); // appends to this vector
+  VarVector GetVars() {
+    VarVector vars = m_vars0;
+    vars.insert(vars.end(), m_vars1.begin(), m_vars1.end());
+    return vars;
+  }
 
   OR::EnvironmentBasePtr m_env;
   CollisionCheckerPtr m_cc;
@@ -74,6 +86,11 @@ public:
   void CalcDistExpressions(const DblVec& x, vector<AffExpr>& exprs, DblVec& weights); // appends to this vector
   void CalcDists(const DblVec& x, DblVec& dists, DblVec& weights); // appends to this vector
   void CalcCollisions(const DblVec& x, vector<Collision>& collisions);
+  VarVector GetVars() {
+    VarVector vars = m_vars0;
+    vars.insert(vars.end(), m_vars1.begin(), m_vars1.end());
+    return vars;
+  }
 
   // parameters:
   OR::EnvironmentBasePtr m_env;
@@ -94,6 +111,7 @@ public:
   void CalcDists(const DblVec& x, DblVec& dists, DblVec& weights); // appends to this vector
   void CalcCollisions(const DblVec& x, vector<Collision>& collisions);
 	VectorXd CalcDists(const VectorXd& theta, DblVec& weights);
+  VarVector GetVars() {return m_theta_vars;}
   void CustomPlot(const DblVec& x, std::vector<OR::GraphHandlePtr>& handles);
 
   // parameters:
@@ -116,6 +134,7 @@ public:
   virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
   virtual double value(const vector<double>&);
   virtual void Plot(const DblVec& x, OR::EnvironmentBase&, std::vector<OR::GraphHandlePtr>& handles);
+  CollisionEvaluatorPtr GetEvaluator() {return m_calc;}
 private:
   CollisionEvaluatorPtr m_calc;
   double m_dist_pen;
@@ -132,6 +151,7 @@ public:
   virtual vector<double> value(const vector<double>&);
   ConstraintType type() {return type_;}
   virtual void Plot(const DblVec& x, OR::EnvironmentBase&, std::vector<OR::GraphHandlePtr>& handles);
+  CollisionEvaluatorPtr GetEvaluator() {return m_calc;}
 private:
   CollisionEvaluatorPtr m_calc;
   double m_dist_pen;
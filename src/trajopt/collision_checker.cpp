@@ -25,6 +25,11 @@ boost::shared_ptr<CollisionChecker> CollisionChecker::GetOrCreate(OR::Environmen
 	return boost::dynamic_pointer_cast<CollisionChecker>(ud);
 }
 
+void CollisionChecker::LinksVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links, const DblVec& dofvals, vector<Collision>& collisions) {
+	OR::RobotBase::RobotStateSaver saver = rad.Save();
+	rad.SetDOFValues(dofvals);
+	LinksVsAll(links, collisions);
+}
 
 #if 0
 void CollisionPairIgnorer::ExcludePair(const KinBody::Link& link1, const KinBody::Link& link2) {
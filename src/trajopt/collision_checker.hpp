@@ -35,6 +35,8 @@ public:
   /** check link vs everything else */
   virtual void LinkVsAll(const KinBody::Link& link, vector<Collision>& collisions)=0;
   virtual void LinksVsAll(const vector<KinBody::LinkPtr>& links, vector<Collision>& collisions)=0;
+  /** check links vs everything else, with the DOFs of rad at dofvals. The robot is left at its current state */
+  virtual void LinksVsAll(RobotAndDOF& rad, const vector<KinBody::LinkPtr>& links, const DblVec& dofvals, vector<Collision>& collisions);
 
   /** check robot vs everything else. includes attached bodies */
   void BodyVsAll(const KinBody& body, vector<Collision>& collisions) {
@@ -73,6 +73,7 @@ void makeTrajVariablesAndBounds(int n_steps, RobotAndDOFPtr manip, OptProb& prob
 
   prob_out.createVariables(names, vlower, vupper);
   vars_out = VarArray(n_steps, n_dof, prob_out.getVars().data());
+  setTrajStages(prob_out, vars_out);
 
 }
 
@@ -80,8 +81,10 @@ JointPosCost::JointPosCost(const VarVector& vars, const VectorXd& vals, const Ve
     Cost("JointVel"), vars_(vars), vals_(vals), coeffs_(coeffs) {
     for (int i=0; i < vars.size(); ++i) {
       if (coeffs[i] > 0) {
-        AffExpr diff = exprSub(AffExpr(vars[i]), AffExpr(vals[i]));
-        exprInc(expr_, exprMult(exprSquare(diff), coeffs[i]));
+        IndexAffExpr diff(vars[i]);
+        exprInc(diff, -vals[i]);
+        IndexQuadExpr diff_sq = exprMult(exprSquare(diff), coeffs[i]);
+        exprAbsorb(expr_, diff_sq);
       }
     }
 }
@@ -100,10 +103,11 @@ JointVelCost::JointVelCost(const VarArray& vars, const VectorXd& coeffs) :
     Cost("JointVel"), vars_(vars), coeffs_(coeffs) {
   for (int i=0; i < vars.rows()-1; ++i) {
     for (int j=0; j < vars.cols(); ++j) {
-      AffExpr vel;
-      exprInc(vel, exprMult(vars(i,j), -1));
-      exprInc(vel, exprMult(vars(i+1,j), 1));
-      exprInc(expr_, exprMult(exprSquare(vel),coeffs_[j]));
+      IndexAffExpr vel;
+      exprInc(vel, exprMult(IndexAffExpr(vars(i,j)), -1));
+      exprInc(vel, IndexAffExpr(vars(i+1,j)));
+      IndexQuadExpr vel_sq = exprMult(exprSquare(vel), coeffs_[j]);
+      exprAbsorb(expr_, vel_sq);
     }
   }
 }
@@ -123,11 +127,12 @@ JointAccCost::JointAccCost(const VarArray& vars, const VectorXd& coeffs) :
     Cost("JointAcc"), vars_(vars), coeffs_(coeffs) {
   for (int i=0; i < vars.rows()-2; ++i) {
     for (int j=0; j < vars.cols(); ++j) {
-      AffExpr acc;
-      exprInc(acc, exprMult(vars(i,j), -1));
-      exprInc(acc, exprMult(vars(i+1,j), 2));
-      exprInc(acc, exprMult(vars(i+2,j), -1));
-      exprInc(expr_, exprMult(exprSquare(acc), coeffs_[j]));
+      IndexAffExpr acc;
+      exprInc(acc, exprMult(IndexAffExpr(vars(i,j)), -1));
+      exprInc(acc, exprMult(IndexAffExpr(vars(i+1,j)), 2));
+      exprInc(acc, exprMult(IndexAffExpr(vars(i+2,j)), -1));
+      IndexQuadExpr acc_sq = exprMult(exprSquare(acc), coeffs_[j]);
+      exprAbsorb(expr_, acc_sq);
     }
   }
 }
@@ -157,8 +162,7 @@ struct CartPoseErrCalculator : public VectorOfVector {
   {}
 //  CartPoseCostCalculator(const CartPoseCostCalculator& other) : pose_(other.pose_), manip_(other.manip_), rs_(other.rs_) {}
   VectorXd operator()(const VectorXd& dof_vals) const {
-    manip_->SetDOFValues(toDblVec(dof_vals));
-    OR::Transform newpose = link_->GetTransform();
+    OR::Transform newpose = manip_->GetLinkTransform(toDblVec(dof_vals), *link_);
 
     OR::Transform pose_err = pose_inv_ * newpose;
     VectorXd err = coeffs_.cwiseProduct(concat(rotVec(pose_err.rot), toVector3d(pose_err.trans)));
@@ -174,8 +178,7 @@ CartPoseCost::CartPoseCost(const VarVector& vars, const OR::Transform& pose, con
 void CartPoseCost::Plot(const DblVec& x, OR::EnvironmentBase& env, std::vector<OR::GraphHandlePtr>& handles) {
   CartPoseErrCalculator* calc = static_cast<CartPoseErrCalculator*>(f_.get());
   DblVec dof_vals = getDblVec(x, vars_);
-  calc->manip_->SetDOFValues(dof_vals);
-  OR::Transform target = calc->pose_inv_.inverse(), cur = calc->link_->GetTransform();
+  OR::Transform target = calc->pose_inv_.inverse(), cur = calc->manip_->GetLinkTransform(dof_vals, *calc->link_);
   PlotAxes(env, cur, .1,  handles);
   PlotAxes(env, target, .1,  handles);
   handles.push_back(env.drawarrow(cur.trans, target.trans, .01, OR::Vector(1,0,1,1)));
@@ -193,8 +196,7 @@ void CartPoseConstraint::Plot(const DblVec& x, OR::EnvironmentBase& env, std::ve
   // IDENTITCAL TO CartPoseCost::Plot
   CartPoseErrCalculator* calc = static_cast<CartPoseErrCalculator*>(f_.get());
   DblVec dof_vals = getDblVec(x, vars_);
-  calc->manip_->SetDOFValues(dof_vals);
-  OR::Transform target = calc->pose_inv_.inverse(), cur = calc->link_->GetTransform();
+  OR::Transform target = calc->pose_inv_.inverse(), cur = calc->manip_->GetLinkTransform(dof_vals, *calc->link_);
   PlotAxes(env, cur, .1,  handles);
   PlotAxes(env, target, .1,  handles);
   handles.push_back(env.drawarrow(cur.trans, target.trans, .01, OR::Vector(1,0,1,1)));
@@ -211,8 +213,7 @@ struct CartPositionErrCalculator {
   link_(link)
   {}
   VectorXd operator()(const VectorXd& dof_vals) {
-    manip_->SetDOFValues(toDblVec(dof_vals));
-    OR::Transform newpose = link_->GetTransform();
+    OR::Transform newpose = manip_->GetLinkTransform(toDblVec(dof_vals), *link_);
     return pt_world_ - toVector3d(newpose.trans);
   }
 };
@@ -227,12 +228,14 @@ struct CartVelJacCalculator : MatrixOfVector {
   MatrixXd operator()(const VectorXd& dof_vals) const {
     int n_dof = manip_->GetDOF();
     MatrixXd out(6, 2*n_dof);
-    manip_->SetDOFValues(toDblVec(dof_vals.topRows(n_dof)));
-    OR::Transform pose0 = link_->GetTransform();
-    MatrixXd jac0 = manip_->PositionJacobian(link_->GetIndex(), pose0.trans);
-    manip_->SetDOFValues(toDblVec(dof_vals.bottomRows(n_dof)));
-    OR::Transform pose1 = link_->GetTransform();
-    MatrixXd jac1 = manip_->PositionJacobian(link_->GetIndex(), pose1.trans);
+    DblVec dofs0 = toDblVec(dof_vals.topRows(n_dof)), dofs1 = toDblVec(dof_vals.bottomRows(n_dof));
+    vector<OR::Transform> link_tfs;
+    manip_->GetLinkTransforms(dofs0, link_tfs);
+    OR::Transform pose0 = manip_->GetLinkTransform(link_tfs, *link_);
+    MatrixXd jac0 = manip_->PositionJacobian(dofs0, link_tfs, link_->GetIndex(), pose0.trans);
+    manip_->GetLinkTransforms(dofs1, link_tfs);
+    OR::Transform pose1 = manip_->GetLinkTransform(link_tfs, *link_);
+    MatrixXd jac1 = manip_->PositionJacobian(dofs1, link_tfs, link_->GetIndex(), pose1.trans);
     out.block(0,0,3,n_dof) = -jac0;
     out.block(0,n_dof,3,n_dof) = jac1;
     out.block(3,0,3,n_dof) = jac0;
@@ -250,10 +253,8 @@ struct CartVelCalculator : VectorOfVector {
 
   VectorXd operator()(const VectorXd& dof_vals) const {
     int n_dof = manip_->GetDOF();
-    manip_->SetDOFValues(toDblVec(dof_vals.topRows(n_dof)));
-    OR::Transform pose0 = link_->GetTransform();
-    manip_->SetDOFValues(toDblVec(dof_vals.bottomRows(n_dof)));
-    OR::Transform pose1 = link_->GetTransform();
+    OR::Transform pose0 = manip_->GetLinkTransform(toDblVec(dof_vals.topRows(n_dof)), *link_);
+    OR::Transform pose1 = manip_->GetLinkTransform(toDblVec(dof_vals.bottomRows(n_dof)), *link_);
     VectorXd out(6);
     out.topRows(3) = toVector3d(pose1.trans - pose0.trans - OR::Vector(limit_,limit_,limit_));
     out.bottomRows(3) = toVector3d( - pose1.trans + pose0.trans - OR::Vector(limit_, limit_, limit_));
@@ -288,8 +289,7 @@ struct UpErrorCalculator {
     perp_basis_.row(1) = perp1.transpose();
   }
   VectorXd operator()(const VectorXd& dof_vals) {
-    manip_->SetDOFValues(toDblVec(dof_vals));
-    OR::Transform newpose = link_->GetTransform();
+    OR::Transform newpose = manip_->GetLinkTransform(toDblVec(dof_vals), *link_);
     return perp_basis_*(toRot(newpose.rot) * dir_local_ - goal_dir_world_);
   }
 };
@@ -34,10 +34,11 @@ public:
   JointPosCost(const VarVector& vars, const VectorXd& vals, const VectorXd& coeffs);
   virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
   virtual double value(const vector<double>&);
+  virtual bool isConvexConstant() const {return true;}
 private:
   VarVector vars_;
   VectorXd vals_, coeffs_;
-  QuadExpr expr_;
+  IndexQuadExpr expr_;
 };
 
 class JointVelCost : public Cost {
@@ -45,10 +46,11 @@ public:
   JointVelCost(const VarArray& traj, const VectorXd& coeffs);
   virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
   virtual double value(const vector<double>&);
+  virtual bool isConvexConstant() const {return true;}
 private:
   VarArray vars_;
   VectorXd coeffs_;
-  QuadExpr expr_;
+  IndexQuadExpr expr_;
 };
 
 class JointAccCost : public Cost {
@@ -56,10 +58,11 @@ public:
   JointAccCost(const VarArray& traj, const VectorXd& coeffs);
   virtual ConvexObjectivePtr convex(const vector<double>& x, Model* model);
   virtual double value(const vector<double>&);
+  virtual bool isConvexConstant() const {return true;}
 private:
   VarArray vars_;
   VectorXd coeffs_;
-  QuadExpr expr_;
+  IndexQuadExpr expr_;
 };
 
 
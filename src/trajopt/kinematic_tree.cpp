@@ -0,0 +1,209 @@
+#include "trajopt/kinematic_tree.hpp"
+#include "trajopt/robot_and_dof.hpp"
+#include "trajopt/utils.hpp"
+#include "utils/logging.hpp"
+#include <boost/foreach.hpp>
+#include <algorithm>
+using namespace OpenRAVE;
+using namespace std;
+
+namespace {
+
+bool TransformsMatch(const OR::Transform& a, const OR::Transform& b) {
+  const double tol = 1e-5;
+  // q and -q are the same rotation
+  return (a.trans - b.trans).lengthsqr3() < tol*tol
+      && min((a.rot - b.rot).lengthsqr4(), (a.rot + b.rot).lengthsqr4()) < tol*tol;
+}
+
+}
+
+namespace trajopt {
+
+KinematicTreePtr KinematicTree::Create(const RobotAndDOF& rad) {
+  KinematicTreePtr tree(new KinematicTree());
+  if (!tree->Init(rad)) return KinematicTreePtr();
+  return tree;
+}
+
+bool KinematicTree::Init(const RobotAndDOF& rad) {
+  RobotBasePtr robot = rad.GetRobot();
+  IntVec joint_inds = rad.GetJointIndices();
+  m_robot = robot.get();
+  m_affinedofs = rad.GetAffineDOFs();
+  m_rotationaxis = rad.GetRotationAxis();
+  m_n_joint_dofs = joint_inds.size();
+  m_base = robot->GetTransform();
+  if (m_affinedofs & (DOF_Rotation3D | DOF_RotationQuat)) {
+    LOG_INFO("no kinematic tree for %s: only DOF_RotationAxis is supported", robot->GetName().c_str());
+    return false;
+  }
+
+  const vector<KinBody::LinkPtr>& links = robot->GetLinks();
+  int n_links = links.size();
+  m_links.assign(n_links, LinkInfo());
+  for (int i=0; i < n_links; ++i) {
+    m_links[i].left = m_base.inverse() * links[i]->GetTransform();
+  }
+
+  vector<KinBody::JointPtr> joints = robot->GetJoints();
+  joints.insert(joints.end(), robot->GetPassiveJoints().begin(), robot->GetPassiveJoints().end());
+  BOOST_FOREACH(const KinBody::JointPtr& joint, joints) {
+    KinBody::LinkPtr parent = joint->GetHierarchyParentLink(), child = joint->GetHierarchyChildLink();
+    if (!child) continue;
+    LinkInfo& info = m_links[child->GetIndex()];
+    if (parent) {
+      info.parent = parent->GetIndex();
+      info.left = parent->GetTransform().inverse() * child->GetTransform();
+    }
+    for (int iaxis=0; iaxis < joint->GetDOF(); ++iaxis) {
+      if (joint->IsMimic(iaxis)) {
+        vector<int> mimic_inds;
+        joint->GetMimicDOFIndices(mimic_inds, iaxis);
+        BOOST_FOREACH(int ind, mimic_inds) {
+          if (find(joint_inds.begin(), joint_inds.end(), ind) != joint_inds.end()) {
+            LOG_INFO("no kinematic tree for %s: joint %s mimics an active DOF", robot->GetName().c_str(), joint->GetName().c_str());
+            return false;
+          }
+        }
+        continue;
+      }
+      int col = find(joint_inds.begin(), joint_inds.end(), joint->GetDOFIndex() + iaxis) - joint_inds.begin();
+      if (joint->GetDOFIndex() < 0 || col == m_n_joint_dofs) continue;
+      if (joint->GetDOF() != 1 || !(joint->IsRevolute(0) || joint->IsPrismatic(0))) {
+        LOG_INFO("no kinematic tree for %s: active joint %s isn't a revolute or prismatic joint with one DOF",
+            robot->GetName().c_str(), joint->GetName().c_str());
+        return false;
+      }
+      info.dof = col;
+      info.revolute = joint->IsRevolute(0);
+      info.left = joint->GetInternalHierarchyLeftTransform();
+      info.right = joint->GetInternalHierarchyRightTransform();
+      info.axis = joint->GetInternalHierarchyAxis(0);
+      info.offset = joint->GetWrapOffset(0);
+    }
+  }
+
+  vector<bool> placed(n_links, false);
+  while ((int)m_order.size() < n_links) {
+    size_t n_placed = m_order.size();
+    for (int i=0; i < n_links; ++i) {
+      if (!placed[i] && (m_links[i].parent < 0 || placed[m_links[i].parent])) {
+        m_order.push_back(i);
+        placed[i] = true;
+      }
+    }
+    if (m_order.size() == n_placed) {
+      LOG_INFO("no kinematic tree for %s: its links don't form a tree", robot->GetName().c_str());
+      return false;
+    }
+  }
+
+  m_chains.resize(n_links);
+  BOOST_FOREACH(int i, m_order) {
+    if (m_links[i].parent >= 0) m_chains[i] = m_chains[m_links[i].parent];
+    if (m_links[i].dof >= 0) {
+      m_chains[i].push_back(m_active.size());
+      m_active.push_back(i);
+    }
+  }
+
+  vector<KinBodyPtr> grabbed;
+  robot->GetGrabbed(grabbed);
+  BOOST_FOREACH(const KinBodyPtr& body, grabbed) {
+    KinBody::LinkPtr grabber = robot->IsGrabbing(body);
+    assert(grabber);
+    BOOST_FOREACH(const KinBody::LinkPtr& link, body->GetLinks()) {
+      m_grabbed[link.get()] = make_pair(grabber->GetIndex(), grabber->GetTransform().inverse() * link->GetTransform());
+    }
+  }
+
+  vector<OR::Transform> link_tfs;
+  ComputeTransforms(rad.GetDOFValues(), link_tfs);
+  for (int i=0; i < n_links; ++i) {
+    if (!TransformsMatch(link_tfs[i], links[i]->GetTransform())) {
+      LOG_WARN("no kinematic tree for %s: wrong transform for link %s", robot->GetName().c_str(), links[i]->GetName().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+OR::Transform KinematicTree::BaseTransform(const DblVec& dofs) const {
+  if (m_affinedofs == 0) return m_base;
+  // same as RobotAndDOF::SetDOFValues
+  OR::Transform T;
+  OR::RaveGetTransformFromAffineDOFValues(T, dofs.begin()+m_n_joint_dofs, m_affinedofs, m_rotationaxis, true);
+  return T;
+}
+
+void KinematicTree::ComputeTransforms(const DblVec& dofs, vector<OR::Transform>& link_tfs) const {
+  OR::Transform base = BaseTransform(dofs);
+  link_tfs.resize(m_links.size());
+  BOOST_FOREACH(int i, m_order) {
+    const LinkInfo& info = m_links[i];
+    const OR::Transform& parent_tf = info.parent >= 0 ? link_tfs[info.parent] : base;
+    if (info.dof < 0) {
+      link_tfs[i] = parent_tf * info.left;
+    }
+    else {
+      OR::Transform motion;
+      double value = dofs[info.dof] - info.offset;
+      if (info.revolute) motion.rot = OR::geometry::quatFromAxisAngle(info.axis, value);
+      else motion.trans = info.axis * value;
+      link_tfs[i] = parent_tf * info.left * motion * info.right;
+    }
+  }
+}
+
+bool KinematicTree::GetTransform(const vector<OR::Transform>& link_tfs, const KinBody::Link& link, OR::Transform& tf) const {
+  map<const KinBody::Link*, std::pair<int, OR::Transform> >::const_iterator it = m_grabbed.find(&link);
+  if (it != m_grabbed.end()) {
+    tf = link_tfs[it->second.first] * it->second.second;
+    return true;
+  }
+  if (link.GetParent().get() != m_robot) return false;
+  tf = link_tfs[link.GetIndex()];
+  return true;
+}
+
+DblMatrix KinematicTree::PositionJacobian(const DblVec& dofs, const vector<OR::Transform>& link_tfs, int link_ind, const OR::Vector& pt) const {
+  DblMatrix jac;
+  PositionJacobians(dofs, link_tfs, IntVec(1, link_ind), vector<OR::Vector>(1, pt), jac);
+  return jac;
+}
+
+void KinematicTree::PositionJacobians(const DblVec& dofs, const vector<OR::Transform>& link_tfs, const IntVec& link_inds,
+    const vector<OR::Vector>& pts, DblMatrix& jacs) const {
+  assert(link_inds.size() == pts.size());
+  OR::Transform base = BaseTransform(dofs);
+  // world axis and anchor of each active joint
+  vector<OR::Vector> axes(m_active.size()), anchors(m_active.size());
+  for (int j=0; j < m_active.size(); ++j) {
+    const LinkInfo& info = m_links[m_active[j]];
+    OR::Transform frame = (info.parent >= 0 ? link_tfs[info.parent] : base) * info.left;
+    axes[j] = frame.rotate(info.axis);
+    anchors[j] = frame.trans;
+  }
+  const int translation_dofs[3] = {DOF_X, DOF_Y, DOF_Z};
+  int rotation_col = (m_affinedofs & DOF_RotationAxis) ? m_n_joint_dofs + RaveGetIndexFromAffineDOF(m_affinedofs, DOF_RotationAxis) : -1;
+
+  jacs.setZero(3*pts.size(), dofs.size());
+  for (int k=0; k < pts.size(); ++k) {
+    const OR::Vector& pt = pts[k];
+    BOOST_FOREACH(int j, m_chains[link_inds[k]]) {
+      const LinkInfo& info = m_links[m_active[j]];
+      jacs.block<3,1>(3*k, info.dof) = toVector3d(info.revolute ? axes[j].cross(pt - anchors[j]) : axes[j]);
+    }
+    for (int i=0; i < 3; ++i) {
+      if (m_affinedofs & translation_dofs[i]) {
+        jacs(3*k+i, m_n_joint_dofs + RaveGetIndexFromAffineDOF(m_affinedofs, (DOFAffine)translation_dofs[i])) = 1;
+      }
+    }
+    if (rotation_col >= 0) {
+      jacs.block<3,1>(3*k, rotation_col) = toVector3d(m_rotationaxis.cross(pt - base.trans));
+    }
+  }
+}
+
+}
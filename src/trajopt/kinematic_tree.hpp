@@ -0,0 +1,77 @@
+#pragma once
+#include "typedefs.hpp"
+#include <openrave/openrave.h>
+
+namespace trajopt {
+
+class RobotAndDOF;
+
+/**
+Forward kinematics of a robot, compiled once from its OpenRAVE description, so that link transforms and
+jacobians can be computed for any values of the DOFs of a RobotAndDOF without setting them on the robot.
+
+The links are stored in a flat array, traversed in an order where every link comes after its parent. Each
+link holds its transform relative to its parent: the fixed transforms on both sides of the joint between
+them and the axis of that joint, if it is one of the active DOFs. Everything else, i.e. the inactive joints,
+the base transform if it isn't an affine DOF and the bodies the robot grabs, is frozen at the state the robot
+was in when the tree was built, so it has to be rebuilt when that state changes (see RobotAndDOF::UpdateKinematics).
+
+All the methods are const and write into buffers owned by the caller, so a tree can be used from several
+threads at once.
+*/
+class TRAJOPT_API KinematicTree {
+public:
+  /**
+  Returns NULL if the tree can't represent the DOFs of rad: active joints with several axes, or that are neither
+  revolute nor prismatic, or that drive mimic joints, and DOF_Rotation3D or DOF_RotationQuat. Also returns NULL
+  if the tree doesn't reproduce the current transforms of the links.
+  */
+  static boost::shared_ptr<KinematicTree> Create(const RobotAndDOF& rad);
+
+  int NumLinks() const {return m_links.size();}
+  /** link_tfs[i] is set to the transform of robot->GetLinks()[i] */
+  void ComputeTransforms(const DblVec& dofs, vector<OR::Transform>& link_tfs) const;
+  /**
+  Transform of a link of the robot or of a body it was grabbing when the tree was built, from the output of
+  ComputeTransforms. Returns false for any other link
+  */
+  bool GetTransform(const vector<OR::Transform>& link_tfs, const KinBody::Link& link, OR::Transform& tf) const;
+  /** Same as RobotBase::CalculateActiveJacobian, with link_tfs computed by ComputeTransforms(dofs) */
+  DblMatrix PositionJacobian(const DblVec& dofs, const vector<OR::Transform>& link_tfs, int link_ind, const OR::Vector& pt) const;
+  /**
+  Jacobians of several points at once: rows 3*i to 3*i+2 of jacs are set to the jacobian of pts[i], attached to link
+  link_inds[i]. The world axes of the joints are only computed once, so this is much cheaper than one call per point
+  */
+  void PositionJacobians(const DblVec& dofs, const vector<OR::Transform>& link_tfs, const IntVec& link_inds,
+      const vector<OR::Vector>& pts, DblMatrix& jacs) const;
+
+private:
+  struct LinkInfo {
+    int parent; // index of the parent link, or -1 if the link is attached to the base
+    int dof; // index of the active DOF that moves the link relative to its parent, or -1
+    bool revolute;
+    // transform from the parent: left * (motion along axis) * right, or just left if dof == -1
+    OR::Transform left, right;
+    OR::Vector axis;
+    double offset;
+    LinkInfo() : parent(-1), dof(-1), revolute(false), offset(0) {}
+  };
+
+  KinematicTree() : m_robot(NULL), m_affinedofs(0), m_n_joint_dofs(0) {}
+  bool Init(const RobotAndDOF& rad);
+  OR::Transform BaseTransform(const DblVec& dofs) const;
+
+  const OR::RobotBase* m_robot;
+  vector<LinkInfo> m_links;
+  IntVec m_order; // parents first
+  IntVec m_active; // links moved by active joints, parents first
+  vector<IntVec> m_chains; // indices in m_active of the links between the base and each link
+  map<const KinBody::Link*, std::pair<int, OR::Transform> > m_grabbed; // grabber link index, transform from it
+  OR::Transform m_base;
+  int m_affinedofs;
+  OR::Vector m_rotationaxis;
+  int m_n_joint_dofs;
+};
+typedef boost::shared_ptr<KinematicTree> KinematicTreePtr;
+
+}
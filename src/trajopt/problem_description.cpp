@@ -3,6 +3,7 @@
 #include <boost/foreach.hpp>
 #include "utils/logging.hpp"
 #include "sco/expr_ops.hpp"
+#include "sco/sco_common.hpp"
 #include "trajopt/kinematic_constraints.hpp"
 #include "trajopt/belief_constraints.hpp"
 #include "trajopt/collision_avoidance.hpp"
@@ -129,6 +130,15 @@ void BasicInfo::fromJson(const Json::Value& v) {
 	childFromJson(v, robot, "robot", string(""));
 	childFromJson(v, dofs_fixed, "dofs_fixed", IntVec());
 	childFromJson(v, belief_space, "belief_space", false);
+	childFromJson(v, max_time, "max_time", (double)INFINITY);
+	childFromJson(v, optimizer, "optimizer", string("sqp"));
+	if (optimizer != "sqp" && optimizer != "augmented_lagrangian") {
+		PRINT_AND_THROW(boost::format("optimizer %s not valid. valid values: sqp augmented_lagrangian")%optimizer);
+	}
+	childFromJson(v, num_threads, "num_threads", 1);
+	if (num_threads < 1) {
+		PRINT_AND_THROW(boost::format("num_threads must be at least 1, got %i")%num_threads);
+	}
 }
 
 
@@ -302,7 +312,10 @@ void CntInfo::RegisterMaker(const std::string& type, MakerFunc f) {
 
 TrajOptResult::TrajOptResult(OptResults& opt, TrajOptProb& prob) :
 				  cost_vals(opt.cost_vals),
-				  cnt_viols(opt.cnt_viols) {
+				  cnt_viols(opt.cnt_viols),
+				  cnt_coeffs(opt.cnt_coeffs),
+				  status(statusToString(opt.status)),
+				  feasible(opt.cnt_viols.empty() || vecMax(opt.cnt_viols) < 1e-4) {
 	BOOST_FOREACH(const CostPtr& cost, prob.getCosts()) {
 		cost_names.push_back(cost->name());
 	}
@@ -310,6 +323,42 @@ TrajOptResult::TrajOptResult(OptResults& opt, TrajOptProb& prob) :
 		cnt_names.push_back(cnt->name());
 	}
 	traj = getTraj(opt.x, prob.GetVars());
+	iterations = IterationRecordsToJson(opt.iterations, cost_names, cnt_names);
+}
+
+static Json::Value namedTimesToJson(const vector<string>& names, const DblVec& times) {
+	Json::Value out(Json::arrayValue);
+	for (size_t i=0; i < times.size(); ++i) {
+		Json::Value entry;
+		entry["name"] = names[i];
+		entry["time"] = times[i];
+		out.append(entry);
+	}
+	return out;
+}
+
+Json::Value IterationRecordsToJson(const vector<IterationRecord>& records,
+		const vector<string>& cost_names, const vector<string>& cnt_names) {
+	Json::Value out(Json::arrayValue);
+	BOOST_FOREACH(const IterationRecord& rec, records) {
+		Json::Value v;
+		v["merit_coeff"] = rec.merit_coeff;
+		v["trust_box_size"] = rec.trust_box_size;
+		v["callback_time"] = rec.callback_time;
+		v["convexify_time"] = rec.convexify_time;
+		v["model_time"] = rec.model_time;
+		v["qp_time"] = rec.qp_time;
+		v["eval_time"] = rec.eval_time;
+		v["cost_convexify_times"] = namedTimesToJson(cost_names, rec.cost_convexify_times);
+		v["cnt_convexify_times"] = namedTimesToJson(cnt_names, rec.cnt_convexify_times);
+		v["n_qp_solves"] = rec.n_qp_solves;
+		v["n_eval_rounds"] = rec.n_eval_rounds;
+		v["n_vars"] = rec.n_vars;
+		v["n_cnts"] = rec.n_cnts;
+		v["n_nonzeros"] = rec.n_nonzeros;
+		out.append(v);
+	}
+	return out;
 }
 
 Vector3d endEffectorPosition(BeliefRobotAndDOFPtr brad, VectorXd dofs) {
@@ -609,11 +658,21 @@ VectorXd SimulateAndReplan(const Json::Value& root, OpenRAVE::EnvironmentBasePtr
 
 TrajOptResultPtr OptimizeProblem(TrajOptProbPtr prob, bool plot) {
 	RobotBase::RobotStateSaver saver = prob->GetRAD()->Save();
-	BasicTrustRegionSQP opt(prob);
+	prob->GetRAD()->UpdateKinematics(); // the robot may have moved since the problem was constructed
+	boost::shared_ptr<BasicTrustRegionSQP> optptr;
+	if (prob->optimizer == "augmented_lagrangian") optptr.reset(new AugmentedLagrangianSQP(prob));
+	else optptr.reset(new BasicTrustRegionSQP(prob));
+	BasicTrustRegionSQP& opt = *optptr;
 	opt.max_iter_ = 100;
 	opt.min_approx_improve_frac_ = .001;
 	opt.merit_error_coeff_ = 20;
 	opt.max_merit_coeff_increases_ = 10;
+	opt.max_time_ = prob->max_time;
+	opt.num_threads_ = prob->num_threads;
+	if (opt.num_threads_ > 1 && (prob->belief_space || !prob->GetRAD()->GetKinematics())) {
+		LOG_WARN("evaluating the costs on one thread, since they set the DOF values of the robot");
+		opt.num_threads_ = 1;
+	}
 
 	if (plot) opt.addCallback(PlotCallback(*prob));
 	//  opt.addCallback(boost::bind(&PlotCosts, boost::ref(prob->getCosts()),boost::ref(*prob->GetRAD()), boost::ref(prob->GetVars()), _1));
@@ -638,6 +697,9 @@ TrajOptProbPtr ConstructProblem(const ProblemConstructionInfo& pci) {
 	TrajOptProbPtr prob(new TrajOptProb());
 	const BasicInfo& bi = pci.basic_info;
 	prob->belief_space = bi.belief_space;
+	prob->max_time = bi.max_time;
+	prob->optimizer = bi.optimizer;
+	prob->num_threads = bi.num_threads;
 	int n_steps = bi.n_steps;
 
 	prob->m_rad = pci.rad;
@@ -675,6 +737,7 @@ TrajOptProbPtr ConstructProblem(const ProblemConstructionInfo& pci) {
 		prob->m_traj_vars = VarArray(n_steps, b_dim + u_dim, prob->vars_.data());
 	else
 		prob->m_traj_vars = VarArray(n_steps, n_dof, prob->vars_.data());
+	setTrajStages(*prob, prob->m_traj_vars);
 
 	DblVec cur_dofvals = prob->m_rad->GetDOFValues();
 
@@ -727,7 +790,7 @@ TrajOptProbPtr ConstructProblem(const Json::Value& root, OpenRAVE::EnvironmentBa
 }
 
 
-TrajOptProb::TrajOptProb(int n_steps, BeliefRobotAndDOFPtr rad) : m_rad(rad) {
+TrajOptProb::TrajOptProb(int n_steps, BeliefRobotAndDOFPtr rad) : belief_space(false), max_time(INFINITY), optimizer("sqp"), num_threads(1), m_rad(rad) {
 	DblVec lower, upper;
 	m_rad->GetDOFLimits(lower, upper);
 	int n_dof = m_rad->GetDOF();
@@ -742,11 +805,12 @@ TrajOptProb::TrajOptProb(int n_steps, BeliefRobotAndDOFPtr rad) : m_rad(rad) {
 	}
 	createVariables(names, vlower, vupper);
 	m_traj_vars = VarArray(n_steps, n_dof, getVars().data());
+	setTrajStages(*this, m_traj_vars);
 
 }
 
 
-TrajOptProb::TrajOptProb() {
+TrajOptProb::TrajOptProb() : belief_space(false), max_time(INFINITY), optimizer("sqp"), num_threads(1) {
 }
 
 void PoseCostInfo::fromJson(const Value& v) {
@@ -2,7 +2,7 @@
 #include "json_marshal.hpp"
 #include <boost/function.hpp>
 
-namespace sco{struct OptResults;}
+namespace sco{struct OptResults; struct IterationRecord;}
 
 namespace trajopt {
 
@@ -53,6 +53,9 @@ public:
 	friend TrajOptProbPtr ConstructProblem(const ProblemConstructionInfo&);
 
 	bool belief_space;
+	double max_time; // seconds, see BasicTrustRegionSQP::max_time_
+	string optimizer; // see BasicInfo::optimizer
+	int num_threads; // see BasicInfo::num_threads
 private:
 	VarArray m_traj_vars;
 	BeliefRobotAndDOFPtr m_rad;
@@ -63,10 +66,21 @@ private:
 struct TRAJOPT_API TrajOptResult {
 	vector<string> cost_names, cnt_names;
 	vector<double> cost_vals, cnt_viols;
+	vector<double> cnt_coeffs; // penalty coefficients of the constraints in the merit function, see OptResults
 	TrajArray traj;
+	string status;
+	bool feasible; // whether traj satisfies the constraints, to the default tolerance of BasicTrustRegionSQP
+	Json::Value iterations; // see IterationRecordsToJson
 	TrajOptResult(OptResults& opt, TrajOptProb& prob);
 };
 
+/**
+The per-iteration timings and subproblem sizes of the optimizer (sco::IterationRecord) as a JSON array,
+with the convexification time of every cost and constraint next to its name
+*/
+Json::Value TRAJOPT_API IterationRecordsToJson(const vector<IterationRecord>& records,
+		const vector<string>& cost_names, const vector<string>& cnt_names);
+
 struct BasicInfo  {
 	bool start_fixed;
 	int n_steps;
@@ -74,6 +88,14 @@ struct BasicInfo  {
 	string robot; // optional
 	IntVec dofs_fixed; // optional
 	bool belief_space; // optional
+	double max_time; // optional, seconds. when it runs out, the best trajectory found so far is returned
+	string optimizer; // optional. "sqp" (BasicTrustRegionSQP, default) or "augmented_lagrangian" (AugmentedLagrangianSQP)
+	/**
+	optional, default 1. number of threads that evaluate the costs and constraints, e.g. the collision checks of
+	all the timesteps at once. Ignored in belief space and when the robot needs its DOF values set to compute
+	link transforms (RobotAndDOF::GetKinematics() is NULL). Adding costs or constraints from python resets it to 1
+	*/
+	int num_threads;
 	void fromJson(const Json::Value& v);
 };
 
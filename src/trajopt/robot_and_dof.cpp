@@ -3,12 +3,22 @@
 #include "trajopt/rave_utils.hpp"
 #include "trajopt/utils.hpp"
 #include "utils/math.hpp"
+#include <boost/format.hpp>
 using namespace OpenRAVE;
 using namespace util;
 using namespace std;
 
 namespace trajopt {
 
+RobotAndDOF::RobotAndDOF(OR::RobotBasePtr _robot, const IntVec& _joint_inds, int _affinedofs, const OR::Vector _rotationaxis) :
+  robot(_robot), joint_inds(_joint_inds), affinedofs(_affinedofs), rotationaxis(_rotationaxis) {
+  UpdateKinematics();
+}
+
+void RobotAndDOF::UpdateKinematics() {
+  kinematics = KinematicTree::Create(*this);
+}
+
 void RobotAndDOF::SetDOFValues(const DblVec& dofs) {
   if (affinedofs != 0) {
     OR::Transform T;
@@ -71,6 +81,56 @@ void RobotAndDOF::GetDOFLimits(DblVec& lower, DblVec& upper) const {
 int RobotAndDOF::GetDOF() const {
   return joint_inds.size() + RaveGetAffineDOF(affinedofs);
 }
+void RobotAndDOF::GetLinkTransforms(const DblVec& dofs, vector<OR::Transform>& link_tfs) const {
+  if (kinematics) {
+    kinematics->ComputeTransforms(dofs, link_tfs);
+    return;
+  }
+  OR::RobotBase::RobotStateSaver saver = const_cast<RobotAndDOF*>(this)->Save();
+  const_cast<RobotAndDOF*>(this)->SetDOFValues(dofs);
+  robot->GetLinkTransformations(link_tfs);
+}
+
+OR::Transform RobotAndDOF::GetLinkTransform(const vector<OR::Transform>& link_tfs, const KinBody::Link& link) const {
+  OR::Transform tf;
+  if (kinematics && kinematics->GetTransform(link_tfs, link, tf)) return tf;
+  if (link.GetParent() == robot) return link_tfs[link.GetIndex()];
+  // grabbed bodies move rigidly with the link that grabs them
+  KinBody::LinkPtr grabber = robot->IsGrabbing(link.GetParent());
+  if (!grabber) PRINT_AND_THROW(boost::format("link %s is neither part of nor grabbed by %s")%link.GetName()%robot->GetName());
+  return link_tfs[grabber->GetIndex()] * grabber->GetTransform().inverse() * link.GetTransform();
+}
+
+OR::Transform RobotAndDOF::GetLinkTransform(const DblVec& dofs, const KinBody::Link& link) const {
+  vector<OR::Transform> link_tfs;
+  GetLinkTransforms(dofs, link_tfs);
+  return GetLinkTransform(link_tfs, link);
+}
+
+DblMatrix RobotAndDOF::PositionJacobian(const DblVec& dofs, const vector<OR::Transform>& link_tfs, int link_ind, const OR::Vector& pt) const {
+  if (kinematics) return kinematics->PositionJacobian(dofs, link_tfs, link_ind, pt);
+  OR::RobotBase::RobotStateSaver saver = const_cast<RobotAndDOF*>(this)->Save();
+  const_cast<RobotAndDOF*>(this)->SetDOFValues(dofs);
+  return PositionJacobian(link_ind, pt);
+}
+
+void RobotAndDOF::PositionJacobians(const DblVec& dofs, const vector<OR::Transform>& link_tfs, const IntVec& link_inds,
+    const vector<OR::Vector>& pts, DblMatrix& jacs) const {
+  if (kinematics) {
+    kinematics->PositionJacobians(dofs, link_tfs, link_inds, pts, jacs);
+    return;
+  }
+  OR::RobotBase::RobotStateSaver saver = const_cast<RobotAndDOF*>(this)->Save();
+  const_cast<RobotAndDOF*>(this)->SetDOFValues(dofs);
+  const_cast<RobotAndDOF*>(this)->SetRobotActiveDOFs();
+  jacs.resize(3*pts.size(), GetDOF());
+  vector<double> jacdata;
+  for (int k=0; k < pts.size(); ++k) {
+    robot->CalculateActiveJacobian(link_inds[k], pts[k], jacdata);
+    jacs.middleRows(3*k, 3) = Eigen::Map<DblMatrix>(jacdata.data(), 3, GetDOF());
+  }
+}
+
 DblMatrix RobotAndDOF::PositionJacobian(int link_ind, const OR::Vector& pt) const {
   OR::RobotBase::RobotStateSaver saver = const_cast<RobotAndDOF*>(this)->Save();
   const_cast<RobotAndDOF*>(this)->SetRobotActiveDOFs();
@@ -1,5 +1,6 @@
 #pragma once
 #include "typedefs.hpp"
+#include "kinematic_tree.hpp"
 #include <openrave/openrave.h>
 
 namespace trajopt {
@@ -7,18 +8,39 @@ namespace trajopt {
 
 /**
 Stores an OpenRAVE robot and the active degrees of freedom  
+
+The methods that take DOF values compute the link transforms with a KinematicTree, so they leave the robot
+alone and can be called from several threads. If the tree can't handle the DOFs, they fall back to setting
+the DOF values on the robot and restoring them.
 */
 class TRAJOPT_API RobotAndDOF {
 public:
-  RobotAndDOF(OR::RobotBasePtr _robot, const IntVec& _joint_inds, int _affinedofs=0, const OR::Vector _rotationaxis=OR::Vector()) :
-    robot(_robot), joint_inds(_joint_inds), affinedofs(_affinedofs), rotationaxis(_rotationaxis) {}
+  RobotAndDOF(OR::RobotBasePtr _robot, const IntVec& _joint_inds, int _affinedofs=0, const OR::Vector _rotationaxis=OR::Vector());
 
   void SetDOFValues(const DblVec& dofs);
   void GetDOFLimits(DblVec& lower, DblVec& upper) const;
   DblVec GetDOFValues() const;
   int GetDOF() const;
   IntVec GetJointIndices() const {return joint_inds;}
+  int GetAffineDOFs() const {return affinedofs;}
+  OR::Vector GetRotationAxis() const {return rotationaxis;}
+  /** NULL if KinematicTree::Create can't handle these DOFs */
+  KinematicTreePtr GetKinematics() const {return kinematics;}
+  /** Rebuild the kinematic tree, after changing the robot other than through the active DOFs, e.g. moving the base or grabbing a body */
+  void UpdateKinematics();
+  /** link_tfs[i] is set to the transform of GetRobot()->GetLinks()[i] at dofs */
+  void GetLinkTransforms(const DblVec& dofs, vector<OR::Transform>& link_tfs) const;
+  /** Transform of a link of the robot or of a body it grabs, from the output of GetLinkTransforms */
+  OR::Transform GetLinkTransform(const vector<OR::Transform>& link_tfs, const KinBody::Link& link) const;
+  /** Transform of link at dofs. Use GetLinkTransforms when several links are needed */
+  OR::Transform GetLinkTransform(const DblVec& dofs, const KinBody::Link& link) const;
+  /** Jacobian in the current state of the robot. Always computed by OpenRAVE, so it doesn't depend on UpdateKinematics */
   DblMatrix PositionJacobian(int link_ind, const OR::Vector& pt) const;
+  /** Jacobian at dofs, with link_tfs from GetLinkTransforms(dofs) */
+  DblMatrix PositionJacobian(const DblVec& dofs, const vector<OR::Transform>& link_tfs, int link_ind, const OR::Vector& pt) const;
+  /** Jacobians of pts[i] on link link_inds[i] stacked in jacs, see KinematicTree::PositionJacobians */
+  void PositionJacobians(const DblVec& dofs, const vector<OR::Transform>& link_tfs, const IntVec& link_inds,
+      const vector<OR::Vector>& pts, DblMatrix& jacs) const;
   DblMatrix RotationJacobian(int link_ind) const;
   OR::RobotBasePtr GetRobot() const {return robot;}
   OR::RobotBase::RobotStateSaver Save() {return OR::RobotBase::RobotStateSaver(robot, /*just save trans*/ 1);}
@@ -32,6 +54,7 @@ private:
   IntVec joint_inds;
   int affinedofs;
   OR::Vector rotationaxis;
+  KinematicTreePtr kinematics;
 };
 typedef boost::shared_ptr<RobotAndDOF> RobotAndDOFPtr;
 
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <openrave-core.h>
+#include "trajopt/robot_and_dof.hpp"
+#include "trajopt/rave_utils.hpp"
+#include "trajopt/utils.hpp"
+#include <cstdlib>
+#include "utils/eigen_conversions.hpp"
+using namespace OpenRAVE;
+using namespace std;
+using namespace trajopt;
+using namespace util;
+
+namespace {
+
+void ExpectSameKinematics(RobotAndDOF& rad) {
+  RobotBasePtr robot = rad.GetRobot();
+  ASSERT_TRUE(!!rad.GetKinematics());
+  KinBody::LinkPtr link = robot->GetLink("r_gripper_tool_frame");
+  ASSERT_TRUE(!!link);
+  for (int i=0; i < 10; ++i) {
+    DblVec dofs(rad.GetDOF());
+    for (int k=0; k < dofs.size(); ++k) dofs[k] = 2*rand()/(double)RAND_MAX - 1;
+    vector<OR::Transform> link_tfs;
+    rad.GetLinkTransforms(dofs, link_tfs);
+    OR::Vector pt = rad.GetLinkTransform(link_tfs, *link) * OR::Vector(.05, .02, -.01);
+    DblMatrix jac = rad.PositionJacobian(dofs, link_tfs, link->GetIndex(), pt);
+
+    KinBody::LinkPtr elbow = robot->GetLink("r_elbow_flex_link");
+    OR::Vector elbow_pt = rad.GetLinkTransform(link_tfs, *elbow).trans;
+    IntVec link_inds; link_inds.push_back(link->GetIndex()); link_inds.push_back(elbow->GetIndex());
+    vector<OR::Vector> pts; pts.push_back(pt); pts.push_back(elbow_pt);
+    DblMatrix jacs;
+    rad.PositionJacobians(dofs, link_tfs, link_inds, pts, jacs);
+    ASSERT_EQ(jacs.rows(), 6);
+    EXPECT_TRUE(jacs.topRows(3).isApprox(jac));
+    EXPECT_TRUE(jacs.bottomRows(3).isApprox(rad.PositionJacobian(dofs, link_tfs, elbow->GetIndex(), elbow_pt)));
+
+    RobotBase::RobotStateSaver saver = rad.Save();
+    rad.SetDOFValues(dofs);
+    for (int j=0; j < link_tfs.size(); ++j) {
+      OR::Transform expected = robot->GetLinks()[j]->GetTransform();
+      EXPECT_NEAR((link_tfs[j].trans - expected.trans).lengthsqr3(), 0, 1e-10);
+      EXPECT_NEAR(min((link_tfs[j].rot - expected.rot).lengthsqr4(), (link_tfs[j].rot + expected.rot).lengthsqr4()), 0, 1e-10);
+    }
+    rad.SetRobotActiveDOFs();
+    vector<double> jacdata;
+    robot->CalculateActiveJacobian(link->GetIndex(), pt, jacdata);
+    EXPECT_TRUE(jac.isApprox(Eigen::Map<DblMatrix>(jacdata.data(), 3, rad.GetDOF()), 1e-6));
+  }
+}
+
+}
+
+TEST(kinematic_tree, matches_openrave) {
+  RaveInitialize(false);
+  EnvironmentBasePtr env = RaveCreateEnvironment();
+  env->StopSimulation();
+  ASSERT_TRUE(env->Load("robots/pr2-beta-static.zae"));
+  RobotBasePtr robot = GetRobot(*env);
+  ASSERT_TRUE(!!robot);
+  RobotBase::ManipulatorPtr manip = robot->GetManipulator("rightarm");
+
+  RobotAndDOF arm(robot, manip->GetArmIndices());
+  ExpectSameKinematics(arm);
+
+  RobotAndDOF arm_and_base(robot, manip->GetArmIndices(), DOF_X | DOF_Y | DOF_RotationAxis, OR::Vector(0,0,1));
+  ExpectSameKinematics(arm_and_base);
+
+  // rotations other than around an axis fall back to setting the DOF values
+  RobotAndDOF free_base(robot, manip->GetArmIndices(), DOF_X | DOF_Y | DOF_Z | DOF_Rotation3D);
+  EXPECT_FALSE(!!free_base.GetKinematics());
+
+  env->Destroy();
+}
@@ -158,29 +158,34 @@ void PyTrajOptProb::AddConstraint1(py::object f, py::list ijs, const string& typ
 	ConstraintType type = _GetConstraintType(typestr);
 	VarVector vars = _GetVars(ijs, m_prob->GetVars());
 	ConstraintPtr c(new ConstraintFromFunc(VectorOfVectorPtr(new VectorFuncFromPy(f)), vars, type, name));
+	m_prob->num_threads = 1;
 	m_prob->addConstr(c);
 }
 void PyTrajOptProb::AddConstraint2(py::object f, py::object dfdx, py::list ijs, const string& typestr, const string& name) {
 	ConstraintType type = _GetConstraintType(typestr);
 	VarVector vars = _GetVars(ijs, m_prob->GetVars());
 	ConstraintPtr c(new ConstraintFromFunc(VectorOfVectorPtr(new VectorFuncFromPy(f)), MatrixOfVectorPtr(new MatrixFuncFromPy(dfdx)), vars, type, name));
+	m_prob->num_threads = 1;
 	m_prob->addConstr(c);
 }
 void PyTrajOptProb::AddCost1(py::object f, py::list ijs, const string& name) {
 	VarVector vars = _GetVars(ijs, m_prob->GetVars());
 	CostPtr c(new CostFromFunc(ScalarOfVectorPtr(new ScalarFuncFromPy(f)), vars, "f"));
+	m_prob->num_threads = 1;
 	m_prob->addCost(c);
 }
 void PyTrajOptProb::AddErrCost1(py::object f, py::list ijs, const string& typestr, const string& name) {
 	PenaltyType type = _GetPenaltyType(typestr);
 	VarVector vars = _GetVars(ijs, m_prob->GetVars());
 	CostPtr c(new CostFromErrFunc(VectorOfVectorPtr(new VectorFuncFromPy(f)), vars, VectorXd(), type, name));
+	m_prob->num_threads = 1;
 	m_prob->addCost(c);
 }
 void PyTrajOptProb::AddErrCost2(py::object f, py::object dfdx, py::list ijs, const string& typestr, const string& name) {
 	PenaltyType type = _GetPenaltyType(typestr);
 	VarVector vars = _GetVars(ijs, m_prob->GetVars());
 	CostPtr c(new CostFromErrFunc(VectorOfVectorPtr(new VectorFuncFromPy(f)), MatrixOfVectorPtr(new MatrixFuncFromPy(dfdx)), vars, VectorXd(), type, name));
+	m_prob->num_threads = 1;
 	m_prob->addCost(c);
 }
 
@@ -235,6 +240,14 @@ public:
 		}
 		return out;
 	}
+	py::object GetConstraintPenalties() {
+		py::list out;
+		int n_cnts = m_result->cnt_names.size();
+		for (int i=0; i < n_cnts; ++i) {
+			out.append(py::make_tuple(m_result->cnt_names[i], m_result->cnt_coeffs[i]));
+		}
+		return out;
+	}
 	py::object GetTraj() {
 		TrajArray &traj = m_result->traj;
 		py::object out = np_mod.attr("empty")(py::make_tuple(traj.rows(), traj.cols()));
@@ -245,6 +258,11 @@ public:
 		}
 		return out;
 	}
+	string GetStatus() {return m_result->status;}
+	py::object GetIterations() {
+		return py::import("json").attr("loads")(m_result->iterations.toStyledString());
+	}
+	bool IsFeasible() {return m_result->feasible;}
 	py::object __str__() {
 		return GetCosts().attr("__str__")() + GetConstraints().attr("__str__")();
 	}
@@ -384,7 +402,11 @@ BOOST_PYTHON_MODULE(ctrajoptpy) {
 	py::class_<PyTrajOptResult>("TrajOptResult", py::no_init)
     				  .def("GetCosts", &PyTrajOptResult::GetCosts)
     				  .def("GetConstraints", &PyTrajOptResult::GetConstraints)
+    				  .def("GetConstraintPenalties", &PyTrajOptResult::GetConstraintPenalties)
     				  .def("GetTraj", &PyTrajOptResult::GetTraj)
+    				  .def("GetStatus", &PyTrajOptResult::GetStatus)
+    				  .def("IsFeasible", &PyTrajOptResult::IsFeasible)
+    				  .def("GetIterations", &PyTrajOptResult::GetIterations, "per-iteration timings and QP sizes, as a list of dicts")
     				  .def("__str__", &PyTrajOptResult::__str__)
     				  ;
 
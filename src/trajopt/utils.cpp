@@ -12,6 +12,18 @@ TrajArray getTraj(const vector<double>& x, const VarArray& vars) {
   return out;
 }
 
+void setTrajStages(OptProb& prob, const VarArray& vars) {
+  VarVector stage_vars;
+  IntVec stages;
+  for (int i=0; i < vars.rows(); ++i) {
+    for (int j=0; j < vars.cols(); ++j) {
+      stage_vars.push_back(vars(i,j));
+      stages.push_back(i);
+    }
+  }
+  prob.getModel()->setVarStages(stage_vars, stages);
+}
+
 Eigen::Matrix3d toRot(const OR::Vector& rq) {
   Eigen::Affine3d T;
   T = Eigen::Quaterniond(rq[0], rq[1], rq[2], rq[3]);
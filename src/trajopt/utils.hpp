@@ -8,6 +8,11 @@ namespace trajopt {
 Extract trajectory array from solution vector x using indices in array vars
 */
 TrajArray TRAJOPT_API getTraj(const vector<double>& x, const VarArray& vars);
+/**
+Tell the model of prob that row i of vars is time step i, so that the convex subproblems can be factorized
+step by step (see sco::Model::setVarStages)
+*/
+void TRAJOPT_API setTrajStages(OptProb& prob, const VarArray& vars);
 
 inline Vector3d toVector3d(const OR::Vector& v) {
   return Vector3d(v.x, v.y, v.z);
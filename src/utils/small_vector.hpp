@@ -0,0 +1,125 @@
+#pragma once
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+#include <algorithm>
+
+namespace util {
+
+/**
+Vector of plain old data that keeps up to N elements in place and only allocates when it grows beyond that.
+Elements are copied with memcpy, so T must not have a constructor or destructor that matters.
+*/
+template<class T, int N>
+class SmallVector {
+public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  SmallVector() : data_(buf_), size_(0), capacity_(N) {}
+  explicit SmallVector(size_t n, const T& val = T()) : data_(buf_), size_(0), capacity_(N) {
+    resize(n, val);
+  }
+  SmallVector(const T* first, const T* last) : data_(buf_), size_(0), capacity_(N) {
+    append(first, last - first);
+  }
+  SmallVector(const SmallVector& other) : data_(buf_), size_(0), capacity_(N) {
+    append(other.data_, other.size_);
+  }
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) {
+      size_ = 0;
+      append(other.data_, other.size_);
+    }
+    return *this;
+  }
+  ~SmallVector() {
+    if (data_ != buf_) free(data_);
+  }
+
+  size_t size() const {return size_;}
+  bool empty() const {return size_ == 0;}
+  size_t capacity() const {return capacity_;}
+  T* data() {return data_;}
+  const T* data() const {return data_;}
+  iterator begin() {return data_;}
+  iterator end() {return data_ + size_;}
+  const_iterator begin() const {return data_;}
+  const_iterator end() const {return data_ + size_;}
+  T& operator[](size_t i) {assert(i < size_); return data_[i];}
+  const T& operator[](size_t i) const {assert(i < size_); return data_[i];}
+  T& back() {return data_[size_-1];}
+  const T& back() const {return data_[size_-1];}
+
+  void clear() {size_ = 0;}
+  void reserve(size_t n) {
+    if (n <= capacity_) return;
+    T* data = static_cast<T*>(malloc(n * sizeof(T)));
+    if (!data) throw std::bad_alloc();
+    if (size_ > 0) memcpy(data, data_, size_ * sizeof(T));
+    if (data_ != buf_) free(data_);
+    data_ = data;
+    capacity_ = n;
+  }
+  void resize(size_t n, const T& val = T()) {
+    if (n > capacity_) reserve(std::max(n, 2*capacity_));
+    for (size_t i=size_; i < n; ++i) data_[i] = val;
+    size_ = n;
+  }
+  void push_back(const T& val) {
+    if (size_ == capacity_) {
+      T copy = val; // val may live in this vector
+      reserve(2*capacity_);
+      data_[size_++] = copy;
+    }
+    else data_[size_++] = val;
+  }
+  void append(const T* vals, size_t n) {
+    if (size_ + n > capacity_) {
+      // vals may live in this vector, and reserve frees the old buffer
+      bool inside = vals >= data_ && vals < data_ + size_;
+      size_t offset = inside ? vals - data_ : 0;
+      reserve(std::max(size_ + n, 2*capacity_));
+      if (inside) vals = data_ + offset;
+    }
+    if (n > 0) memmove(data_ + size_, vals, n * sizeof(T));
+    size_ += n;
+  }
+  template<class InputIt>
+  void assign(InputIt first, InputIt last) {
+    clear();
+    for (; first != last; ++first) push_back(*first);
+  }
+  /** Exchange contents. Heap buffers change owner instead of being copied */
+  void swap(SmallVector& other) {
+    if (data_ == buf_ && other.data_ == other.buf_) {
+      for (int i=0; i < N; ++i) std::swap(buf_[i], other.buf_[i]);
+      std::swap(size_, other.size_);
+    }
+    else if (data_ != buf_ && other.data_ != other.buf_) {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(capacity_, other.capacity_);
+    }
+    else if (data_ != buf_) other.swapWithHeap(*this);
+    else swapWithHeap(other);
+  }
+
+private:
+  // this vector uses its inline buffer and other is on the heap
+  void swapWithHeap(SmallVector& other) {
+    if (size_ > 0) memcpy(other.buf_, buf_, size_ * sizeof(T));
+    data_ = other.data_;
+    other.data_ = other.buf_;
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+  T* data_;
+  size_t size_, capacity_;
+  T buf_[N];
+};
+
+}